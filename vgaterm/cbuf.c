@@ -258,7 +258,9 @@ void * cbuf_peek_back(CircBuf *cbuf, int n)
 {
 	int i;
 
-	i = (cbuf->puti - n) % cbuf->nmemb;
+	i = (cbuf->puti - n) % (int) cbuf->nmemb;
+	if (i < 0)
+		i += cbuf->nmemb;
 
 //printf("cbuf_peek_back(): %p\n", (void *) (cbuf->buf + (i * cbuf->elem_size)));
 	return (void *) (cbuf->buf + (i * cbuf->elem_size));
@@ -31,6 +31,11 @@
 void vga_term_emu_init		(VGATerm *term);
 void vga_term_emu_writec	(VGATerm *term, guchar c);
 void vga_term_emu_write		(VGATerm *term, gchar *s);
+void vga_term_emu_write_len	(VGATerm *term, const guchar *s,
+				 gsize len);
 gchar * vga_term_emu_vtkey	(VGATerm *term, guchar c);
+gboolean vga_term_emu_save	(VGATerm *term, GByteArray *out);
+gboolean vga_term_emu_restore	(VGATerm *term, const guchar *src,
+				 gsize len);
 
 #endif	/* __EMULATION_H__ */
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Build time generator for def_atlas.h and def_palette_rgb.h.  It
+ *  expands the default font (def_font.h) into a ready to paint glyph
+ *  atlas, and the default palette (def_palette.h) into GDK color values,
+ *  so that none of this has to be worked out when a widget is created.
+ *
+ *  Usage: gen-atlas font > def_atlas.h
+ *         gen-atlas palette > def_palette_rgb.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vgarender.h"
+#include "def_font.h"
+#include "def_palette.h"
+
+#define FONT_WIDTH	8
+#define FONT_HEIGHT	16
+#define PALETTE_REGS	64
+
+static int gen_font(void)
+{
+	VGAAtlas *atlas;
+	int i, n;
+
+	atlas = vga_atlas_new(default_font, FONT_WIDTH, FONT_HEIGHT, 1, 0);
+	if (atlas == NULL)
+	{
+		fprintf(stderr, "gen-atlas: out of memory\n");
+		return 1;
+	}
+
+	printf("/* Generated by gen-atlas from def_font.h.  Do not edit. */\n\n");
+	printf("#ifndef __DEF_ATLAS_H__\n#define __DEF_ATLAS_H__\n\n");
+	printf("#include <stdint.h>\n\n");
+
+	printf("#define DEFAULT_ATLAS_FONT_WIDTH\t%d\n", FONT_WIDTH);
+	printf("#define DEFAULT_ATLAS_FONT_HEIGHT\t%d\n\n", FONT_HEIGHT);
+
+	/* One line per glyph row; X is a set pixel */
+	printf("#define X 0xffffffffU\n");
+	printf("static const uint32_t default_atlas_masks[] = {\n");
+	n = atlas->glyph_size * VGA_ATLAS_GLYPHS;
+	for (i = 0; i < n; i++)
+	{
+		printf(atlas->masks[i] ? "X," : "0,");
+		if ((i + 1) % atlas->width == 0)
+			printf("\n");
+	}
+	printf("};\n#undef X\n\n#endif\n");
+
+	vga_atlas_destroy(atlas);
+
+	return 0;
+}
+
+static int gen_palette(void)
+{
+	int i;
+
+	printf("/* Generated by gen-atlas from def_palette.h.  "
+	       "Do not edit. */\n\n");
+	printf("#ifndef __DEF_PALETTE_RGB_H__\n"
+	       "#define __DEF_PALETTE_RGB_H__\n\n");
+
+	/* Same conversion as TO_GDK_RGB() in vgapalette.h */
+	printf("static const unsigned short "
+	       "default_palette_rgb[%d][3] = {\n", PALETTE_REGS);
+	for (i = 0; i < PALETTE_REGS; i++)
+		printf("{0x%04x,0x%04x,0x%04x},\n",
+		       (unsigned short) (default_palette[i * 3] * 1040.23809 + 0.5),
+		       (unsigned short) (default_palette[i * 3 + 1] * 1040.23809 + 0.5),
+		       (unsigned short) (default_palette[i * 3 + 2] * 1040.23809 + 0.5));
+	printf("};\n\n#endif\n");
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "font") == 0)
+		return gen_font();
+	if (argc == 2 && strcmp(argv[1], "palette") == 0)
+		return gen_palette();
+
+	fprintf(stderr, "Usage: %s font|palette\n", argv[0]);
+	return 1;
+}
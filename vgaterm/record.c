@@ -0,0 +1,750 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "record.h"
+#include "session.h"
+#include "emulation.h"
+
+#define RECORD_ALIGN(n)		(((n) + 7) & ~7)
+
+/* Output written this close together goes in one DATA chunk */
+#define RECORD_COALESCE_MS	10
+#define RECORD_CHUNK_MAX	(64 * 1024)
+
+/* Real time playback period, and time spent per main loop iteration
+ * playing at full speed */
+#define PLAYER_TICK_MS		33
+#define PLAYER_SLICE_MS		20
+
+#define CHUNK_NEXT(ofs, chunk) \
+	((ofs) + sizeof(VGARecordChunk) + RECORD_ALIGN((gsize) (chunk)->len))
+
+struct _VGARecorder {
+	VGATerm *term;
+	FILE *f;
+	gboolean failed;
+	guint64 ofs;		/* Bytes written so far */
+	GTimer *timer;
+	GArray *index;		/* Of VGARecordIndexEntry */
+	gint key_ms;
+	gsize key_bytes;
+	gint64 key_time;	/* Of the last keyframe */
+	gsize key_since;	/* Output since then */
+	GByteArray *pending;	/* Output for the next DATA chunk */
+	gint64 pending_time;
+};
+
+struct _VGAPlayer {
+	VGATerm *term;
+	GMappedFile *file;
+	const guchar *data;
+	gsize len;		/* Up to the end of the last chunk to play */
+	GArray *index;		/* Of VGARecordIndexEntry */
+	gint64 duration;
+	gsize ofs;		/* Of the next chunk to play */
+	gint64 pos;		/* Time played up to */
+	gdouble speed;
+	guint source_id;
+	GTimer *timer;		/* Real time since playing from play_pos */
+	gint64 play_pos;
+};
+
+static gint64
+recorder_now(VGARecorder *rec)
+{
+	return (gint64) (g_timer_elapsed(rec->timer, NULL) * 1000);
+}
+
+static void
+recorder_put(VGARecorder *rec, const void *p, gsize len)
+{
+	if (!rec->failed && len > 0 && fwrite(p, 1, len, rec->f) != len)
+		rec->failed = TRUE;
+	rec->ofs += len;
+}
+
+static void
+recorder_chunk(VGARecorder *rec, guint32 id, gint64 time,
+	       const void *data, gsize len)
+{
+	static const guchar zero[8];
+	VGARecordChunk chunk;
+
+	chunk.id = id;
+	chunk.len = len;
+	chunk.time = time;
+	recorder_put(rec, &chunk, sizeof(chunk));
+	recorder_put(rec, data, len);
+	recorder_put(rec, zero, RECORD_ALIGN(len) - len);
+}
+
+static void
+recorder_flush(VGARecorder *rec)
+{
+	if (rec->pending->len == 0)
+		return;
+
+	recorder_chunk(rec, VGA_RECORD_CHUNK_DATA, rec->pending_time,
+		       rec->pending->data, rec->pending->len);
+	g_byte_array_set_size(rec->pending, 0);
+}
+
+static void
+recorder_keyframe(VGARecorder *rec, gint64 time)
+{
+	VGARecordIndexEntry entry;
+	GByteArray *snap;
+
+	recorder_flush(rec);
+
+	snap = vga_term_session_save(rec->term);
+	entry.time = time;
+	entry.offset = rec->ofs;
+	g_array_append_val(rec->index, entry);
+	recorder_chunk(rec, VGA_RECORD_CHUNK_KEYFRAME, time,
+		       snap->data, snap->len);
+	g_byte_array_free(snap, TRUE);
+
+	rec->key_time = time;
+	rec->key_since = 0;
+}
+
+/**
+ * vga_recorder_new:
+ * @term: VGATerm object, set up with vga_term_emu_init()
+ * @fname: File to record to
+ *
+ * Start recording @term, from its current state, to @fname.  Output
+ * to be recorded has to go through vga_recorder_write() rather than
+ * straight to the emulator.
+ *
+ * Returns: the recorder, or NULL if @fname couldn't be created
+ */
+VGARecorder *
+vga_recorder_new(VGATerm *term, const gchar *fname)
+{
+	VGARecordHeader hdr;
+	VGARecorder *rec;
+	FILE *f;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), NULL);
+	g_return_val_if_fail(fname != NULL, NULL);
+	g_return_val_if_fail(g_object_get_data(G_OBJECT(term), "emu_data"),
+			     NULL);
+
+	f = fopen(fname, "wb");
+	if (f == NULL)
+		return NULL;
+
+	rec = g_new0(VGARecorder, 1);
+	rec->term = g_object_ref(term);
+	rec->f = f;
+	rec->index = g_array_new(FALSE, FALSE, sizeof(VGARecordIndexEntry));
+	rec->pending = g_byte_array_sized_new(RECORD_CHUNK_MAX);
+	rec->key_ms = VGA_RECORD_KEYFRAME_MS;
+	rec->key_bytes = VGA_RECORD_KEYFRAME_BYTES;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, VGA_RECORD_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = VGA_SESSION_BYTE_ORDER;
+	hdr.version = VGA_RECORD_VERSION;
+	recorder_put(rec, &hdr, sizeof(hdr));
+
+	recorder_keyframe(rec, 0);
+	rec->timer = g_timer_new();
+
+	return rec;
+}
+
+/*
+ * Keyframe after @ms of recording or @bytes of output since the last
+ * one, whichever comes first.  Seeking replays at most that much, but
+ * every keyframe costs a snapshot, scrollback and all.
+ */
+void
+vga_recorder_set_keyframe_interval(VGARecorder *rec, gint ms, gsize bytes)
+{
+	g_return_if_fail(rec != NULL);
+	g_return_if_fail(ms > 0 && bytes > 0);
+
+	rec->key_ms = ms;
+	rec->key_bytes = bytes;
+}
+
+/* Write output to the emulator, recording it */
+void
+vga_recorder_write(VGARecorder *rec, const guchar *s, gsize len)
+{
+	gint64 now;
+	gsize n;
+
+	g_return_if_fail(rec != NULL);
+	g_return_if_fail(s != NULL || len == 0);
+
+	if (len == 0)
+		return;
+
+	vga_term_emu_write_len(rec->term, s, len);
+	rec->key_since += len;
+
+	now = recorder_now(rec);
+	if (rec->pending->len > 0 &&
+	    now - rec->pending_time >= RECORD_COALESCE_MS)
+		recorder_flush(rec);
+	for (; len > 0; s += n, len -= n)
+	{
+		if (rec->pending->len == RECORD_CHUNK_MAX)
+			recorder_flush(rec);
+		if (rec->pending->len == 0)
+			rec->pending_time = now;
+		n = MIN(len, RECORD_CHUNK_MAX - rec->pending->len);
+		g_byte_array_append(rec->pending, s, n);
+	}
+
+	if (rec->key_since >= rec->key_bytes ||
+	    now - rec->key_time >= rec->key_ms)
+		recorder_keyframe(rec, now);
+}
+
+/*
+ * Finish the recording with its index, and free @rec.
+ * Returns FALSE if any of it couldn't be written.
+ */
+gboolean
+vga_recorder_close(VGARecorder *rec)
+{
+	VGARecordTrailer trailer;
+	gboolean result;
+
+	g_return_val_if_fail(rec != NULL, FALSE);
+
+	recorder_flush(rec);
+
+	memset(&trailer, 0, sizeof(trailer));
+	trailer.index_offset = rec->ofs;
+	memcpy(trailer.magic, VGA_RECORD_MAGIC, sizeof(trailer.magic));
+	recorder_chunk(rec, VGA_RECORD_CHUNK_INDEX, recorder_now(rec),
+		       rec->index->data,
+		       rec->index->len * sizeof(VGARecordIndexEntry));
+	recorder_put(rec, &trailer, sizeof(trailer));
+
+	if (fclose(rec->f) != 0)
+		rec->failed = TRUE;
+	result = !rec->failed;
+
+	g_object_unref(rec->term);
+	g_timer_destroy(rec->timer);
+	g_array_free(rec->index, TRUE);
+	g_byte_array_free(rec->pending, TRUE);
+	g_free(rec);
+
+	return result;
+}
+
+/* Read the chunk at @ofs; FALSE if there isn't a whole one there */
+static gboolean
+player_chunk(VGAPlayer *player, gsize ofs, VGARecordChunk *chunk)
+{
+	if (ofs > player->len || player->len - ofs < sizeof(*chunk))
+		return FALSE;
+	memcpy(chunk, player->data + ofs, sizeof(*chunk));
+	return player->len - ofs - sizeof(*chunk) >= chunk->len;
+}
+
+/* Take the index from the end of a closed recording */
+static gboolean
+player_read_index(VGAPlayer *player)
+{
+	VGARecordTrailer trailer;
+	VGARecordIndexEntry *entries;
+	VGARecordChunk chunk;
+	gsize len, ofs;
+	guint i, n;
+
+	len = player->len;
+	if (len < sizeof(VGARecordHeader) + sizeof(trailer))
+		return FALSE;
+	memcpy(&trailer, player->data + len - sizeof(trailer),
+	       sizeof(trailer));
+	if (memcmp(trailer.magic, VGA_RECORD_MAGIC, sizeof(trailer.magic)) ||
+	    trailer.index_offset < sizeof(VGARecordHeader) ||
+	    trailer.index_offset > len - sizeof(trailer))
+		return FALSE;
+
+	ofs = trailer.index_offset;
+	player->len = len - sizeof(trailer);
+	if (!player_chunk(player, ofs, &chunk) ||
+	    chunk.id != VGA_RECORD_CHUNK_INDEX ||
+	    chunk.len % sizeof(VGARecordIndexEntry) != 0)
+	{
+		player->len = len;
+		return FALSE;
+	}
+
+	n = chunk.len / sizeof(VGARecordIndexEntry);
+	g_array_append_vals(player->index, player->data + ofs + sizeof(chunk),
+			    n);
+	entries = (VGARecordIndexEntry *) player->index->data;
+	for (i = 1; i < n; i++)
+	{
+		/* Seeking needs them in order */
+		if (entries[i].time < entries[i - 1].time)
+		{
+			g_array_set_size(player->index, 0);
+			player->len = len;
+			return FALSE;
+		}
+	}
+
+	player->duration = chunk.time;
+	player->len = ofs;
+
+	return TRUE;
+}
+
+/* Rebuild the index of a recording that was never closed */
+static void
+player_scan(VGAPlayer *player)
+{
+	VGARecordIndexEntry entry;
+	VGARecordChunk chunk;
+	gsize ofs;
+
+	for (ofs = sizeof(VGARecordHeader); player_chunk(player, ofs, &chunk);
+	     ofs = CHUNK_NEXT(ofs, &chunk))
+	{
+		if (chunk.id == VGA_RECORD_CHUNK_INDEX)
+			break;
+		if (chunk.id == VGA_RECORD_CHUNK_KEYFRAME)
+		{
+			entry.time = chunk.time;
+			entry.offset = ofs;
+			g_array_append_val(player->index, entry);
+		}
+		player->duration = MAX(player->duration, chunk.time);
+	}
+
+	/* Anything after that was cut short */
+	player->len = MIN(player->len, ofs);
+}
+
+/* Restore keyframe @i of the index, to play on from there */
+static gboolean
+player_restore(VGAPlayer *player, guint i)
+{
+	VGARecordIndexEntry *entry;
+	VGARecordChunk chunk;
+
+	entry = &g_array_index(player->index, VGARecordIndexEntry, i);
+	if (entry->offset > player->len ||
+	    !player_chunk(player, entry->offset, &chunk) ||
+	    chunk.id != VGA_RECORD_CHUNK_KEYFRAME)
+		return FALSE;
+	if (!vga_term_session_restore(player->term,
+			player->data + entry->offset + sizeof(chunk),
+			chunk.len))
+		return FALSE;
+
+	player->ofs = CHUNK_NEXT((gsize) entry->offset, &chunk);
+	player->pos = chunk.time;
+
+	return TRUE;
+}
+
+/* Play everything up to @time */
+static void
+player_advance(VGAPlayer *player, gint64 time)
+{
+	VGARecordChunk chunk;
+
+	vga_term_begin_batch(player->term);
+	while (player_chunk(player, player->ofs, &chunk) && chunk.time <= time)
+	{
+		if (chunk.id == VGA_RECORD_CHUNK_DATA)
+			vga_term_emu_write_len(player->term,
+				player->data + player->ofs + sizeof(chunk),
+				chunk.len);
+		player->ofs = CHUNK_NEXT(player->ofs, &chunk);
+	}
+	vga_term_end_batch(player->term);
+
+	player->pos = MAX(player->pos, MIN(time, player->duration));
+}
+
+static gboolean
+player_tick(gpointer data)
+{
+	VGAPlayer *player = data;
+	VGARecordChunk chunk;
+
+	/* Not held for timeouts, and the emulator may hand it over */
+	gdk_threads_enter();
+	if (player->speed <= 0)
+	{
+		/* Flat out, but give the main loop a look in */
+		g_timer_start(player->timer);
+		do {
+			if (!player_chunk(player, player->ofs, &chunk))
+			{
+				player_advance(player, player->duration);
+				break;
+			}
+			player_advance(player, chunk.time);
+		} while (g_timer_elapsed(player->timer, NULL) * 1000 <
+			 PLAYER_SLICE_MS);
+	}
+	else
+		player_advance(player, player->play_pos + (gint64)
+			(g_timer_elapsed(player->timer, NULL) * 1000 *
+			 player->speed));
+	gdk_threads_leave();
+
+	if (player->pos < player->duration)
+		return TRUE;
+
+	player->source_id = 0;
+	return FALSE;
+}
+
+/**
+ * vga_player_new:
+ * @term: VGATerm object to play to
+ * @fname: A recording made by a #VGARecorder
+ *
+ * Open a recording for playback, and put @term in the state it starts
+ * from.  The file is mapped rather than read.
+ *
+ * Returns: the player, or NULL if @fname isn't a recording
+ */
+VGAPlayer *
+vga_player_new(VGATerm *term, const gchar *fname)
+{
+	VGARecordHeader hdr;
+	GMappedFile *file;
+	VGAPlayer *player;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), NULL);
+	g_return_val_if_fail(fname != NULL, NULL);
+
+	file = g_mapped_file_new(fname, FALSE, NULL);
+	if (file == NULL)
+		return NULL;
+
+	player = g_new0(VGAPlayer, 1);
+	player->term = g_object_ref(term);
+	player->file = file;
+	player->data = (const guchar *) g_mapped_file_get_contents(file);
+	player->len = g_mapped_file_get_length(file);
+	player->index = g_array_new(FALSE, FALSE, sizeof(VGARecordIndexEntry));
+	player->speed = 1.0;
+	player->timer = g_timer_new();
+
+	if (player->len < sizeof(hdr))
+	{
+		vga_player_free(player);
+		return NULL;
+	}
+	memcpy(&hdr, player->data, sizeof(hdr));
+	if (memcmp(hdr.magic, VGA_RECORD_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.byte_order != VGA_SESSION_BYTE_ORDER ||
+	    hdr.version != VGA_RECORD_VERSION)
+	{
+		vga_player_free(player);
+		return NULL;
+	}
+
+	if (!player_read_index(player))
+		player_scan(player);
+	if (player->index->len == 0 || !vga_player_seek(player, 0))
+	{
+		vga_player_free(player);
+		return NULL;
+	}
+
+	return player;
+}
+
+void
+vga_player_free(VGAPlayer *player)
+{
+	g_return_if_fail(player != NULL);
+
+	vga_player_pause(player);
+	g_object_unref(player->term);
+	g_mapped_file_unref(player->file);
+	g_array_free(player->index, TRUE);
+	g_timer_destroy(player->timer);
+	g_free(player);
+}
+
+/* Length of the recording, in ms */
+gint64
+vga_player_get_duration(VGAPlayer *player)
+{
+	g_return_val_if_fail(player != NULL, 0);
+
+	return player->duration;
+}
+
+/* Time played up to, in ms */
+gint64
+vga_player_get_position(VGAPlayer *player)
+{
+	g_return_val_if_fail(player != NULL, 0);
+
+	return player->pos;
+}
+
+/**
+ * vga_player_seek:
+ * @player: A #VGAPlayer
+ * @time: ms into the recording
+ *
+ * Put the terminal in its state at @time, by restoring the last
+ * keyframe before it and playing the rest.  Seeking forward doesn't
+ * restore anything unless there's a keyframe on the way.  Playback
+ * carries on from @time.
+ *
+ * Returns: FALSE if the keyframe was bad
+ */
+gboolean
+vga_player_seek(VGAPlayer *player, gint64 time)
+{
+	VGARecordIndexEntry *entries;
+	guint lo, hi, mid;
+
+	g_return_val_if_fail(player != NULL, FALSE);
+
+	time = CLAMP(time, 0, player->duration);
+
+	/* Last keyframe at or before @time */
+	entries = (VGARecordIndexEntry *) player->index->data;
+	lo = 0;
+	hi = player->index->len;
+	while (hi - lo > 1)
+	{
+		mid = (lo + hi) / 2;
+		if (entries[mid].time <= time)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	if (time < player->pos || entries[lo].offset >= player->ofs)
+	{
+		if (!player_restore(player, lo))
+			return FALSE;
+	}
+	player_advance(player, time);
+
+	player->play_pos = player->pos;
+	g_timer_start(player->timer);
+
+	return TRUE;
+}
+
+/*
+ * Play from the current position to the end, from the main loop.
+ * @speed is relative to real time, or VGA_PLAYER_MAX_SPEED to play
+ * as fast as the emulator goes.
+ */
+void
+vga_player_play(VGAPlayer *player, gdouble speed)
+{
+	g_return_if_fail(player != NULL);
+
+	vga_player_pause(player);
+	if (player->pos >= player->duration)
+		return;
+
+	player->speed = speed;
+	player->play_pos = player->pos;
+	g_timer_start(player->timer);
+	if (speed <= 0)
+		player->source_id = g_idle_add(player_tick, player);
+	else
+		player->source_id = g_timeout_add(PLAYER_TICK_MS,
+						  player_tick, player);
+}
+
+void
+vga_player_pause(VGAPlayer *player)
+{
+	g_return_if_fail(player != NULL);
+
+	if (player->source_id != 0)
+	{
+		g_source_remove(player->source_id);
+		player->source_id = 0;
+	}
+}
+
+gboolean
+vga_player_is_playing(VGAPlayer *player)
+{
+	g_return_val_if_fail(player != NULL, FALSE);
+
+	return player->source_id != 0;
+}
+
+#ifdef UNIT_TEST
+/*
+ * Compile with:
+ *     gcc record.c -o record-test -DUNIT_TEST \
+ *         `pkg-config --cflags --libs libvgaterm-1.0`
+ * Needs a display.
+ */
+#include <assert.h>
+#include <unistd.h>
+
+#define TEST_FILE	"/tmp/record-test.rec"
+#define TEST_CUT	"/tmp/record-test-cut.rec"
+#define TEST_STEPS	10
+
+/* Whether the top line of @term reads "step @n" */
+static gboolean
+screen_is_step(VGATerm *term, int n)
+{
+	const guchar *cells = vga_get_video_buf(VGA_TEXT(term));
+	char s[16];
+	int i, len;
+
+	len = g_snprintf(s, sizeof(s), "step %d", n);
+	for (i = 0; i < len; i++)
+		if (cells[i * 2] != (guchar) s[i])
+			return FALSE;
+	return TRUE;
+}
+
+/* Time of each DATA chunk in @data, and the offset of the last one */
+static int
+data_times(const guchar *data, gsize len, gint64 *times, gsize *last)
+{
+	VGARecordChunk chunk;
+	gsize ofs;
+	int n = 0;
+
+	for (ofs = sizeof(VGARecordHeader); ofs + sizeof(chunk) <= len;
+	     ofs = CHUNK_NEXT(ofs, &chunk))
+	{
+		memcpy(&chunk, data + ofs, sizeof(chunk));
+		if (chunk.id == VGA_RECORD_CHUNK_INDEX)
+			break;
+		if (chunk.id == VGA_RECORD_CHUNK_DATA)
+		{
+			times[n++] = chunk.time;
+			*last = ofs;
+		}
+	}
+	return n;
+}
+
+/* Seek about the recording in @fname, which has its first @steps */
+static void
+check_playback(VGATerm *term, const gchar *fname, const gint64 *times,
+	       int steps)
+{
+	VGAPlayer *player;
+
+	/* Starts out as it was before anything was recorded */
+	player = vga_player_new(term, fname);
+	assert(player != NULL);
+	assert(!screen_is_step(term, 0));
+	assert(vga_player_get_duration(player) >= times[steps - 1]);
+
+	/* To the end, back before the middle keyframe, then forward past
+	 * another one and to a time between two steps */
+	assert(vga_player_seek(player, vga_player_get_duration(player)));
+	assert(screen_is_step(term, steps - 1));
+	assert(vga_player_seek(player, times[3]));
+	assert(screen_is_step(term, 3));
+	assert(vga_player_get_position(player) == times[3]);
+	assert(vga_player_seek(player, times[7]));
+	assert(screen_is_step(term, 7));
+	assert(vga_player_seek(player, times[8] - 1));
+	assert(screen_is_step(term, 7));
+	assert(vga_player_seek(player, times[1]));
+	assert(screen_is_step(term, 1));
+	assert(vga_player_seek(player, 0));
+	assert(!screen_is_step(term, 0));
+
+	vga_player_free(player);
+}
+
+int main(int argc, char *argv[])
+{
+	VGARecordTrailer trailer;
+	VGARecorder *rec;
+	GtkWidget *term;
+	gint64 times[TEST_STEPS];
+	gchar *data, s[32];
+	gsize len, last;
+	int i, n;
+
+	gtk_init(&argc, &argv);
+	term = vga_term_new();
+	vga_term_emu_init(VGA_TERM(term));
+
+	/* A keyframe every other step; steps far enough apart that each
+	 * gets a DATA chunk of its own */
+	rec = vga_recorder_new(VGA_TERM(term), TEST_FILE);
+	assert(rec != NULL);
+	vga_recorder_set_keyframe_interval(rec, 60000, 20);
+	for (i = 0; i < TEST_STEPS; i++)
+	{
+		g_usleep(20 * 1000);
+		n = g_snprintf(s, sizeof(s), "\033[1;1Hstep %d", i);
+		vga_recorder_write(rec, (guchar *) s, n);
+	}
+	assert(vga_recorder_close(rec));
+
+	assert(g_file_get_contents(TEST_FILE, &data, &len, NULL));
+	assert(data_times((guchar *) data, len, times, &last) == TEST_STEPS);
+
+	/* Closed, with its index */
+	check_playback(VGA_TERM(term), TEST_FILE, times, TEST_STEPS);
+
+	/* Without the trailer the index is rebuilt from the chunks */
+	assert(g_file_set_contents(TEST_CUT, data, len - sizeof(trailer),
+				   NULL));
+	check_playback(VGA_TERM(term), TEST_CUT, times, TEST_STEPS);
+
+	/* A trailer pointing anywhere but at an index isn't believed */
+	memcpy(&trailer, data + len - sizeof(trailer), sizeof(trailer));
+	trailer.index_offset = sizeof(VGARecordHeader);
+	memcpy(data + len - sizeof(trailer), &trailer, sizeof(trailer));
+	assert(g_file_set_contents(TEST_CUT, data, len, NULL));
+	check_playback(VGA_TERM(term), TEST_CUT, times, TEST_STEPS);
+
+	/* Cut off in the middle of the last step, which is dropped */
+	assert(g_file_set_contents(TEST_CUT, data,
+				   last + sizeof(VGARecordChunk) + 2, NULL));
+	check_playback(VGA_TERM(term), TEST_CUT, times, TEST_STEPS - 1);
+
+	unlink(TEST_CUT);
+	unlink(TEST_FILE);
+	g_free(data);
+	gtk_widget_destroy(term);
+
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
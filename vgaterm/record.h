@@ -0,0 +1,108 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Recording the output fed to a terminal with timestamps, and playing
+ *  it back in real time or as fast as possible, with seeking.
+ *
+ *  Layout, all in host byte order:
+ *
+ *    VGARecordHeader
+ *    Chunks, each a VGARecordChunk and then len bytes of data,
+ *    padded to a multiple of 8 bytes
+ *    VGARecordTrailer, if the recording was closed
+ *
+ *  DATA chunks hold output just as it was fed to the emulator.  Every so
+ *  often a KEYFRAME chunk holds a vga_term_session_save() snapshot of
+ *  the state after all the DATA before it; there is always one at time
+ *  0.  The INDEX chunk comes last and lists the keyframes, so a seek
+ *  restores the nearest keyframe and replays only what came after it.
+ *  A recording that was never closed still plays; its index is rebuilt
+ *  from the chunk headers.
+ */
+
+#ifndef __VGA_RECORD_H__
+#define __VGA_RECORD_H__
+
+#include "vgaterm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define VGA_RECORD_MAGIC	"VGARECD"	/* With its NUL, 8 bytes */
+#define VGA_RECORD_VERSION	1
+
+/* Keyframe after this long or this much output, whichever comes first */
+#define VGA_RECORD_KEYFRAME_MS		30000
+#define VGA_RECORD_KEYFRAME_BYTES	(1024 * 1024)
+
+/* For vga_player_play() */
+#define VGA_PLAYER_MAX_SPEED	0.0
+
+typedef struct {
+	char magic[8];
+	guint32 byte_order;	/* VGA_SESSION_BYTE_ORDER as written */
+	guint32 version;
+	guint32 reserved[2];
+} VGARecordHeader;
+
+typedef struct {
+	guint32 id;		/* VGA_RECORD_CHUNK_* */
+	guint32 len;		/* Not counting this or the padding */
+	gint64 time;		/* ms since the recording started */
+} VGARecordChunk;
+
+/* The INDEX chunk is an array of these */
+typedef struct {
+	gint64 time;
+	guint64 offset;		/* Of the keyframe's VGARecordChunk */
+} VGARecordIndexEntry;
+
+typedef struct {
+	guint64 index_offset;	/* Of the INDEX chunk's VGARecordChunk */
+	char magic[8];
+} VGARecordTrailer;
+
+enum {
+	VGA_RECORD_CHUNK_DATA = 1,
+	VGA_RECORD_CHUNK_KEYFRAME,
+	VGA_RECORD_CHUNK_INDEX
+};
+
+typedef struct _VGARecorder VGARecorder;
+typedef struct _VGAPlayer VGAPlayer;
+
+VGARecorder *	vga_recorder_new	(VGATerm *term, const gchar *fname);
+void		vga_recorder_set_keyframe_interval (VGARecorder *rec,
+						 gint ms, gsize bytes);
+void		vga_recorder_write	(VGARecorder *rec, const guchar *s,
+					 gsize len);
+gboolean	vga_recorder_close	(VGARecorder *rec);
+
+VGAPlayer *	vga_player_new		(VGATerm *term, const gchar *fname);
+void		vga_player_free		(VGAPlayer *player);
+gint64		vga_player_get_duration	(VGAPlayer *player);
+gint64		vga_player_get_position	(VGAPlayer *player);
+gboolean	vga_player_seek		(VGAPlayer *player, gint64 time);
+void		vga_player_play		(VGAPlayer *player, gdouble speed);
+void		vga_player_pause	(VGAPlayer *player);
+gboolean	vga_player_is_playing	(VGAPlayer *player);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __VGA_RECORD_H__ */
@@ -0,0 +1,314 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rowcache.h"
+
+#define MIN(a, b)  (((a) < (b)) ? (a) : (b))
+
+struct _RowCacheEntry {
+	uint64_t hash;
+	int prev, next;		/* LRU list, -1 terminated */
+	int chain;		/* Next entry in the same bucket */
+};
+
+#define ENTRY_KEY(cache, i) \
+	((cache)->data + (size_t) (i) * \
+	 ((cache)->key_len + (cache)->line_len * (cache)->lines))
+#define ENTRY_STRIP(cache, i)	(ENTRY_KEY(cache, i) + (cache)->key_len)
+
+RowCache * rowcache_new(size_t max_bytes, int max_entries)
+{
+	RowCache *cache;
+
+	cache = calloc(1, sizeof(RowCache));
+	if (cache == NULL)
+		return NULL;
+
+	cache->max_bytes = max_bytes;
+	cache->max_entries = max_entries;
+	cache->mru = cache->lru = -1;
+
+	return cache;
+}
+
+static void rowcache_free_entries(RowCache *cache)
+{
+	free(cache->entries);
+	free(cache->buckets);
+	free(cache->data);
+	cache->entries = NULL;
+	cache->buckets = NULL;
+	cache->data = NULL;
+	cache->nmemb = cache->nbuckets = cache->used = 0;
+	cache->mru = cache->lru = -1;
+}
+
+void rowcache_destroy(RowCache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	rowcache_free_entries(cache);
+	free(cache);
+}
+
+/*
+ * Drop every entry and set the size of keys and strips from now on.
+ * As many entries as fit max_bytes are allocated, up to max_entries.
+ * Returns 0 if not even one fits (or memory ran out), in which case
+ * the cache just never hits.
+ */
+int rowcache_reset(RowCache *cache, size_t key_len, size_t line_len,
+		   int lines)
+{
+	size_t per_entry;
+	int i;
+
+	rowcache_free_entries(cache);
+	cache->key_len = key_len;
+	cache->line_len = line_len;
+	cache->lines = lines;
+
+	per_entry = key_len + line_len * lines;
+	if (per_entry == 0)
+		return 0;
+	cache->nmemb = MIN((size_t) cache->max_entries,
+			   cache->max_bytes / per_entry);
+	if (cache->nmemb == 0)
+		return 0;
+
+	/* Power of two, at least twice the entries for short chains */
+	for (cache->nbuckets = 1; cache->nbuckets < cache->nmemb * 2;
+	     cache->nbuckets <<= 1)
+		;
+
+	cache->entries = malloc(sizeof(RowCacheEntry) * cache->nmemb);
+	cache->buckets = malloc(sizeof(int) * cache->nbuckets);
+	cache->data = malloc(per_entry * cache->nmemb);
+	if (cache->entries == NULL || cache->buckets == NULL ||
+	    cache->data == NULL)
+	{
+		rowcache_free_entries(cache);
+		return 0;
+	}
+	for (i = 0; i < cache->nbuckets; i++)
+		cache->buckets[i] = -1;
+
+	return 1;
+}
+
+/*
+ * FNV-1a over @data, continuing from @hash.  Start a new hash with
+ * ROWCACHE_HASH_INIT.
+ */
+uint64_t rowcache_hash(const void *data, size_t len, uint64_t hash)
+{
+	const unsigned char *p = data;
+
+	while (len--)
+	{
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static void rowcache_unlink(RowCache *cache, int i)
+{
+	RowCacheEntry *e = &cache->entries[i];
+
+	if (e->prev != -1)
+		cache->entries[e->prev].next = e->next;
+	else
+		cache->mru = e->next;
+	if (e->next != -1)
+		cache->entries[e->next].prev = e->prev;
+	else
+		cache->lru = e->prev;
+}
+
+static void rowcache_push_mru(RowCache *cache, int i)
+{
+	RowCacheEntry *e = &cache->entries[i];
+
+	e->prev = -1;
+	e->next = cache->mru;
+	if (cache->mru != -1)
+		cache->entries[cache->mru].prev = i;
+	else
+		cache->lru = i;
+	cache->mru = i;
+}
+
+static int rowcache_find(RowCache *cache, uint64_t hash, const void *key)
+{
+	int i;
+
+	for (i = cache->buckets[hash & (cache->nbuckets - 1)]; i != -1;
+	     i = cache->entries[i].chain)
+	{
+		if (cache->entries[i].hash == hash &&
+		    memcmp(ENTRY_KEY(cache, i), key, cache->key_len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Look up @key (whose rowcache_hash() is @hash) and on a hit copy its
+ * strip to @dst, @dst_stride bytes per line.  Returns 1 on a hit.
+ */
+int rowcache_fetch(RowCache *cache, uint64_t hash, const void *key,
+		   void *dst, int dst_stride)
+{
+	unsigned char *strip, *d = dst;
+	int i, y;
+
+	if (cache->nmemb == 0 ||
+	    (i = rowcache_find(cache, hash, key)) == -1)
+	{
+		cache->misses++;
+		return 0;
+	}
+
+	strip = ENTRY_STRIP(cache, i);
+	for (y = 0; y < cache->lines; y++)
+		memcpy(d + (size_t) y * dst_stride,
+		       strip + (size_t) y * cache->line_len, cache->line_len);
+
+	rowcache_unlink(cache, i);
+	rowcache_push_mru(cache, i);
+	cache->hits++;
+
+	return 1;
+}
+
+/* Remember the strip at @src (@src_stride bytes per line) for @key */
+void rowcache_store(RowCache *cache, uint64_t hash, const void *key,
+		    const void *src, int src_stride)
+{
+	const unsigned char *s = src;
+	unsigned char *strip;
+	int i, y, *link;
+
+	if (cache->nmemb == 0)
+		return;
+
+	i = rowcache_find(cache, hash, key);
+	if (i != -1)
+		rowcache_unlink(cache, i);
+	else
+	{
+		if (cache->used < cache->nmemb)
+			i = cache->used++;
+		else
+		{
+			/* Evict the least recently used entry */
+			i = cache->lru;
+			rowcache_unlink(cache, i);
+			link = &cache->buckets[cache->entries[i].hash &
+					       (cache->nbuckets - 1)];
+			while (*link != i)
+				link = &cache->entries[*link].chain;
+			*link = cache->entries[i].chain;
+		}
+
+		cache->entries[i].hash = hash;
+		link = &cache->buckets[hash & (cache->nbuckets - 1)];
+		cache->entries[i].chain = *link;
+		*link = i;
+		memcpy(ENTRY_KEY(cache, i), key, cache->key_len);
+	}
+
+	strip = ENTRY_STRIP(cache, i);
+	for (y = 0; y < cache->lines; y++)
+		memcpy(strip + (size_t) y * cache->line_len,
+		       s + (size_t) y * src_stride, cache->line_len);
+
+	rowcache_push_mru(cache, i);
+}
+
+#ifdef UNIT_TEST
+/* Compile with: gcc rowcache.c -o rowcache-test -DUNIT_TEST */
+#include <assert.h>
+#include <stdio.h>
+int main(void)
+{
+	RowCache *cache;
+	unsigned char key[4], strip[2][8], out[2][8];
+	uint64_t hash;
+	int i;
+
+	/* Room for exactly 3 entries of 4 key bytes + 2x6 strip bytes */
+	cache = rowcache_new(3 * (4 + 12), 100);
+	assert(cache != NULL);
+	assert(rowcache_reset(cache, 4, 6, 2) == 1);
+	assert(cache->nmemb == 3);
+
+	for (i = 0; i < 4; i++)
+	{
+		memset(key, i, sizeof(key));
+		memset(strip, 0x10 + i, sizeof(strip));
+		hash = rowcache_hash(key, sizeof(key), ROWCACHE_HASH_INIT);
+		assert(!rowcache_fetch(cache, hash, key, out, 8));
+		rowcache_store(cache, hash, key, strip, 8);
+	}
+
+	/* Key 0 was the least recently used when key 3 went in */
+	memset(key, 0, sizeof(key));
+	hash = rowcache_hash(key, sizeof(key), ROWCACHE_HASH_INIT);
+	assert(!rowcache_fetch(cache, hash, key, out, 8));
+
+	/* Hits copy only line_len bytes of each line */
+	memset(out, 0, sizeof(out));
+	memset(key, 2, sizeof(key));
+	hash = rowcache_hash(key, sizeof(key), ROWCACHE_HASH_INIT);
+	assert(rowcache_fetch(cache, hash, key, out, 8));
+	assert(out[0][0] == 0x12 && out[0][5] == 0x12 && out[0][6] == 0);
+	assert(out[1][0] == 0x12 && out[1][5] == 0x12 && out[1][6] == 0);
+
+	/* Same hash but a different key must not hit */
+	key[3] = 9;
+	assert(!rowcache_fetch(cache, hash, key, out, 8));
+
+	/* 2 is now the most recent, so 1 goes next */
+	memset(key, 4, sizeof(key));
+	hash = rowcache_hash(key, sizeof(key), ROWCACHE_HASH_INIT);
+	rowcache_store(cache, hash, key, strip, 8);
+	memset(key, 1, sizeof(key));
+	hash = rowcache_hash(key, sizeof(key), ROWCACHE_HASH_INIT);
+	assert(!rowcache_fetch(cache, hash, key, out, 8));
+	memset(key, 2, sizeof(key));
+	hash = rowcache_hash(key, sizeof(key), ROWCACHE_HASH_INIT);
+	assert(rowcache_fetch(cache, hash, key, out, 8));
+
+	/* Too small a budget: never hits, never crashes */
+	assert(rowcache_reset(cache, 4, 1000, 100) == 0);
+	rowcache_store(cache, hash, key, strip, 8);
+	assert(!rowcache_fetch(cache, hash, key, out, 8));
+
+	rowcache_destroy(cache);
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Bounded LRU cache of rendered text rows.  Each entry maps a key (the
+ *  cells of the row plus whatever else decides how it looks) to the
+ *  pixels it rendered to, so an identical row can be copied instead of
+ *  rendered again.  All entries have the same key and strip size, set
+ *  with rowcache_reset() whenever the row geometry changes.
+ */
+
+#ifndef __ROWCACHE_H__
+#define __ROWCACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Starting value for rowcache_hash() */
+#define ROWCACHE_HASH_INIT	0xcbf29ce484222325ULL
+
+typedef struct _RowCacheEntry RowCacheEntry;
+
+typedef struct {
+	size_t max_bytes;		/* Budget for keys and strips */
+	int max_entries;
+
+	size_t key_len;			/* Bytes per key */
+	size_t line_len;		/* Bytes per pixel line of a strip */
+	int lines;			/* Pixel lines per strip */
+	int nmemb;			/* Entries that fit the budget */
+
+	RowCacheEntry *entries;
+	int *buckets;			/* Hash chains, nbuckets long */
+	int nbuckets;
+	int mru, lru;			/* Ends of the LRU list */
+	int used;
+	unsigned char *data;		/* nmemb * (key_len + strip) */
+
+	unsigned long hits, misses;
+} RowCache;
+
+RowCache *	rowcache_new		(size_t max_bytes, int max_entries);
+void		rowcache_destroy	(RowCache *cache);
+int		rowcache_reset		(RowCache *cache, size_t key_len,
+					 size_t line_len, int lines);
+uint64_t	rowcache_hash		(const void *data, size_t len,
+					 uint64_t hash);
+int		rowcache_fetch		(RowCache *cache, uint64_t hash,
+					 const void *key,
+					 void *dst, int dst_stride);
+void		rowcache_store		(RowCache *cache, uint64_t hash,
+					 const void *key,
+					 const void *src, int src_stride);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __ROWCACHE_H__ */
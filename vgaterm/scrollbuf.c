@@ -23,7 +23,9 @@
 #include "scrollbuf.h"
 #include "cbuf.h"
 
+#ifdef ENABLE_DEBUG
 #define DEBUG
+#endif
 
 /*
  * Scroll buffer uses two circular buffers:
@@ -39,22 +41,10 @@
  *             Element size: sizeof(RowRecord)
  *
  *   Data is accessed by peeking into the log cbuf.
- *   We must clean up the index cbuf by deleting old
- *   records when we find newer ones that overlap with
- *   it.  This can happen when the log cbuf overwrites.
- *   (we can't guarantee anything because the lines lengths
- *   can vary depending on how big the terminal was in the
- *   past).
- *
- *   We might want to consider changing the index cbuf into
- *   a doubly linked list.  The only problem with this is
- *   the lack of O(1) seek time.
- *   Maybe a simple array is best?  Then again, a cbuf is
- *   basically an array with some helpful indices.
- *
- *   To start out with, we can ignore this problem, and live
- *   with the fact that the very oldest end of the scrollback
- *   will probably be recycled / garbage lines :)
+ *   Old records are retired as soon as new lines are written
+ *   over their bytes (the lines lengths can vary depending on
+ *   how big the terminal was in the past), so every line
+ *   counted in line_count is intact.
  */ 
 
 /*
@@ -91,23 +81,91 @@ int scrollbuf_line_count(ScrollBuf *sbuf)
 
 void scrollbuf_add_line(ScrollBuf *sbuf, unsigned char *line, int bytes)
 {
-	LineRecord r;
-
-	r.bytes = bytes;
-	r.offset = sbuf->buf->put - sbuf->buf->buf;
-	cbuf_force_put(sbuf->buf, line, bytes);
-	cbuf_force_put(sbuf->index_buf, &r, 1);
-	if (sbuf->line_count < sbuf->max_lines)
-		sbuf->line_count++;
-#ifdef DEBUG
-	printf("Add line (%d bytes, ofs=%d): ", bytes, r.offset);
-	int i;
-	for (i = 0; i < bytes; i += 2) {
-		printf("%c", line[i]);
+	scrollbuf_add_lines(sbuf, line, bytes, 1);
+}
+
+/*
+ * Append @count lines of @line_bytes each, stored back to back at
+ * @data (oldest first), e.g. a block of rows leaving the screen.
+ * Space is reserved once: lines that fit before the end of the log go
+ * in with one memcpy and the rest go at its start with another, so no
+ * line is ever split across the wrap and scrollbuf_get_line() can hand
+ * out a flat pointer.  The line records are written in the same pass,
+ * and the records of older lines the copies went over are retired.
+ */
+void scrollbuf_add_lines(ScrollBuf *sbuf, unsigned char *data,
+			 int line_bytes, int count)
+{
+	CircBuf *buf = sbuf->buf;
+	CircBuf *index_buf = sbuf->index_buf;
+	LineRecord *rec;
+	int fit, ofs, i;
+
+	if (count <= 0 || line_bytes <= 0 || line_bytes > buf->size)
+		return;
+
+	/* Only the newest lines could survive anyway */
+	if (count > buf->size / line_bytes) {
+		data += (count - buf->size / line_bytes) * line_bytes;
+		count = buf->size / line_bytes;
 	}
-	printf("\n");
-	//printf("Put index = %d, line_count = %d\n", sbuf->buf->puti, sbuf->line_count);
-	scrollbuf_get_line(sbuf, 0, NULL);
+	if (count > sbuf->max_lines) {
+		data += (count - sbuf->max_lines) * line_bytes;
+		count = sbuf->max_lines;
+	}
+
+	ofs = buf->put - buf->buf;
+	fit = (buf->size - ofs) / line_bytes;
+	if (fit > count)
+		fit = count;
+
+	memcpy(buf->put, data, fit * line_bytes);
+	if (fit < count) {
+		memcpy(buf->buf, data + fit * line_bytes,
+		       (count - fit) * line_bytes);
+		buf->put = buf->buf + (count - fit) * line_bytes;
+	} else {
+		buf->put += fit * line_bytes;
+	}
+	buf->puti = buf->put - buf->buf;
+
+	for (i = 0; i < count; i++) {
+		if (index_buf->puti >= (int) index_buf->nmemb) {
+			index_buf->put = index_buf->buf;
+			index_buf->puti = 0;
+		}
+		rec = (LineRecord *) index_buf->put;
+		rec->bytes = line_bytes;
+		rec->offset = i < fit ? ofs + i * line_bytes
+				      : (i - fit) * line_bytes;
+		index_buf->put += sizeof(LineRecord);
+		index_buf->puti++;
+	}
+
+	/*
+	 * Forward from the old write position the lines run oldest first,
+	 * so retire from the oldest end.  On a wrap, whatever is left in
+	 * the skipped tail is older than the lines hit at the start, so
+	 * it goes too.
+	 */
+	sbuf->line_count += count;
+	if (sbuf->line_count > sbuf->max_lines)
+		sbuf->line_count = sbuf->max_lines;
+	while (sbuf->line_count > count) {
+		rec = (LineRecord *) cbuf_peek_back(index_buf,
+						    sbuf->line_count);
+		if (fit < count ? rec->offset >= ofs ||
+				  rec->offset < (count - fit) * line_bytes
+				: rec->offset < ofs + fit * line_bytes &&
+				  rec->offset + rec->bytes > ofs)
+			sbuf->line_count--;
+		else
+			break;
+	}
+#ifdef DEBUG
+	printf("Add %d lines (%d bytes, ofs=%d)\n", count, line_bytes, ofs);
+	for (i = count - 1; i >= 0; i--)
+		scrollbuf_get_line(sbuf, i, NULL);
 #endif
 }
 
@@ -144,6 +202,186 @@ scrollbuf_get_line(ScrollBuf *sbuf, int index, int *bytes)
 	return (unsigned char *) sbuf->buf->buf + ofs;
 }
 
+/*
+ * Change the limits to @max_bytes and @max_lines, keeping as many of
+ * the newest lines as still fit.  Returns -1 and leaves @sbuf as it
+ * was if the new buffers can't be allocated.
+ */
+int scrollbuf_resize(ScrollBuf *sbuf, int max_bytes, int max_lines)
+{
+	ScrollBuf tmp;
+	unsigned char *line;
+	int i, n, bytes, total;
+
+	if (max_bytes == sbuf->max_bytes && max_lines == sbuf->max_lines)
+		return 0;
+
+	tmp.max_bytes = max_bytes;
+	tmp.max_lines = max_lines;
+	tmp.line_count = 0;
+	tmp.buf = cbuf_new(1, max_bytes);
+	tmp.index_buf = cbuf_new(sizeof(LineRecord), max_lines);
+	if (tmp.buf == NULL || tmp.index_buf == NULL) {
+		cbuf_destroy(tmp.buf);
+		cbuf_destroy(tmp.index_buf);
+		return -1;
+	}
+
+	/* Copy what survives in again, oldest first */
+	for (n = 0, total = 0; n < sbuf->line_count && n < max_lines; n++) {
+		scrollbuf_get_line(sbuf, n, &bytes);
+		if (total + bytes > max_bytes)
+			break;
+		total += bytes;
+	}
+	for (i = n - 1; i >= 0; i--) {
+		line = scrollbuf_get_line(sbuf, i, &bytes);
+		scrollbuf_add_line(&tmp, line, bytes);
+	}
+
+	cbuf_destroy(sbuf->buf);
+	cbuf_destroy(sbuf->index_buf);
+	*sbuf = tmp;
+
+	return 0;
+}
+
+/*
+ * Saved image of a scroll buffer: this header, then the line records
+ * oldest first, then the lines themselves back to back.  The record
+ * offsets are into that run of lines, which is where they go in the
+ * log on loading, so both can be copied in as they are.
+ */
+typedef struct {
+	int max_bytes;
+	int max_lines;
+	int line_count;
+	int data_bytes;
+} ScrollBufImage;
+
+/* Bytes needed by scrollbuf_save_image() */
+long scrollbuf_image_size(ScrollBuf *sbuf)
+{
+	long size;
+	int i, bytes;
+
+	size = sizeof(ScrollBufImage) + sbuf->line_count * sizeof(LineRecord);
+	for (i = 0; i < sbuf->line_count; i++) {
+		scrollbuf_get_line(sbuf, i, &bytes);
+		size += bytes;
+	}
+	return size;
+}
+
+/*
+ * Save the limits and every line of @sbuf to @dest, which must
+ * have room for scrollbuf_image_size() bytes.  Only the lines are
+ * saved, not the empty part of the log.
+ */
+void scrollbuf_save_image(ScrollBuf *sbuf, unsigned char *dest)
+{
+	ScrollBufImage img;
+	LineRecord rec;
+	unsigned char *recs, *data, *line;
+	int i, n;
+
+	n = sbuf->line_count;
+	img.max_bytes = sbuf->max_bytes;
+	img.max_lines = sbuf->max_lines;
+	img.line_count = n;
+	img.data_bytes = scrollbuf_image_size(sbuf) - sizeof(img) -
+			 n * sizeof(LineRecord);
+	memcpy(dest, &img, sizeof(img));
+
+	recs = dest + sizeof(img);
+	data = recs + n * sizeof(LineRecord);
+	rec.offset = 0;
+	for (i = n - 1; i >= 0; i--) {
+		line = scrollbuf_get_line(sbuf, i, &rec.bytes);
+		memcpy(data + rec.offset, line, rec.bytes);
+		memcpy(recs, &rec, sizeof(rec));
+		recs += sizeof(rec);
+		rec.offset += rec.bytes;
+	}
+}
+
+/*
+ * Replace the contents (and limits) of @sbuf with an image made by
+ * scrollbuf_save_image().  Returns -1 and leaves @sbuf as it was if
+ * the image doesn't make sense or the buffers can't be allocated.
+ */
+int scrollbuf_load_image(ScrollBuf *sbuf, const unsigned char *src, long len)
+{
+	ScrollBufImage img;
+	LineRecord rec;
+	CircBuf *buf, *index_buf;
+	long expect;
+	int i;
+
+	if (len < (long) sizeof(img))
+		return -1;
+	memcpy(&img, src, sizeof(img));
+	if (img.max_bytes <= 0 || img.max_lines <= 0 ||
+	    img.line_count < 0 || img.line_count > img.max_lines ||
+	    img.data_bytes < 0 || img.data_bytes > img.max_bytes)
+		return -1;
+	expect = (long) sizeof(img) +
+		 (long) img.line_count * (long) sizeof(LineRecord) +
+		 img.data_bytes;
+	if (len != expect)
+		return -1;
+	for (i = 0; i < img.line_count; i++) {
+		memcpy(&rec, src + sizeof(img) + i * sizeof(rec), sizeof(rec));
+		if (rec.bytes <= 0 || rec.offset < 0 ||
+		    rec.offset > img.data_bytes - rec.bytes)
+			return -1;
+	}
+
+	if (img.max_bytes != sbuf->max_bytes ||
+	    img.max_lines != sbuf->max_lines) {
+		buf = cbuf_new(1, img.max_bytes);
+		index_buf = cbuf_new(sizeof(LineRecord), img.max_lines);
+		if (buf == NULL || index_buf == NULL) {
+			cbuf_destroy(buf);
+			cbuf_destroy(index_buf);
+			return -1;
+		}
+		cbuf_destroy(sbuf->buf);
+		cbuf_destroy(sbuf->index_buf);
+		sbuf->buf = buf;
+		sbuf->index_buf = index_buf;
+		sbuf->max_bytes = img.max_bytes;
+		sbuf->max_lines = img.max_lines;
+	}
+
+	src += sizeof(img);
+	index_buf = sbuf->index_buf;
+	memcpy(index_buf->buf, src, img.line_count * sizeof(LineRecord));
+	index_buf->get = index_buf->buf;
+	index_buf->geti = 0;
+	index_buf->puti = img.line_count;
+	index_buf->put = index_buf->buf + img.line_count * sizeof(LineRecord);
+
+	src += img.line_count * sizeof(LineRecord);
+	buf = sbuf->buf;
+	memcpy(buf->buf, src, img.data_bytes);
+	buf->get = buf->buf;
+	buf->geti = 0;
+	buf->puti = img.data_bytes;
+	buf->put = buf->buf + img.data_bytes;
+
+	sbuf->line_count = img.line_count;
+
+	return 0;
+}
+
+/* Memory held by the buffers, whether filled yet or not */
+long scrollbuf_mem_size(ScrollBuf *sbuf)
+{
+	return (long) sbuf->max_bytes +
+	       (long) sbuf->max_lines * sizeof(LineRecord);
+}
+
 void scrollbuf_check_clean(ScrollBuf *sbuf)
 {
 	/* Check to see if oldest line records are overlapped with
@@ -172,3 +410,128 @@ void scrollbuf_dump(ScrollBuf *sbuf)
 	}
 	free(line);
 }
+
+#ifdef UNIT_TEST
+/* Compile with: gcc -c cbuf.c; gcc scrollbuf.c cbuf.o -o scrollbuf-test -DUNIT_TEST */
+#include <assert.h>
+
+int main(void)
+{
+	ScrollBuf *sbuf;
+	unsigned char screen[25 * 8];
+	unsigned char *line, *image;
+	int i, j, bytes;
+
+	for (i = 0; i < sizeof(screen); i++)
+		screen[i] = i / 8;
+
+	/* 100 bytes holds 12 lines of 8, with a 4 byte tail left over */
+	sbuf = scrollbuf_new(100, 20);
+	scrollbuf_add_lines(sbuf, screen, 8, 10);
+	assert(scrollbuf_line_count(sbuf) == 10);
+	line = scrollbuf_get_line(sbuf, 0, &bytes);
+	assert(bytes == 8 && line[0] == 9 && line[7] == 9);
+
+	/*
+	 * Two fit before the end, the rest wrap without splitting a line,
+	 * and the three oldest they went over are gone
+	 */
+	scrollbuf_add_lines(sbuf, screen + 10 * 8, 8, 5);
+	assert(scrollbuf_line_count(sbuf) == 12);
+	assert(scrollbuf_get_line(sbuf, 11, NULL)[0] == 3);
+	assert(scrollbuf_get_line(sbuf, 12, NULL) == NULL);
+	for (i = 0; i < 5; i++) {
+		line = scrollbuf_get_line(sbuf, i, &bytes);
+		assert(line + bytes <= sbuf->buf->buf + sbuf->buf->size);
+		for (j = 0; j < bytes; j++)
+			assert(line[j] == 14 - i);
+	}
+
+	/* One at a time matches, and the index wraps too */
+	for (i = 0; i < 25; i++)
+		scrollbuf_add_line(sbuf, screen + i * 8, 8);
+	assert(scrollbuf_line_count(sbuf) == 12);
+	for (i = 0; i < 12; i++)
+		assert(scrollbuf_get_line(sbuf, i, NULL)[0] == 24 - i);
+
+	/* A block bigger than the log keeps only its newest lines */
+	scrollbuf_add_lines(sbuf, screen, 8, 25);
+	for (i = 0; i < 12; i++)
+		assert(scrollbuf_get_line(sbuf, i, NULL)[3] == 24 - i);
+
+	/* Resizing keeps the newest lines that fit, in order */
+	assert(scrollbuf_resize(sbuf, 40, 20) == 0);
+	assert(scrollbuf_line_count(sbuf) == 5);
+	for (i = 0; i < 5; i++)
+		assert(scrollbuf_get_line(sbuf, i, NULL)[0] == 24 - i);
+	assert(scrollbuf_resize(sbuf, 400, 3) == 0);
+	assert(scrollbuf_line_count(sbuf) == 3);
+	assert(scrollbuf_get_line(sbuf, 2, NULL)[0] == 22);
+	assert(scrollbuf_mem_size(sbuf) == 400 + 3 * sizeof(LineRecord));
+	scrollbuf_add_lines(sbuf, screen, 8, 2);
+	assert(scrollbuf_line_count(sbuf) == 3);
+	assert(scrollbuf_get_line(sbuf, 2, NULL)[0] == 24);
+	scrollbuf_destroy(sbuf);
+
+	/* An image only holds the intact lines, and loads back the same */
+	sbuf = scrollbuf_new(100, 20);
+	for (i = 0; i < 25; i++)
+		scrollbuf_add_line(sbuf, screen + i * 8, 8);
+	bytes = scrollbuf_image_size(sbuf);
+	image = malloc(bytes);
+	scrollbuf_save_image(sbuf, image);
+	scrollbuf_destroy(sbuf);
+
+	sbuf = scrollbuf_new(50, 5);
+	assert(scrollbuf_load_image(sbuf, image, bytes - 1) == -1);
+	assert(scrollbuf_line_count(sbuf) == 0);
+	assert(scrollbuf_load_image(sbuf, image, bytes) == 0);
+	assert(sbuf->max_bytes == 100 && sbuf->max_lines == 20);
+	assert(scrollbuf_line_count(sbuf) == 12);
+	for (i = 0; i < 12; i++)
+		assert(scrollbuf_get_line(sbuf, i, NULL)[5] == 24 - i);
+	scrollbuf_add_lines(sbuf, screen, 8, 3);
+	assert(scrollbuf_line_count(sbuf) == 12);
+	assert(scrollbuf_get_line(sbuf, 0, NULL)[0] == 2);
+	assert(scrollbuf_get_line(sbuf, 3, NULL)[0] == 24);
+	free(image);
+	scrollbuf_destroy(sbuf);
+
+	/*
+	 * Mixed widths: the 40 byte line doesn't fit in the last 10 bytes,
+	 * so it goes at the start and the next one lands on C.  Only D and
+	 * E are still intact.
+	 */
+	sbuf = scrollbuf_new(100, 20);
+	for (i = 0; i < 5; i++) {
+		bytes = i == 3 ? 40 : 30;
+		memset(screen, 'A' + i, bytes);
+		scrollbuf_add_line(sbuf, screen, bytes);
+	}
+	assert(scrollbuf_line_count(sbuf) == 2);
+	assert(scrollbuf_resize(sbuf, 200, 20) == 0);
+	assert(scrollbuf_line_count(sbuf) == 2);
+	line = scrollbuf_get_line(sbuf, 0, &bytes);
+	assert(bytes == 30 && line[0] == 'E' && line[29] == 'E');
+	line = scrollbuf_get_line(sbuf, 1, &bytes);
+	assert(bytes == 40 && line[0] == 'D' && line[39] == 'D');
+	assert(scrollbuf_image_size(sbuf) == (long) sizeof(ScrollBufImage) +
+	       2 * sizeof(LineRecord) + 70);
+	scrollbuf_destroy(sbuf);
+
+	/* Lines written over don't stay readable however many are added */
+	sbuf = scrollbuf_new(100, 20);
+	for (i = 0; i < 20; i++) {
+		memset(screen, i, 30);
+		scrollbuf_add_line(sbuf, screen, 30);
+	}
+	assert(scrollbuf_line_count(sbuf) == 3);
+	for (i = 0; i < 3; i++)
+		assert(scrollbuf_get_line(sbuf, i, NULL)[29] == 19 - i);
+	scrollbuf_destroy(sbuf);
+
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
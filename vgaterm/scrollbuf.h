@@ -50,8 +50,17 @@ void		scrollbuf_destroy	(ScrollBuf *sbuf);
 int		scrollbuf_line_count	(ScrollBuf *sbuf);
 void		scrollbuf_add_line	(ScrollBuf *sbuf, unsigned char *line,
 					 int bytes);
+void		scrollbuf_add_lines	(ScrollBuf *sbuf, unsigned char *data,
+					 int line_bytes, int count);
 unsigned char *	scrollbuf_get_line	(ScrollBuf *sbuf, int index,
 					 int *bytes);
+int		scrollbuf_resize	(ScrollBuf *sbuf, int max_bytes,
+					 int max_lines);
+long		scrollbuf_image_size	(ScrollBuf *sbuf);
+void		scrollbuf_save_image	(ScrollBuf *sbuf, unsigned char *dest);
+int		scrollbuf_load_image	(ScrollBuf *sbuf,
+					 const unsigned char *src, long len);
+long		scrollbuf_mem_size	(ScrollBuf *sbuf);
 void		scrollbuf_check_clean	(ScrollBuf *sbuf);
 void		scrollbuf_dump		(ScrollBuf *sbuf);
 
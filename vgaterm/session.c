@@ -0,0 +1,513 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <string.h>
+#include "session.h"
+#include "emulation.h"
+
+#define SESSION_ALIGN(n)	(((n) + 7) & ~7)
+
+/* VGA_SESSION_SECTION_SCREEN, followed by the cells */
+typedef struct {
+	gint32 cols, rows;	/* Of the grid */
+	gint32 canvas_rows, view_rows, view_top;
+	gint32 cursor_x, cursor_y;
+	guint8 cursor_visible, icecolor;
+	guint8 pad[2];
+} SessionScreen;
+
+/* VGA_SESSION_SECTION_FONT, followed by the glyphs */
+typedef struct {
+	gint32 width, height;
+} SessionFont;
+
+/* VGA_SESSION_SECTION_TERM */
+typedef struct {
+	gint32 win_top_left_x, win_top_left_y;
+	gint32 win_bot_right_x, win_bot_right_y;
+	guint8 textattr;
+	guint8 pad[7];
+} SessionTerm;
+
+/* Start a section; returns where its header is, for session_end() */
+static guint
+session_begin(GByteArray *out, guint32 id)
+{
+	VGASessionSection sec;
+	guint ofs = out->len;
+
+	sec.id = id;
+	sec.len = 0;
+	g_byte_array_append(out, (guint8 *) &sec, sizeof(sec));
+	return ofs;
+}
+
+/* Fill in the length of the section started at @ofs, and pad it */
+static void
+session_end(GByteArray *out, guint ofs)
+{
+	VGASessionSection sec;
+
+	memcpy(&sec, out->data + ofs, sizeof(sec));
+	sec.len = out->len - ofs - sizeof(sec);
+	memcpy(out->data + ofs, &sec, sizeof(sec));
+	g_byte_array_set_size(out, SESSION_ALIGN(out->len));
+}
+
+static void
+session_save_screen(VGATerm *term, GByteArray *out)
+{
+	VGAText *vga = VGA_TEXT(term);
+	SessionScreen scr;
+
+	memset(&scr, 0, sizeof(scr));
+	scr.cols = vga_get_cols(vga);
+	scr.rows = vga_get_rows(vga);
+	scr.canvas_rows = vga_get_canvas_rows(vga);
+	scr.view_rows = vga_get_view_rows(vga);
+	scr.view_top = vga_get_view_top(vga);
+	scr.cursor_x = vga_cursor_x(vga);
+	scr.cursor_y = vga_cursor_y(vga);
+	scr.cursor_visible = vga_cursor_is_visible(vga) != FALSE;
+	scr.icecolor = vga_get_icecolor(vga) != FALSE;
+	g_byte_array_append(out, (guint8 *) &scr, sizeof(scr));
+	g_byte_array_append(out, vga_get_video_buf(vga),
+			    vga_video_buf_size(vga));
+}
+
+static gboolean
+session_restore_screen(VGATerm *term, const guchar *src, gsize len)
+{
+	VGAText *vga = VGA_TEXT(term);
+	SessionScreen scr;
+
+	if (len < sizeof(scr))
+		return FALSE;
+	memcpy(&scr, src, sizeof(scr));
+	if (scr.cols <= 0 || scr.cols > VGA_MAX_COLS ||
+	    scr.view_rows <= 0 || scr.view_rows > VGA_MAX_ROWS ||
+	    scr.canvas_rows < 0 || scr.canvas_rows > VGA_MAX_CANVAS_ROWS ||
+	    scr.rows != MAX(scr.canvas_rows, scr.view_rows) ||
+	    len != sizeof(scr) + sizeof(vga_charcell) * scr.cols * scr.rows)
+		return FALSE;
+
+	vga_set_canvas_rows(vga, scr.canvas_rows);
+	vga_set_size(vga, scr.cols, scr.view_rows);
+	if (vga_get_cols(vga) != scr.cols || vga_get_rows(vga) != scr.rows)
+		return FALSE;
+
+	memcpy(vga_get_video_buf(vga), src + sizeof(scr),
+	       vga_video_buf_size(vga));
+	vga_mark_region_dirty(vga, 0, 0, scr.cols, scr.rows);
+	vga_set_view_top(vga, scr.view_top);
+	vga_cursor_set_visible(vga, scr.cursor_visible);
+	vga_cursor_move(vga, CLAMP(scr.cursor_x, 0, scr.cols - 1),
+			CLAMP(scr.cursor_y, 0, scr.rows - 1));
+	vga_set_icecolor(vga, scr.icecolor);
+
+	return TRUE;
+}
+
+static void
+session_save_palette(VGATerm *term, GByteArray *out)
+{
+	guint16 regs[PAL_REGS * 3];
+
+	vga_palette_get_regs16(vga_get_palette(VGA_TEXT(term)), regs);
+	g_byte_array_append(out, (guint8 *) regs, sizeof(regs));
+}
+
+static gboolean
+session_restore_palette(VGATerm *term, const guchar *src, gsize len)
+{
+	VGAPalette *pal;
+	guint16 regs[PAL_REGS * 3];
+
+	if (len != sizeof(regs))
+		return FALSE;
+	memcpy(regs, src, sizeof(regs));
+
+	/* The old one may be shared, so don't change it */
+	pal = VGA_PALETTE(vga_palette_new());
+	vga_palette_set_regs16(pal, regs);
+	vga_set_palette(VGA_TEXT(term), pal);
+
+	return TRUE;
+}
+
+/* vga_set_font(), taking over our reference even if it's the same font */
+static void
+session_set_font(VGATerm *term, VGAFont *font)
+{
+	if (font == vga_get_font(VGA_TEXT(term)))
+		g_object_unref(font);
+	else
+		vga_set_font(VGA_TEXT(term), font);
+}
+
+static void
+session_save_font(VGATerm *term, GByteArray *out)
+{
+	VGAFont *font, *def;
+	SessionFont f;
+
+	font = vga_get_font(VGA_TEXT(term));
+	def = vga_font_get_default();
+	g_object_unref(def);
+	if (font == def)
+		return;
+
+	f.width = font->width;
+	f.height = font->height;
+	g_byte_array_append(out, (guint8 *) &f, sizeof(f));
+	g_byte_array_append(out, vga_font_get_glyph_data(font, 0),
+			    font->bytes_per_glyph * 256);
+}
+
+static gboolean
+session_restore_font(VGATerm *term, const guchar *src, gsize len)
+{
+	SessionFont f;
+
+	if (len < sizeof(f))
+		return FALSE;
+	memcpy(&f, src, sizeof(f));
+	if (f.width <= 0 || f.width > 16 || f.height <= 0 || f.height > 32 ||
+	    len != sizeof(f) + VGA_FONT_GLYPH_BYTES(f.width, f.height) * 256)
+		return FALSE;
+
+	/* Sessions with the same font end up sharing it */
+	session_set_font(term, vga_font_intern((guchar *) src + sizeof(f),
+					       f.width, f.height));
+
+	return TRUE;
+}
+
+static void
+session_save_term(VGATerm *term, GByteArray *out)
+{
+	SessionTerm t;
+
+	memset(&t, 0, sizeof(t));
+	t.win_top_left_x = term->win_top_left_x;
+	t.win_top_left_y = term->win_top_left_y;
+	t.win_bot_right_x = term->win_bot_right_x;
+	t.win_bot_right_y = term->win_bot_right_y;
+	t.textattr = term->textattr;
+	g_byte_array_append(out, (guint8 *) &t, sizeof(t));
+}
+
+static gboolean
+session_restore_term(VGATerm *term, const guchar *src, gsize len)
+{
+	SessionTerm t;
+
+	if (len != sizeof(t))
+		return FALSE;
+	memcpy(&t, src, sizeof(t));
+	if (t.win_top_left_x < 1 || t.win_top_left_x > t.win_bot_right_x ||
+	    t.win_top_left_y < 1 || t.win_top_left_y > t.win_bot_right_y ||
+	    t.win_bot_right_x > vga_get_cols(VGA_TEXT(term)) ||
+	    t.win_bot_right_y > vga_get_rows(VGA_TEXT(term)))
+		return FALSE;
+
+	/* Not vga_term_window(), which would home the cursor */
+	term->win_top_left_x = t.win_top_left_x;
+	term->win_top_left_y = t.win_top_left_y;
+	term->win_bot_right_x = t.win_bot_right_x;
+	term->win_bot_right_y = t.win_bot_right_y;
+	vga_term_set_attr(term, t.textattr);
+
+	return TRUE;
+}
+
+/**
+ * vga_term_session_save:
+ * @term: VGATerm object
+ *
+ * Save the state of a terminal session, see session.h for what that
+ * covers.  Output still spooled in a write batch is applied first.
+ *
+ * Returns: the snapshot, to be freed with g_byte_array_free()
+ */
+GByteArray *
+vga_term_session_save(VGATerm *term)
+{
+	VGASessionHeader hdr;
+	GByteArray *out;
+	guint ofs;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), NULL);
+
+	vga_term_flush_scroll(term);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, VGA_SESSION_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = VGA_SESSION_BYTE_ORDER;
+	hdr.version = VGA_SESSION_VERSION;
+	out = g_byte_array_sized_new(sizeof(hdr) +
+		vga_video_buf_size(VGA_TEXT(term)) + 64 * 1024);
+	g_byte_array_append(out, (guint8 *) &hdr, sizeof(hdr));
+
+	ofs = session_begin(out, VGA_SESSION_SECTION_SCREEN);
+	session_save_screen(term, out);
+	session_end(out, ofs);
+	hdr.n_sections++;
+
+	ofs = session_begin(out, VGA_SESSION_SECTION_PALETTE);
+	session_save_palette(term, out);
+	session_end(out, ofs);
+	hdr.n_sections++;
+
+	ofs = session_begin(out, VGA_SESSION_SECTION_FONT);
+	session_save_font(term, out);
+	if (out->len > ofs + sizeof(VGASessionSection))
+	{
+		session_end(out, ofs);
+		hdr.n_sections++;
+	}
+	else
+		g_byte_array_set_size(out, ofs);
+
+	ofs = session_begin(out, VGA_SESSION_SECTION_TERM);
+	session_save_term(term, out);
+	session_end(out, ofs);
+	hdr.n_sections++;
+
+	ofs = session_begin(out, VGA_SESSION_SECTION_EMULATION);
+	if (vga_term_emu_save(term, out))
+	{
+		session_end(out, ofs);
+		hdr.n_sections++;
+	}
+	else
+		g_byte_array_set_size(out, ofs);
+
+	ofs = session_begin(out, VGA_SESSION_SECTION_SCROLLBACK);
+	vga_term_save_scrollback(term, out);
+	session_end(out, ofs);
+	hdr.n_sections++;
+
+	memcpy(out->data, &hdr, sizeof(hdr));
+
+	return out;
+}
+
+/* Save a snapshot to @fname, replacing it in one go */
+gboolean
+vga_term_session_save_to_file(VGATerm *term, const gchar *fname)
+{
+	GByteArray *data;
+	gboolean result;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), FALSE);
+	g_return_val_if_fail(fname != NULL, FALSE);
+
+	data = vga_term_session_save(term);
+	result = g_file_set_contents(fname, (const gchar *) data->data,
+				     data->len, NULL);
+	g_byte_array_free(data, TRUE);
+
+	return result;
+}
+
+/**
+ * vga_term_session_restore:
+ * @term: VGATerm object
+ * @data: A snapshot made by vga_term_session_save()
+ * @len: Its size
+ *
+ * Put @term back in the state saved in a snapshot.  The layout of the
+ * snapshot is checked before any of it is used, but a section that
+ * turns out to be bad (or that can't be applied, e.g. for lack of
+ * memory) stops the restore with what came before it applied.
+ *
+ * Returns: FALSE if the snapshot couldn't be restored
+ */
+gboolean
+vga_term_session_restore(VGATerm *term, const guchar *data, gsize len)
+{
+	VGASessionHeader hdr;
+	VGASessionSection sec;
+	gboolean had_font = FALSE, ok = TRUE;
+	const guchar *body;
+	gsize ofs;
+	guint i;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), FALSE);
+	g_return_val_if_fail(data != NULL, FALSE);
+
+	if (len < sizeof(hdr))
+		return FALSE;
+	memcpy(&hdr, data, sizeof(hdr));
+	if (memcmp(hdr.magic, VGA_SESSION_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.byte_order != VGA_SESSION_BYTE_ORDER ||
+	    hdr.version != VGA_SESSION_VERSION)
+		return FALSE;
+
+	/* Make sure every section is all there first */
+	for (i = 0, ofs = sizeof(hdr); i < hdr.n_sections; i++)
+	{
+		if (len - ofs < sizeof(sec))
+			return FALSE;
+		memcpy(&sec, data + ofs, sizeof(sec));
+		ofs += sizeof(sec);
+		if (len - ofs < sec.len)
+			return FALSE;
+		ofs = MIN(len, ofs + SESSION_ALIGN(sec.len));
+	}
+
+	vga_term_set_scroll(term, 0);
+	vga_term_flush_scroll(term);
+
+	for (i = 0, ofs = sizeof(hdr); ok && i < hdr.n_sections; i++)
+	{
+		memcpy(&sec, data + ofs, sizeof(sec));
+		body = data + ofs + sizeof(sec);
+		ofs = MIN(len, ofs + sizeof(sec) + SESSION_ALIGN(sec.len));
+
+		switch (sec.id) {
+		case VGA_SESSION_SECTION_SCREEN:
+			ok = session_restore_screen(term, body, sec.len);
+			break;
+		case VGA_SESSION_SECTION_PALETTE:
+			ok = session_restore_palette(term, body, sec.len);
+			break;
+		case VGA_SESSION_SECTION_FONT:
+			ok = had_font = session_restore_font(term, body,
+							     sec.len);
+			break;
+		case VGA_SESSION_SECTION_TERM:
+			ok = session_restore_term(term, body, sec.len);
+			break;
+		case VGA_SESSION_SECTION_EMULATION:
+			ok = vga_term_emu_restore(term, body, sec.len);
+			break;
+		case VGA_SESSION_SECTION_SCROLLBACK:
+			ok = vga_term_restore_scrollback(term, body, sec.len);
+			break;
+		default:
+			/* From a newer version; not needed to restore */
+			break;
+		}
+	}
+
+	if (ok && !had_font)
+		session_set_font(term, vga_font_get_default());
+
+	return ok;
+}
+
+/*
+ * Restore a snapshot saved to @fname.  The file is mapped rather than
+ * read, so only the pages actually copied from are ever touched.
+ */
+gboolean
+vga_term_session_load_from_file(VGATerm *term, const gchar *fname)
+{
+	GMappedFile *file;
+	gboolean result;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), FALSE);
+	g_return_val_if_fail(fname != NULL, FALSE);
+
+	file = g_mapped_file_new(fname, FALSE, NULL);
+	if (file == NULL)
+		return FALSE;
+	result = vga_term_session_restore(term,
+			(const guchar *) g_mapped_file_get_contents(file),
+			g_mapped_file_get_length(file));
+	g_mapped_file_unref(file);
+
+	return result;
+}
+
+#ifdef UNIT_TEST
+/*
+ * Compile with:
+ *     gcc session.c -o session-test -DUNIT_TEST \
+ *         `pkg-config --cflags --libs libvgaterm-1.0`
+ * Needs a display.
+ */
+#include <stdio.h>
+#include <assert.h>
+
+/* The font section of @snap */
+static SessionFont *
+find_font(GByteArray *snap)
+{
+	VGASessionHeader hdr;
+	VGASessionSection sec;
+	gsize ofs;
+	guint i;
+
+	memcpy(&hdr, snap->data, sizeof(hdr));
+	for (i = 0, ofs = sizeof(hdr); i < hdr.n_sections; i++)
+	{
+		memcpy(&sec, snap->data + ofs, sizeof(sec));
+		if (sec.id == VGA_SESSION_SECTION_FONT)
+			return (SessionFont *) (snap->data + ofs + sizeof(sec));
+		ofs += sizeof(sec) + SESSION_ALIGN(sec.len);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	static guchar glyphs[VGA_FONT_GLYPH_BYTES(9, 14) * 256];
+	GtkWidget *a, *b;
+	GByteArray *snap;
+	SessionFont *f;
+	VGAFont *font;
+	guint i;
+
+	gtk_init(&argc, &argv);
+	for (i = 0; i < sizeof(glyphs); i++)
+		glyphs[i] = i * 7;
+
+	/* A 9 pixel wide font has two bytes to each glyph row */
+	a = vga_term_new();
+	vga_set_font(VGA_TEXT(a), vga_font_intern(glyphs, 9, 14));
+	snap = vga_term_session_save(VGA_TERM(a));
+	assert(snap != NULL);
+
+	b = vga_term_new();
+	assert(vga_term_session_restore(VGA_TERM(b), snap->data, snap->len));
+	font = vga_get_font(VGA_TEXT(b));
+	assert(font->width == 9 && font->height == 14);
+	assert(memcmp(vga_font_get_glyph_data(font, 0), glyphs,
+		      sizeof(glyphs)) == 0);
+	/* Same glyphs, so the same shared font */
+	assert(font == vga_get_font(VGA_TEXT(a)));
+
+	/* Glyph data that doesn't fit the size is refused */
+	f = find_font(snap);
+	assert(f != NULL && f->width == 9);
+	f->width = 8;
+	assert(!vga_term_session_restore(VGA_TERM(b), snap->data,
+					 snap->len));
+
+	g_byte_array_free(snap, TRUE);
+	gtk_widget_destroy(a);
+	gtk_widget_destroy(b);
+
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
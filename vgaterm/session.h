@@ -0,0 +1,82 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Saving a terminal session to a compact binary snapshot and restoring
+ *  it later, e.g. in another process.  A snapshot covers the screen
+ *  (the selected console) and cursor, iCE color, the palette, a custom
+ *  font, the VGATerm window and text attribute, the emulation state down
+ *  to a half parsed escape sequence, and the scrollback.
+ *
+ *  Layout, all in host byte order:
+ *
+ *    VGASessionHeader
+ *    Sections, each a VGASessionSection and then len bytes of data,
+ *    padded to a multiple of 8 bytes
+ *
+ *  Everything big in a section (cells, glyphs, scrollback lines) is
+ *  stored just as it is held in memory, so restoring from a mapped file
+ *  comes down to a few memcpy()s.  Readers skip sections they don't
+ *  know, so new ones can be added without bumping the version.
+ */
+
+#ifndef __VGA_SESSION_H__
+#define __VGA_SESSION_H__
+
+#include "vgaterm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define VGA_SESSION_MAGIC	"VGASESS"	/* With its NUL, 8 bytes */
+#define VGA_SESSION_VERSION	1
+#define VGA_SESSION_BYTE_ORDER	0x01020304
+
+typedef struct {
+	char magic[8];
+	guint32 byte_order;	/* VGA_SESSION_BYTE_ORDER as written */
+	guint32 version;
+	guint32 n_sections;
+	guint32 reserved;
+} VGASessionHeader;
+
+typedef struct {
+	guint32 id;		/* VGA_SESSION_SECTION_* */
+	guint32 len;		/* Not counting this or the padding */
+} VGASessionSection;
+
+enum {
+	VGA_SESSION_SECTION_SCREEN = 1,
+	VGA_SESSION_SECTION_PALETTE,
+	VGA_SESSION_SECTION_FONT,	/* Only if not the default font */
+	VGA_SESSION_SECTION_TERM,
+	VGA_SESSION_SECTION_EMULATION,	/* Only with vga_term_emu_init() */
+	VGA_SESSION_SECTION_SCROLLBACK
+};
+
+GByteArray *	vga_term_session_save	(VGATerm *term);
+gboolean	vga_term_session_save_to_file (VGATerm *term,
+					 const gchar *fname);
+gboolean	vga_term_session_restore (VGATerm *term, const guchar *data,
+					 gsize len);
+gboolean	vga_term_session_load_from_file (VGATerm *term,
+					 const gchar *fname);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __VGA_SESSION_H__ */
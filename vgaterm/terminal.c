@@ -215,22 +215,174 @@ void terminal_process_input(guchar * s)
 }
 
 
-void terminal_dump_file(VGATerm *term, gchar * fname)
+/* Bytes handed to the emulator at a time by the file players */
+#define TERMINAL_PLAY_SLICE	(256 * 1024)
+
+typedef struct
+{
+	VGATerm *term;
+	GMappedFile *file;
+	const guchar *data;
+	gsize len, done;
+	gint budget_ms;
+	TerminalPlayFunc func;
+	TerminalPlayDoneFunc finish;
+	gpointer func_data;
+	GTimer *timer;
+} TerminalPlayback;
+
+static TerminalPlayback *terminal_playback_new(VGATerm *term,
+					       const gchar *fname)
+{
+	TerminalPlayback *pb;
+	GMappedFile *file;
+
+	file = g_mapped_file_new(fname, FALSE, NULL);
+	if (file == NULL)
+		return NULL;
+
+	pb = g_new0(TerminalPlayback, 1);
+	pb->term = g_object_ref(term);
+	pb->file = file;
+	pb->data = (const guchar *) g_mapped_file_get_contents(file);
+	pb->len = g_mapped_file_get_length(file);
+
+	return pb;
+}
+
+static void terminal_playback_free(gpointer data)
+{
+	TerminalPlayback *pb = data;
+
+	/* Only still set if the source was removed before it played out */
+	if (pb->finish != NULL)
+		pb->finish(pb->term, pb->done == pb->len, pb->func_data);
+
+	g_object_unref(pb->term);
+	g_mapped_file_unref(pb->file);
+	if (pb->timer != NULL)
+		g_timer_destroy(pb->timer);
+	g_free(pb);
+}
+
+/* Play the next slice; FALSE once done or cancelled */
+static gboolean terminal_playback_slice(TerminalPlayback *pb)
+{
+	gsize n;
+
+	n = MIN(pb->len - pb->done, TERMINAL_PLAY_SLICE);
+	vga_term_emu_write_len(pb->term, pb->data + pb->done, n);
+	pb->done += n;
+
+	if (pb->func != NULL &&
+	    !pb->func(pb->term, pb->done, pb->len, pb->func_data))
+		return FALSE;
+
+	return pb->done < pb->len;
+}
+
+static gboolean terminal_playback_idle(gpointer data)
 {
-	FILE * f;
-	guchar buf[4096];
-	int n, i;
+	TerminalPlayback *pb = data;
+	gboolean more;
 
-	f = fopen(fname, "rb");
-	if (f == NULL)
-		return;
+	/*
+	 * Idle callbacks don't get the GDK lock by themselves, and the
+	 * emulator hands it to the render thread now and then.
+	 */
+	gdk_threads_enter();
+	/* One batch per iteration, as terminal_play_file() does it all */
+	vga_term_begin_batch(pb->term);
+	g_timer_start(pb->timer);
+	do {
+		more = terminal_playback_slice(pb);
+	} while (more &&
+		 g_timer_elapsed(pb->timer, NULL) * 1000 < pb->budget_ms);
+	vga_term_end_batch(pb->term);
 
-	n = fread(buf, 1, 4096, f);
-	while (n > 0)
+	/* Played out or stopped by func: finish gets the lock we hold */
+	if (!more && pb->finish != NULL)
 	{
-		for (i = 0; i < n; i++)
-			vga_term_emu_writec(term, buf[i]);
-		n = fread(buf, 1, 4096, f);
+		pb->finish(pb->term, pb->done == pb->len, pb->func_data);
+		pb->finish = NULL;
 	}
-	fclose(f);
+	gdk_threads_leave();
+
+	return more;
+}
+
+/*
+ * Play a file of captured output to the terminal.  The file is mapped
+ * and goes to the emulator in large slices, after each of which @func
+ * (if not NULL) is called with the bytes done so far and the total.
+ * If it returns FALSE, playback stops there.
+ *
+ * Returns FALSE if the file couldn't be opened or playback was stopped.
+ */
+gboolean terminal_play_file(VGATerm *term, const gchar *fname,
+			    TerminalPlayFunc func, gpointer data)
+{
+	TerminalPlayback *pb;
+	gboolean result;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), FALSE);
+	g_return_val_if_fail(fname != NULL, FALSE);
+
+	pb = terminal_playback_new(term, fname);
+	if (pb == NULL)
+		return FALSE;
+	pb->func = func;
+	pb->func_data = data;
+
+	vga_term_begin_batch(term);
+	while (terminal_playback_slice(pb))
+		;
+	vga_term_end_batch(term);
+	result = pb->done == pb->len;
+
+	terminal_playback_free(pb);
+	return result;
+}
+
+/*
+ * Like terminal_play_file(), but from the main loop, playing for about
+ * @budget_ms per iteration so the UI keeps up.  @finish (if not NULL)
+ * is called once playback is over, whether it played out, @func
+ * stopped it or it was cancelled.  Cancel by removing the returned
+ * source with g_source_remove(), but only until @finish is called:
+ * after that the id is no longer valid.
+ *
+ * When playback plays out or @func stops it, @finish is called from
+ * the main loop with the GDK lock held, like @func.  When it is
+ * cancelled, @finish is called from within g_source_remove(), under
+ * whatever locking its caller holds.
+ *
+ * Returns: the source id, or 0 if the file couldn't be opened
+ */
+guint terminal_play_file_async(VGATerm *term, const gchar *fname,
+			       gint budget_ms, TerminalPlayFunc func,
+			       TerminalPlayDoneFunc finish, gpointer data)
+{
+	TerminalPlayback *pb;
+
+	g_return_val_if_fail(VGA_IS_TERM(term), 0);
+	g_return_val_if_fail(fname != NULL, 0);
+	g_return_val_if_fail(budget_ms > 0, 0);
+
+	pb = terminal_playback_new(term, fname);
+	if (pb == NULL)
+		return 0;
+	pb->func = func;
+	pb->finish = finish;
+	pb->func_data = data;
+	pb->budget_ms = budget_ms;
+	pb->timer = g_timer_new();
+
+	return g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, terminal_playback_idle,
+			       pb, terminal_playback_free);
+}
+
+void terminal_dump_file(VGATerm *term, gchar * fname)
+{
+	terminal_play_file(term, fname, NULL, NULL);
 }
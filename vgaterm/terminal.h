@@ -24,6 +24,14 @@
 #include "emulation.h"
 #include "vgaterm.h"
 
+/* Progress of a file being played; return FALSE to stop */
+typedef gboolean (*TerminalPlayFunc)	(VGATerm *term, gsize done,
+					 gsize total, gpointer data);
+
+/* End of a terminal_play_file_async(); @completed is FALSE if stopped */
+typedef void (*TerminalPlayDoneFunc)	(VGATerm *term, gboolean completed,
+					 gpointer data);
+
 void		terminal_flush_input		(void);
 void		terminal_new_connection		(void);
 gboolean	terminal_key_pressed		(void);
@@ -35,5 +43,15 @@ void		terminal_process_input_char	(guchar c);
 */
 void		terminal_process_input		(guchar * s);
 void		terminal_dump_file		(VGATerm *term, gchar *fname);
+gboolean	terminal_play_file		(VGATerm *term,
+						 const gchar *fname,
+						 TerminalPlayFunc func,
+						 gpointer data);
+guint		terminal_play_file_async	(VGATerm *term,
+						 const gchar *fname,
+						 gint budget_ms,
+						 TerminalPlayFunc func,
+						 TerminalPlayDoneFunc finish,
+						 gpointer data);
 
 #endif	/* __TERMINAL_H__ */
@@ -0,0 +1,1234 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Based on ideas from Iniquity BBS's emulator, some of which
+ *  originally came from Turbo Pascal SWAG.  The ANSI and TextFX support
+ *  are most complete (since they're what really matters).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "vgaemu.h"
+#include "def_palette_rgb.h"
+
+/* Same conversion as TO_GDK_RGB() in vgapalette.h */
+#define EMU_RGB16(v)		((unsigned short) ((v) * 1040.23809 + 0.5))
+
+/* As in vgatext.h */
+#define EMU_SETFG(attr, fg)	(((attr) & 0xf0) | (fg))
+#define EMU_SETBG(attr, bg)	(((attr) & 0x8f) | ((bg) << 4))
+#define EMU_BRIGHT(attr)	((attr) | 0x08)
+#define EMU_BLINK(attr)		((attr) | 0x80)
+
+/* Attribute flags for vt100 */
+#define AVT_DEFAULT 0
+#define AVT_BOLD 1
+#define AVT_LOWINT 2
+#define AVT_ULINE 4
+#define AVT_BLINK 8
+#define AVT_REVERSE 16
+#define AVT_INVIS 32
+
+/* ANSI color number to VGA color */
+static const unsigned char ansi_colors[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+static int emu_wherex(VGAEmu *emu)
+{
+	int x, y;
+
+	emu->ops->wherexy(emu->screen, &x, &y);
+	return x;
+}
+
+static int emu_wherey(VGAEmu *emu)
+{
+	int x, y;
+
+	emu->ops->wherexy(emu->screen, &x, &y);
+	return y;
+}
+
+/* Move the cursor by @dx, @dy */
+static void emu_move(VGAEmu *emu, int dx, int dy)
+{
+	int x, y;
+
+	emu->ops->wherexy(emu->screen, &x, &y);
+	emu->ops->gotoxy(emu->screen, x + dx, y + dy);
+}
+
+static void emu_set_attr(VGAEmu *emu, unsigned char attr)
+{
+	emu->ops->set_attr(emu->screen, attr);
+}
+
+static unsigned char emu_get_attr(VGAEmu *emu)
+{
+	return emu->ops->get_attr(emu->screen);
+}
+
+static void emu_clear(VGAEmu *emu, int area)
+{
+	emu->ops->clear(emu->screen, area);
+}
+
+/* The whole screen as the window again */
+static void emu_full_window(VGAEmu *emu)
+{
+	int cols, rows;
+
+	if (emu->ops->window == NULL)
+		return;
+	emu->ops->size(emu->screen, &cols, &rows);
+	emu->ops->window(emu->screen, 1, 1, cols, rows);
+}
+
+static void emu_default_palette(VGAEmuPalette pal)
+{
+	memcpy(pal, default_palette_rgb, sizeof(VGAEmuPalette));
+}
+
+/*
+ * Get TextFX palette @c: a user palette ('1'-'3'), or stock white,
+ * black, the current one, the default or greyscale ('A'-'E').  Returns
+ * 0 if there's no such palette.
+ */
+static int tfx_get_pal(VGAEmu *emu, unsigned char c, VGAEmuPalette pal)
+{
+	long avg;
+	int i;
+
+	if (c >= '1' && c < '1' + VGA_EMU_USER_PALS)
+	{
+		memcpy(pal, emu->tfx_user_pal[c - '1'], sizeof(VGAEmuPalette));
+		return 1;
+	}
+
+	switch (c)
+	{
+		case 'A':
+			for (i = 0; i < VGA_EMU_PAL_REGS; i++)
+				pal[i][0] = pal[i][1] = pal[i][2] =
+					EMU_RGB16(63);
+			break;
+		case 'B':
+			memset(pal, 0, sizeof(VGAEmuPalette));
+			break;
+		case 'C':
+			if (emu->ops->get_palette == NULL)
+				return 0;
+			emu->ops->get_palette(emu->screen, pal);
+			break;
+		case 'D':
+			emu_default_palette(pal);
+			break;
+		case 'E':
+			/* Averaged from the default, as vga_palette_stock() */
+			emu_default_palette(pal);
+			for (i = 0; i < VGA_EMU_PAL_REGS; i++)
+			{
+				avg = ((long) pal[i][0] + pal[i][1] +
+				       pal[i][2]) / 3;
+				pal[i][0] = pal[i][1] = pal[i][2] = avg;
+			}
+			break;
+		default:
+			return 0;
+	}
+
+	return 1;
+}
+
+static void tfx_set_pal(VGAEmu *emu, const VGAEmuPalette pal)
+{
+	if (emu->ops->set_palette != NULL)
+		emu->ops->set_palette(emu->screen, pal);
+}
+
+/* One step of @pal toward @to, as vga_palette_morph_to_step() */
+static void tfx_morph_step(VGAEmuPalette pal, const VGAEmuPalette to)
+{
+	int i, j, v;
+
+	for (i = 0; i < VGA_EMU_PAL_REGS; i++)
+		for (j = 0; j < 3; j++)
+		{
+			v = pal[i][j];
+			if (v > to[i][j])
+				v = v - EMU_RGB16(1) > to[i][j] ?
+					v - EMU_RGB16(1) : to[i][j];
+			else
+				v = v + EMU_RGB16(1) < to[i][j] ?
+					v + EMU_RGB16(1) : to[i][j];
+			pal[i][j] = v;
+		}
+}
+
+static void tfx_command(VGAEmu *emu, unsigned char cmd)
+{
+	const VGAScreenOps *ops = emu->ops;
+	unsigned char *p = emu->tfx_param;
+	VGAEmuPalette pal, to;
+	int x, z, i, count;
+
+	switch (cmd)
+	{
+		case 'a':
+			emu_move(emu, 0, -1);
+			break;
+		case 'A':
+			emu_move(emu, 0, -p[0]);
+			break;
+		case 'b':
+			emu_move(emu, 0, 1);
+			break;
+		case 'B':
+			emu_move(emu, 0, p[0]);
+			break;
+		case 'c':
+			emu_move(emu, 1, 0);
+			break;
+		case 'C':
+			emu_move(emu, p[0], 0);
+			break;
+		case 'd':
+			emu_move(emu, -1, 0);
+			break;
+		case 'D':
+			emu_move(emu, -p[0], 0);
+			break;
+		case 'E':
+			/* We would send <esc>ENVgtermix v1.00<null> */
+			/* I think we should simulate keypresses here
+			 * on the widget */
+			break;
+		case 'F':
+			if (ops->font != NULL)
+				ops->font(emu->screen, p, 0, 256);
+			break;
+		case 'G':
+			/*
+			 * Characters p[0] to p[1] + 1.  Only the two
+			 * parameters are collected, so the glyphs are
+			 * whatever follows them in tfx_param.
+			 */
+			count = (unsigned char) (p[1] + 1) - p[0] + 1;
+			if (count > (int) (sizeof(emu->tfx_param) - 2) / 16)
+				count = (sizeof(emu->tfx_param) - 2) / 16;
+			if (count > 0 && ops->font != NULL)
+				ops->font(emu->screen, &p[2], p[0], count);
+			break;
+		case 'h':
+			ops->gotoxy(emu->screen, 1, 1);
+			break;
+		case 'H':
+			ops->gotoxy(emu->screen, p[0], p[1]);
+			break;
+		case 'i':
+			emu_set_attr(emu, emu->tfx_save_attr);
+			break;
+		case 'I':
+			emu->tfx_save_attr = emu_get_attr(emu);
+			break;
+		case 'j':
+			emu_set_attr(emu, emu->tfx_def_attr);
+			emu_clear(emu, VGA_EMU_CLEAR_SCREEN);
+			break;
+		case 'J':
+			emu_clear(emu, VGA_EMU_CLEAR_SCREEN);
+			break;
+		case 'k':
+			emu_set_attr(emu, emu->tfx_def_attr);
+			emu_clear(emu, VGA_EMU_CLEAR_EOL);
+			break;
+		case 'K':
+			emu_clear(emu, VGA_EMU_CLEAR_EOL);
+			break;
+		case 'l':
+			emu->tfx_def_attr = p[0];
+			break;
+		case 'M':
+			emu_set_attr(emu, p[0]);
+			break;
+		case 'n':
+			if (ops->cursor != NULL)
+				ops->cursor(emu->screen, 0);
+			break;
+		case 'N':
+			if (ops->cursor != NULL)
+				ops->cursor(emu->screen, 1);
+			break;
+		case 'p':
+			/* The current palette is already in place */
+			if (p[0] != 'C' && tfx_get_pal(emu, p[0], pal))
+				tfx_set_pal(emu, pal);
+			break;
+		case 'P':
+			for (i = 0; i < VGA_EMU_PAL_REGS; i++)
+			{
+				pal[i][0] = EMU_RGB16(p[i * 3]);
+				pal[i][1] = EMU_RGB16(p[i * 3 + 1]);
+				pal[i][2] = EMU_RGB16(p[i * 3 + 2]);
+			}
+			tfx_set_pal(emu, pal);
+			break;
+		case 'Q':
+			if (p[0] >= '1' && p[0] < '1' + VGA_EMU_USER_PALS)
+				tfx_get_pal(emu, 'C',
+					    emu->tfx_user_pal[p[0] - '1']);
+			break;
+		case 'r':
+			for (i = 0; i < p[1]; i++)
+				ops->writec(emu->screen, p[0]);
+			break;
+		case 'R':
+			if (p[0] < VGA_EMU_PAL_REGS && tfx_get_pal(emu, 'C', pal))
+			{
+				pal[p[0]][0] = EMU_RGB16(p[1]);
+				pal[p[0]][1] = EMU_RGB16(p[2]);
+				pal[p[0]][2] = EMU_RGB16(p[3]);
+				tfx_set_pal(emu, pal);
+			}
+			break;
+		case 's':
+			ops->gotoxy(emu->screen, emu->tfx_save_x,
+				    emu->tfx_save_y);
+			break;
+		case 'S':
+			ops->wherexy(emu->screen, &x, &z);
+			emu->tfx_save_x = x;
+			emu->tfx_save_y = z;
+			break;
+		case 't':
+			ops->scroll(emu->screen, emu_wherey(emu), -1);
+			break;
+		case 'T':
+			ops->scroll(emu->screen, emu_wherey(emu), -p[0]);
+			break;
+		case 'u':
+			ops->scroll(emu->screen, emu_wherey(emu), 1);
+			break;
+		case 'U':
+			ops->scroll(emu->screen, emu_wherey(emu), p[0]);
+			break;
+		case 'V':
+			// would put string <esc>TFX<#2>
+			break;
+		case 'W':
+			if (ops->window != NULL)
+				ops->window(emu->screen, p[0], p[1], p[2], p[3]);
+			break;
+		case 'X':
+			/* Morph from palette p[0] to p[1], p[2] fast */
+			x = p[2] ? 63 / p[2] : 0;
+			if (x < 1)
+				x = 1;
+			if (p[2] && tfx_get_pal(emu, p[0], pal) &&
+			    tfx_get_pal(emu, p[1], to))
+			{
+				tfx_set_pal(emu, pal);
+				for (z = 0; z < 63; z++)
+				{
+					tfx_morph_step(pal, to);
+					if (z % x == 0 || z == 62)
+						tfx_set_pal(emu, pal);
+				}
+			}
+			break;
+		case 'z':
+			if (p[0])
+				emu_full_window(emu);
+			if (p[1])
+			{
+				emu_default_palette(pal);
+				tfx_set_pal(emu, pal);
+			}
+			/* Back to the default font */
+			if (p[2] && ops->font != NULL)
+				ops->font(emu->screen, NULL, 0, 256);
+			break;
+		case 'Z':
+			emu_full_window(emu);
+			if (ops->icecolor != NULL)
+				ops->icecolor(emu->screen, 1);
+			emu_set_attr(emu, emu->tfx_def_attr);
+			emu_default_palette(pal);
+			tfx_set_pal(emu, pal);
+			emu_clear(emu, VGA_EMU_CLEAR_SCREEN);
+			if (ops->font != NULL)
+				ops->font(emu->screen, NULL, 0, 256);
+			break;
+	}
+	emu->tfx_stage = -1;
+}
+
+static void tfx_out(VGAEmu *emu, unsigned char c)
+{
+	if (emu->tfx_stage == -1)
+	{
+		if (c == 27)
+			emu->tfx_stage = 0;
+		else
+			emu->ops->writec(emu->screen, c);
+		return;
+	}
+
+	if (emu->tfx_stage == 0)
+	{
+		emu->tfx_cmd = c;
+		switch (c)
+		{
+			case 'a':case 'b':case 'c':case 'd':case 'E':
+			case 'h':case 'i':case 'I':case 'j':case 'J':
+			case 'k':case 'K':case 'n':case 'N':case 's':
+			case 'S':case 't':case 'u':case 'V':case 'Z':
+				emu->tfx_num = 0;
+				break;
+			case 'A':case 'B':case 'C':case 'D':case 'l':
+			case 'M':case 'p':case 'Q':case 'T':case 'U':
+				emu->tfx_num = 1;
+				break;
+			case 'G':
+			case 'H':
+			case 'r':
+				emu->tfx_num = 2;
+				break;
+			case 'z':
+			case 'X':
+				emu->tfx_num = 3;
+				break;
+			case 'R':
+			case 'W':
+				emu->tfx_num = 4;
+				break;
+			case 'P':
+				emu->tfx_num = 192;
+				break;
+			case 'F':
+				emu->tfx_num = 4096;
+				break;
+			default:
+				emu->tfx_stage = -1;
+				emu->ops->writec(emu->screen, c);
+				return;
+		}
+	}
+	else
+		emu->tfx_param[emu->tfx_stage - 1] = c;
+
+	if (emu->tfx_stage == emu->tfx_num)
+		tfx_command(emu, emu->tfx_cmd);
+	else
+		emu->tfx_stage++;
+}
+
+static void vt_init(VGAEmu *emu)
+{
+	emu->vt100 = 1;
+	emu->vt_code_len = 0;
+	emu->vt_stage = 0;
+	emu->vt_cmd = 0;
+	emu->vt_save_x = 1;
+	emu->vt_save_y = 1;
+	emu->vt_buf[0] = emu->vt_buf[1] = emu->vt_buf[2] = 0;
+	emu->vt_save_attr = 0x07;
+	emu->vt_attr = AVT_DEFAULT;
+	/* need to set the terminal text attr here? */
+}
+
+/*
+ * Get a regular VGA textmode attribute given a VT attribute byte.
+ * Note: The VT attribute byte is my own creation to manage the flags and
+ * isn't really part of any standard
+ */
+static unsigned char get_vt_color_attr(unsigned char at)
+{
+	unsigned char new_attr = 0x00;
+
+	if (at & AVT_BLINK)
+		new_attr = EMU_BLINK(new_attr);
+	if (at & AVT_REVERSE)
+	{
+		new_attr = EMU_SETBG(new_attr, 1);
+		if (at & AVT_ULINE && at & AVT_BOLD)
+			new_attr = EMU_SETBG(new_attr, 15);
+		else
+		if (at & AVT_BOLD)
+			new_attr = EMU_SETBG(new_attr, 7);
+		else
+		if (at & AVT_ULINE)
+			new_attr = EMU_SETBG(new_attr, 9);
+	}
+	else
+	{
+		if (at & AVT_ULINE && at & AVT_BOLD)
+			new_attr = EMU_SETFG(new_attr, 11);
+		else
+		if (at & AVT_BOLD)
+			new_attr = EMU_SETFG(new_attr, 15);
+		else
+		if (at & AVT_ULINE)
+			new_attr = EMU_SETFG(new_attr, 8);
+		else
+			new_attr = EMU_SETFG(new_attr, 7);
+	}
+
+	return new_attr;
+}
+
+static void vt_reset(VGAEmu *emu)
+{
+	emu->vt_code_len = 0;
+	emu->vt_cmd = 0;
+}
+
+/*
+ * Take the next number off the front of the parameters in @code, like
+ * the Pascal val() function: the digits up to the first ';', which goes
+ * too.  An empty number is 0.
+ */
+static unsigned char emu_parse_num(char *code, int *len)
+{
+	long n = 0;
+	int i;
+
+	for (i = 0; i < *len && code[i] >= '0' && code[i] <= '9'; i++)
+		if (n < 100000)
+			n = n * 10 + code[i] - '0';
+	if (i < *len)
+		i++;
+	memmove(code, code + i, *len - i);
+	*len -= i;
+
+	return n;
+}
+
+/* Keep a parameter character, if there's room */
+static void emu_add_code(char *code, int *len, char c)
+{
+	if (*len < VGA_EMU_CODE_MAX)
+		code[(*len)++] = c;
+}
+
+static unsigned char vt_num(VGAEmu *emu)
+{
+	return emu_parse_num(emu->vt_code, &emu->vt_code_len);
+}
+
+/* Go to the next tab position; gotoxy stops it at the window's edge */
+static void vt_tab(VGAEmu *emu)
+{
+	int x = emu_wherex(emu) + 1;
+
+	while ((x - 1) % 8 != 0)
+		x++;
+	emu->ops->gotoxy(emu->screen, x, emu_wherey(emu));
+}
+
+static void vt_process_attr(VGAEmu *emu, unsigned char c)
+{
+	switch (c)
+	{
+		case 0:
+			emu_set_attr(emu, 0x07);
+			emu->vt_attr = AVT_DEFAULT;
+			break;
+		case 1:
+			emu_set_attr(emu, EMU_BRIGHT(emu_get_attr(emu)));
+			emu->vt_attr = emu->vt_attr | AVT_BOLD;
+			if (AVT_REVERSE & emu->vt_attr ||
+				       AVT_ULINE & emu->vt_attr)
+			{
+				emu_set_attr(emu,
+					get_vt_color_attr(emu->vt_attr));
+			}
+			break;
+		case 2:
+			emu->vt_attr = emu->vt_attr | AVT_LOWINT;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		case 4:
+			emu->vt_attr = emu->vt_attr | AVT_ULINE;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		case 5:
+			emu->vt_attr = emu->vt_attr | AVT_BLINK;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		case 7:
+			emu->vt_attr = emu->vt_attr | AVT_REVERSE;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		case 8:
+			emu->vt_attr = emu->vt_attr | AVT_INVIS;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		default:
+			if (c >= 30 && c <= 37)
+				emu_set_attr(emu, (emu_get_attr(emu) & 0xf8) +
+					     ansi_colors[c - 30]);
+			else if (c >= 40 && c <= 47)
+				emu_set_attr(emu, EMU_SETBG(emu_get_attr(emu),
+					     ansi_colors[c - 40]));
+	}
+}
+
+static void vt_out(VGAEmu *emu, unsigned char c)
+{
+	const VGAScreenOps *ops = emu->ops;
+	int x, cols, rows;
+
+	if (emu->vt_cmd == 1)
+		switch (c)
+		{
+			case '[':
+				emu->vt_cmd = 2;
+				break;
+			case 'c':
+				vt_init(emu);
+				break;
+			case 'D':
+				ops->scroll(emu->screen, emu_wherey(emu), -1);
+				vt_reset(emu);
+				break;
+			case 'M':
+				ops->scroll(emu->screen, emu_wherey(emu), 1);
+				vt_reset(emu);
+				ops->gotoxy(emu->screen, 1, 1);
+				break;
+			case 'E':
+				ops->writec(emu->screen, 10);
+				break;
+			case '7':
+				emu->vt_save_x = emu_wherex(emu);
+				emu->vt_save_y = emu_wherey(emu);
+				emu->vt_save_attr = emu_get_attr(emu);
+				vt_reset(emu);
+				break;
+			case '8':
+				ops->gotoxy(emu->screen, emu->vt_save_x,
+					    emu->vt_save_y);
+				emu_set_attr(emu, emu->vt_save_attr);
+				vt_reset(emu);
+				break;
+			case 'A':
+				emu_move(emu, 0, -1);
+				vt_reset(emu);
+				break;
+			case 'B':
+				emu_move(emu, 0, 1);
+				vt_reset(emu);
+				break;
+			case 'C':
+				emu_move(emu, 1, 0);
+				vt_reset(emu);
+				break;
+			case 'H':
+				ops->gotoxy(emu->screen, 1, 1);
+				vt_reset(emu);
+				break;
+			case 'K':
+				emu_clear(emu, VGA_EMU_CLEAR_EOL);
+				vt_reset(emu);
+				break;
+			case '(':
+				emu->vt_cmd = 3;
+				break;
+			case ')':
+				emu->vt_cmd = 4;
+				break;
+			default:
+				vt_reset(emu);
+		}
+	else
+	if (emu->vt_cmd == 2)
+	{
+		if ((c >= '0' && c <= '9') || c == ';')
+			emu_add_code(emu->vt_code, &emu->vt_code_len, c);
+		else
+		switch (c)
+		{
+			case 'm':
+				if (emu->vt_code_len == 0)
+					emu_add_code(emu->vt_code,
+						     &emu->vt_code_len, '0');
+				while (emu->vt_code_len > 0)
+				{
+					vt_process_attr(emu, vt_num(emu));
+					vt_reset(emu);
+				}
+				break;
+			case 'A':
+			case 'B':
+			case 'C':
+			case 'D':
+				x = vt_num(emu);
+				if (x == 0)
+					x = 1;
+				if (c == 'A')
+					emu_move(emu, 0, -x);
+				else if (c == 'B')
+					emu_move(emu, 0, x);
+				else if (c == 'C')
+					emu_move(emu, x, 0);
+				else
+					emu_move(emu, -x, 0);
+				vt_reset(emu);
+				break;
+			case 'H':
+			case 'f':
+				x = vt_num(emu);
+				if (x == 0)
+					ops->gotoxy(emu->screen, 1, 1);
+				else
+					ops->gotoxy(emu->screen, vt_num(emu), x);
+				vt_reset(emu);
+				break;
+			case 'J':
+				switch (vt_num(emu))
+				{
+					case 0:
+						emu_clear(emu,
+							  VGA_EMU_CLEAR_DOWN);
+						break;
+					case 1:
+						emu_clear(emu,
+							  VGA_EMU_CLEAR_UP);
+						break;
+					case 2:
+						emu_clear(emu,
+							  VGA_EMU_CLEAR_SCREEN);
+						break;
+				}
+				vt_reset(emu);
+				break;
+			case 'K':
+				if (vt_num(emu) == 0)
+					emu_clear(emu, VGA_EMU_CLEAR_EOL);
+				vt_reset(emu);
+				break;
+			case 'r':
+				if (ops->window != NULL)
+				{
+					ops->size(emu->screen, &cols, &rows);
+					x = vt_num(emu);
+					ops->window(emu->screen, 1, x, cols,
+						    vt_num(emu));
+				}
+				ops->gotoxy(emu->screen, 1, 1);
+				vt_reset(emu);
+				break;
+			default:
+				vt_reset(emu);
+		}
+	}
+	else
+	/* Keyboard/character set codes */
+	if (emu->vt_cmd == 3 || emu->vt_cmd == 4)
+	{
+		vt_reset(emu);
+		/* unfinished?  check spec */
+	}
+	else
+	switch (c)
+	{
+		case 27:
+			emu->vt_cmd = 1;
+			break;
+		case 9:
+			vt_tab(emu);
+			break;
+		case 12:
+			emu_clear(emu, VGA_EMU_CLEAR_SCREEN);
+			break;
+		case '[':
+			emu->vt_buf[2] = '[';
+			ops->writec(emu->screen, c);
+			break;
+		case 15:
+			/* ??? */
+			break;
+		case 2:
+			/* Toggle bold attribute */
+			emu->vt_attr = emu->vt_attr ^ AVT_BOLD;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		case 22:
+			/* Toggle reverse video attribute */
+			emu->vt_attr = emu->vt_attr ^ AVT_REVERSE;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		case 31:
+			/* Toggle underline attribute */
+			emu->vt_attr = emu->vt_attr ^ AVT_ULINE;
+			emu_set_attr(emu, get_vt_color_attr(emu->vt_attr));
+			break;
+		default:
+			ops->writec(emu->screen, c);
+	}
+}
+
+static void ansi_init(VGAEmu *emu)
+{
+	emu->ansi_code_len = 0;
+	emu->ansi_save_x = 1;
+	emu->ansi_save_y = 1;
+	emu->ansi_esc = 0;
+	emu->avt_cmd = 0;
+	emu->avt_stage = 0;
+	emu->avt_par1 = 0;
+	emu->avt_par2 = 0;
+	emu->tfx_stage = -1;
+	emu->vt100 = 0;
+}
+
+static void ansi_detect_reply(VGAEmu *emu)
+{
+	char str[16];
+
+	snprintf(str, sizeof(str), "\033[%d;%dR",
+		 emu_wherey(emu), emu_wherex(emu));
+/* TODO: FIXME: */
+#if 0
+	termix_send_data(str, strlen(str));
+#endif
+}
+
+static unsigned char ansi_num(VGAEmu *emu)
+{
+	return emu_parse_num(emu->ansi_code, &emu->ansi_code_len);
+}
+
+static void ansi_cmd(VGAEmu *emu, unsigned char c)
+{
+	unsigned char attr;
+	int col, y;
+
+	if ((c >= '0' && c <= '9') || c == ';')
+	{
+		emu_add_code(emu->ansi_code, &emu->ansi_code_len, c);
+		return;
+	}
+	if (c == '?')
+		return;
+
+	emu->ansi_esc = 0;
+	switch (c)
+	{
+		case 'm':
+			attr = emu_get_attr(emu);
+			if (emu->ansi_code_len == 0)
+				emu_add_code(emu->ansi_code,
+					     &emu->ansi_code_len, '0');
+			while (emu->ansi_code_len > 0)
+			{
+				col = ansi_num(emu);
+				if (col == 0)
+					attr = 0x07;
+				else if (col == 1)
+					attr = EMU_BRIGHT(attr);
+				else if (col == 5)
+					attr = EMU_BLINK(attr);
+				else if (col == 7)
+					/* reverse video */
+					attr = ((attr << 4) & 0x70) |
+					       (attr >> 4);
+				else if (col >= 30 && col <= 37)
+					attr = (attr & 0xf8) +
+					       ansi_colors[col - 30];
+				else if (col >= 40 && col <= 47)
+					attr = EMU_SETBG(attr,
+						ansi_colors[col - 40]);
+			}
+			emu_set_attr(emu, attr);
+			break;
+		case 'H':
+		case 'f':
+			y = ansi_num(emu);
+			emu->ops->gotoxy(emu->screen, ansi_num(emu), y);
+			break;
+		case 'A':
+		case 'B':
+		case 'C':
+		case 'D':
+			y = ansi_num(emu);
+			if (y == 0)
+				y = 1;
+			if (c == 'A')
+				emu_move(emu, 0, -y);
+			else if (c == 'B')
+				emu_move(emu, 0, y);
+			else if (c == 'C')
+				emu_move(emu, y, 0);
+			else
+				emu_move(emu, -y, 0);
+			break;
+		case 's':
+			emu->ansi_save_x = emu_wherex(emu);
+			emu->ansi_save_y = emu_wherey(emu);
+			break;
+		case 'u':
+			emu->ops->gotoxy(emu->screen, emu->ansi_save_x,
+					 emu->ansi_save_y);
+			break;
+		case 'J':
+			emu_clear(emu, VGA_EMU_CLEAR_SCREEN);
+			break;
+		case 'K':
+			emu_clear(emu, VGA_EMU_CLEAR_EOL);
+			break;
+		case 'n':
+			ansi_detect_reply(emu);
+			break;
+	}
+}
+
+/*
+ * Set up @emu to drive @screen through @ops, in the state a freshly
+ * connected terminal starts in.  The ops table has to outlive @emu.
+ */
+void vga_emu_init(VGAEmu *emu, const VGAScreenOps *ops, void *screen)
+{
+	memset(emu, 0, sizeof(VGAEmu));
+	emu->ops = ops;
+	emu->screen = screen;
+
+	emu->tfx_stage = -1;
+	emu->tfx_def_attr = 0x07;
+	emu->tfx_save_x = 1;
+	emu->tfx_save_y = 1;
+	emu->tfx_save_attr = emu->tfx_def_attr;
+	emu->textfx = 1;
+
+	vt_init(emu);
+	ansi_init(emu);
+}
+
+/* Feed one character of output through the emulation */
+void vga_emu_writec(VGAEmu *emu, unsigned char c)
+{
+	const VGAScreenOps *ops = emu->ops;
+	int i;
+
+	/* vt100 is exclusive */
+	if (emu->vt100)
+		vt_out(emu, c);
+	else
+	if (emu->tfx_stage > 0)
+		tfx_out(emu, c);
+	else
+	if (emu->avt_cmd == 100)
+	{
+		if (emu->avt_stage == 1)
+		{
+			emu->avt_par1 = c;
+			emu->avt_stage++;
+		}
+		else
+		if (emu->avt_stage == 2)
+		{
+			for (i = 0; i < emu->avt_par1; i++)
+				ops->writec(emu->screen, c);
+			emu->avt_cmd = 0;
+		}
+	}
+	else
+	if (emu->ansi_esc > 0)
+	{
+		switch (emu->ansi_esc)
+		{
+			case 1:
+				if (c == '[')
+				{
+					emu->ansi_esc = 2;
+					emu->ansi_code_len = 0;
+				}
+				else
+				if (emu->textfx)
+				{
+					emu->ansi_esc = 0;
+					emu->tfx_stage = 0;
+					tfx_out(emu, c);
+				}
+				else
+					emu->ansi_esc = 0;
+				break;
+			case 2:
+				ansi_cmd(emu, c);
+				break;
+			default:
+				emu->ansi_esc = 0;
+				emu->ansi_code_len = 0;
+		}
+	}
+	else
+	if (emu->avt_cmd > 1)
+	{
+		switch (emu->avt_cmd)
+		{
+			case 2:
+				emu_set_attr(emu, c);
+				emu->avt_cmd = 0;
+				break;
+			case 3:
+				if (emu->avt_stage == 1)
+				{
+					emu->avt_par1 = c;
+					emu->avt_stage++;
+					break;
+				}
+				emu->avt_par2 = c;
+				ops->gotoxy(emu->screen, emu->avt_par1,
+					    emu->avt_par2);
+				emu->avt_cmd = 0;
+				break;
+			default:
+				emu->avt_cmd = 0;
+		}
+	}
+	else
+	if (emu->avt_cmd == 1)
+	{
+		emu->avt_cmd = 0;
+		switch (c)
+		{
+			case 1:
+				emu->avt_cmd = 2;
+				emu->avt_stage = 1;
+				break;
+			case 2:
+				emu_set_attr(emu, EMU_BLINK(emu_get_attr(emu)));
+				break;
+			case 3:
+				emu_move(emu, 0, -1);
+				break;
+			case 4:
+			case 6:
+				emu_move(emu, 0, 1);
+				break;
+			case 5:
+				emu_move(emu, -1, 0);
+				break;
+			case 7:
+				emu_clear(emu, VGA_EMU_CLEAR_EOL);
+				break;
+			case 8:
+				emu->avt_cmd = 3;
+				emu->avt_stage = 1;
+				break;
+		}
+	}
+	else
+	{
+		switch (c)
+		{
+			/* Avatar/0 commands */
+			/*
+			 * The 'Repeat' command has been disabled because
+			 * too many BBSes like to use this character literally
+			 * as an arrow.  Figure out a better solution later
+			 * (unfortunately this command is not escaped in
+			 * Avatar).
+			 */
+		/*	case 25:
+				emu->avt_cmd = 100;
+				emu->avt_stage = 1;
+				break;
+		*/
+			case 22:
+				emu->avt_cmd = 1;
+				break;
+			case 27:
+				emu->ansi_esc = 1;
+				break;
+			case 9:
+				vt_tab(emu);
+				break;
+			case 12:
+				emu_clear(emu, VGA_EMU_CLEAR_SCREEN);
+				break;
+			default:
+				ops->writec(emu->screen, c);
+		}
+	}
+}
+
+void vga_emu_write(VGAEmu *emu, const unsigned char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		vga_emu_writec(emu, s[i]);
+}
+
+#ifdef UNIT_TEST
+/*
+ * Compile with:
+ *     gcc gen-atlas.c vgarender.c -o gen-atlas
+ *     ./gen-atlas palette > def_palette_rgb.h
+ *     gcc vgaemu.c -o vgaemu-test -DUNIT_TEST
+ */
+#include <assert.h>
+
+#define TEST_COLS	20
+#define TEST_ROWS	5
+
+#define WRITE(emu, s)	vga_emu_write(emu, (const unsigned char *) s, \
+				      sizeof(s) - 1)
+
+/* A bare screen: no scrolling, and the cursor stops at the edges */
+typedef struct {
+	unsigned char ch[TEST_ROWS][TEST_COLS];
+	unsigned char at[TEST_ROWS][TEST_COLS];
+	int x, y;		/* 1 based */
+	unsigned char attr;
+	int clears;
+	VGAEmuPalette pal;
+} TestScreen;
+
+static void test_gotoxy(void *screen, int x, int y)
+{
+	TestScreen *t = screen;
+
+	t->x = x < 1 ? 1 : (x > TEST_COLS ? TEST_COLS : x);
+	t->y = y < 1 ? 1 : (y > TEST_ROWS ? TEST_ROWS : y);
+}
+
+static void test_writec(void *screen, unsigned char c)
+{
+	TestScreen *t = screen;
+
+	if (c == 13)
+		t->x = 1;
+	else if (c == 10)
+		test_gotoxy(t, 1, t->y + 1);
+	else
+	{
+		t->ch[t->y - 1][t->x - 1] = c;
+		t->at[t->y - 1][t->x - 1] = t->attr;
+		test_gotoxy(t, t->x + 1, t->y);
+	}
+}
+
+static void test_wherexy(void *screen, int *x, int *y)
+{
+	*x = ((TestScreen *) screen)->x;
+	*y = ((TestScreen *) screen)->y;
+}
+
+static void test_size(void *screen, int *cols, int *rows)
+{
+	*cols = TEST_COLS;
+	*rows = TEST_ROWS;
+}
+
+static void test_scroll(void *screen, int y, int n)
+{
+}
+
+static void test_clear(void *screen, int area)
+{
+	((TestScreen *) screen)->clears++;
+}
+
+static unsigned char test_get_attr(void *screen)
+{
+	return ((TestScreen *) screen)->attr;
+}
+
+static void test_set_attr(void *screen, unsigned char attr)
+{
+	((TestScreen *) screen)->attr = attr;
+}
+
+static void test_get_palette(void *screen, VGAEmuPalette pal)
+{
+	memcpy(pal, ((TestScreen *) screen)->pal, sizeof(VGAEmuPalette));
+}
+
+static void test_set_palette(void *screen, const VGAEmuPalette pal)
+{
+	memcpy(((TestScreen *) screen)->pal, pal, sizeof(VGAEmuPalette));
+}
+
+static const VGAScreenOps test_ops = {
+	test_writec, test_gotoxy, test_wherexy, test_size, test_scroll,
+	test_clear, test_get_attr, test_set_attr,
+	NULL, NULL, NULL, NULL, test_get_palette, test_set_palette
+};
+
+int main(void)
+{
+	TestScreen t;
+	VGAEmu emu;
+	int i;
+
+	memset(&t, 0, sizeof(t));
+	t.x = t.y = 1;
+	t.attr = 0x07;
+	emu_default_palette(t.pal);
+	vga_emu_init(&emu, &test_ops, &t);
+
+	/* Positioning and colors, with a sequence split over writes */
+	WRITE(&emu, "\033[2;");
+	WRITE(&emu, "3H\033[1;31;44mX\033[0mY");
+	assert(t.ch[1][2] == 'X' && t.at[1][2] == 0x1c);
+	assert(t.ch[1][3] == 'Y' && t.at[1][3] == 0x07);
+	WRITE(&emu, "\033[s\033[5B\033[99D\033[u");
+	assert(t.x == 5 && t.y == 2);
+
+	/* Too many parameter characters are dropped, not overrun */
+	WRITE(&emu, "\033[");
+	for (i = 0; i < 10 * VGA_EMU_CODE_MAX; i++)
+		WRITE(&emu, "1");
+	WRITE(&emu, "H");
+	assert(emu.ansi_esc == 0 && emu.ansi_code_len <= VGA_EMU_CODE_MAX);
+
+	/* Tabs stop at every 8th column and at the edge */
+	WRITE(&emu, "\033[1;2H\t");
+	assert(t.x == 9);
+	WRITE(&emu, "\t\t\t");
+	assert(t.x == TEST_COLS);
+
+	/* Avatar attribute and goto */
+	WRITE(&emu, "\026\001\x4e" "\026\010\004\003A");
+	assert(t.ch[2][3] == 'A' && t.at[2][3] == 0x4e);
+
+	/* TextFX repeat, save and restore position, and clear screen */
+	WRITE(&emu, "\033H\002\001\033S\033r#\003\033s\033J");
+	assert(t.ch[0][1] == '#' && t.ch[0][3] == '#' && t.ch[0][4] == 0);
+	assert(t.x == 2 && t.y == 1 && t.clears == 1);
+
+	/* TextFX palettes: a register, user palette 1, and back */
+	WRITE(&emu, "\033R\001\077\000\000");
+	assert(t.pal[1][0] == 0xffff && t.pal[1][2] == 0);
+	WRITE(&emu, "\033Q1\033pD");
+	assert(memcmp(t.pal, default_palette_rgb, sizeof(t.pal)) == 0);
+	WRITE(&emu, "\033p1");
+	assert(t.pal[1][0] == 0xffff);
+	/* 63 steps of a 6 bit level get within a level of the end */
+	WRITE(&emu, "\033XD1\001");
+	assert(t.pal[1][0] > 0xff00 && t.pal[1][2] == 0);
+
+	/* Unknown TextFX commands print */
+	WRITE(&emu, "\033[1;1H\033y");
+	assert(t.ch[0][0] == 'y' && emu.tfx_stage == -1);
+
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  The ANSI/vt100/Avatar/TextFX parser on its own.  Output is fed in
+ *  with vga_emu_write() and comes out as calls through a VGAScreenOps
+ *  table, which the VGATerm widget (emulation.c) and the headless
+ *  screen (vgaimage.c) each implement.  No GTK and no shared state, so
+ *  parsers can run on different threads at once.
+ */
+
+#ifndef __VGA_EMU_H__
+#define __VGA_EMU_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define VGA_EMU_PAL_REGS	64	/* Registers a TextFX palette sets */
+#define VGA_EMU_USER_PALS	3	/* TextFX user palettes '1'-'3' */
+#define VGA_EMU_CODE_MAX	64	/* ANSI/vt100 parameter characters kept */
+
+/* VGAScreenOps.clear() areas */
+#define VGA_EMU_CLEAR_SCREEN	0
+#define VGA_EMU_CLEAR_EOL	1
+#define VGA_EMU_CLEAR_DOWN	2	/* Cursor line to the bottom */
+#define VGA_EMU_CLEAR_UP	3	/* Top to the cursor line */
+
+/* 16 bit red, green and blue of each register, as TO_GDK_RGB() makes */
+typedef unsigned short VGAEmuPalette[VGA_EMU_PAL_REGS][3];
+
+/*
+ * What a screen does for the parser.  Positions are 1 based and within
+ * the current window, as with vga_term_gotoxy().  The ones from window
+ * on may be NULL if the screen has no such thing.
+ */
+typedef struct {
+	/* Print @c, or act on CR, LF, BS or BEL, as vga_term_writec() */
+	void (*writec) (void *screen, unsigned char c);
+	/* Move the cursor, clamped to the window */
+	void (*gotoxy) (void *screen, int x, int y);
+	void (*wherexy) (void *screen, int *x, int *y);
+	/* The whole screen, whatever the window */
+	void (*size) (void *screen, int *cols, int *rows);
+	/* Move the lines from @y down up by @n, or down if @n < 0 */
+	void (*scroll) (void *screen, int y, int n);
+	void (*clear) (void *screen, int area);
+	unsigned char (*get_attr) (void *screen);
+	void (*set_attr) (void *screen, unsigned char attr);
+
+	void (*window) (void *screen, int x1, int y1, int x2, int y2);
+	void (*cursor) (void *screen, int visible);
+	void (*icecolor) (void *screen, int on);
+	/* 8x16 glyphs for @count characters from @first; NULL for the default */
+	void (*font) (void *screen, const unsigned char *glyphs, int first,
+		      int count);
+	void (*get_palette) (void *screen, VGAEmuPalette pal);
+	void (*set_palette) (void *screen, const VGAEmuPalette pal);
+} VGAScreenOps;
+
+/*
+ * Parser state.  Public so a screen can embed it and a terminal can
+ * save and restore it in the middle of a sequence.
+ */
+typedef struct {
+	const VGAScreenOps *ops;
+	void *screen;
+
+	/* Individual emulation enablers */
+	int ansi, vt100, avatar, textfx;
+
+	int tfx_stage;
+	unsigned char tfx_param[4096];
+	unsigned char tfx_cmd;
+	int tfx_num;		/* param length for tfx_cmd */
+	unsigned char tfx_def_attr;
+	unsigned char tfx_save_x, tfx_save_y, tfx_save_attr;
+	VGAEmuPalette tfx_user_pal[VGA_EMU_USER_PALS];
+
+	char ansi_code[VGA_EMU_CODE_MAX];
+	int ansi_code_len;
+	unsigned char ansi_save_x, ansi_save_y;
+	unsigned char ansi_esc;
+
+	unsigned char avt_cmd, avt_stage, avt_par1, avt_par2;
+
+	char vt_code[VGA_EMU_CODE_MAX];
+	int vt_code_len;
+	unsigned char vt_stage, vt_cmd, vt_save_x, vt_save_y, vt_save_attr;
+	unsigned char vt_attr;
+	unsigned char vt_buf[3];
+} VGAEmu;
+
+void	vga_emu_init		(VGAEmu *emu, const VGAScreenOps *ops,
+				 void *screen);
+void	vga_emu_writec		(VGAEmu *emu, unsigned char c);
+void	vga_emu_write		(VGAEmu *emu, const unsigned char *s,
+				 size_t len);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __VGA_EMU_H__ */
@@ -0,0 +1,721 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "vgaexport.h"
+#include "def_palette_rgb.h"
+
+#define EXPORT_BUF_SIZE		(64 * 1024)
+#define EXPORT_GLYPH_MAX	8	/* Bytes per glyph slot */
+#define EXPORT_PLAIN		0x07	/* Colors that need no span */
+
+struct _VGAExport {
+	int format;		/* VGA_EXPORT_HTML or VGA_EXPORT_TEXT */
+	int icecolor;
+	VGAExportWriteFunc write;
+	void *data;
+	int started;		/* Header is out */
+	int failed;		/* A write failed */
+	int span;		/* Colors of the open span, fg | bg << 4 */
+	uint32_t rgb[16];
+
+	/* Output for each character, built once by vga_export_new() */
+	char glyph[256][EXPORT_GLYPH_MAX];
+	unsigned char glyph_len[256];
+	unsigned char blank[256];	/* Draws nothing in the foreground */
+
+	size_t len;
+	char buf[EXPORT_BUF_SIZE];
+};
+
+/* Text color to palette register, as in vgapalette.c */
+static const int pal_map[16] = {
+	0, 1, 2, 3, 4, 5, 20, 7, 56, 57, 58, 59, 60, 61, 62, 63
+};
+
+/* Code page 437 as Unicode; 0 is drawn blank */
+static const unsigned short cp437_unicode[256] = {
+	0x0020, 0x263a, 0x263b, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022,
+	0x25d8, 0x25cb, 0x25d9, 0x2642, 0x2640, 0x266a, 0x266b, 0x263c,
+	0x25ba, 0x25c4, 0x2195, 0x203c, 0x00b6, 0x00a7, 0x25ac, 0x21a8,
+	0x2191, 0x2193, 0x2192, 0x2190, 0x221f, 0x2194, 0x25b2, 0x25bc,
+	0x0020, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027,
+	0x0028, 0x0029, 0x002a, 0x002b, 0x002c, 0x002d, 0x002e, 0x002f,
+	0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+	0x0038, 0x0039, 0x003a, 0x003b, 0x003c, 0x003d, 0x003e, 0x003f,
+	0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+	0x0048, 0x0049, 0x004a, 0x004b, 0x004c, 0x004d, 0x004e, 0x004f,
+	0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+	0x0058, 0x0059, 0x005a, 0x005b, 0x005c, 0x005d, 0x005e, 0x005f,
+	0x0060, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+	0x0068, 0x0069, 0x006a, 0x006b, 0x006c, 0x006d, 0x006e, 0x006f,
+	0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+	0x0078, 0x0079, 0x007a, 0x007b, 0x007c, 0x007d, 0x007e, 0x2302,
+	0x00c7, 0x00fc, 0x00e9, 0x00e2, 0x00e4, 0x00e0, 0x00e5, 0x00e7,
+	0x00ea, 0x00eb, 0x00e8, 0x00ef, 0x00ee, 0x00ec, 0x00c4, 0x00c5,
+	0x00c9, 0x00e6, 0x00c6, 0x00f4, 0x00f6, 0x00f2, 0x00fb, 0x00f9,
+	0x00ff, 0x00d6, 0x00dc, 0x00a2, 0x00a3, 0x00a5, 0x20a7, 0x0192,
+	0x00e1, 0x00ed, 0x00f3, 0x00fa, 0x00f1, 0x00d1, 0x00aa, 0x00ba,
+	0x00bf, 0x2310, 0x00ac, 0x00bd, 0x00bc, 0x00a1, 0x00ab, 0x00bb,
+	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+	0x2555, 0x2563, 0x2551, 0x2557, 0x255d, 0x255c, 0x255b, 0x2510,
+	0x2514, 0x2534, 0x252c, 0x251c, 0x2500, 0x253c, 0x255e, 0x255f,
+	0x255a, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256c, 0x2567,
+	0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256b,
+	0x256a, 0x2518, 0x250c, 0x2588, 0x2584, 0x258c, 0x2590, 0x2580,
+	0x03b1, 0x00df, 0x0393, 0x03c0, 0x03a3, 0x03c3, 0x00b5, 0x03c4,
+	0x03a6, 0x0398, 0x03a9, 0x03b4, 0x221e, 0x03c6, 0x03b5, 0x2229,
+	0x2261, 0x00b1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00f7, 0x2248,
+	0x00b0, 0x2219, 0x00b7, 0x221a, 0x207f, 0x00b2, 0x25a0, 0x00a0
+};
+
+/* Encode @u (BMP only) as UTF-8 at @s; returns the length */
+static int export_utf8(unsigned short u, char *s)
+{
+	if (u < 0x80)
+	{
+		s[0] = u;
+		return 1;
+	}
+	if (u < 0x800)
+	{
+		s[0] = 0xc0 | (u >> 6);
+		s[1] = 0x80 | (u & 0x3f);
+		return 2;
+	}
+	s[0] = 0xe0 | (u >> 12);
+	s[1] = 0x80 | ((u >> 6) & 0x3f);
+	s[2] = 0x80 | (u & 0x3f);
+	return 3;
+}
+
+static void export_build_glyphs(VGAExport *exp)
+{
+	const char *esc;
+	int c;
+
+	for (c = 0; c < 256; c++)
+	{
+		esc = NULL;
+		if (exp->format == VGA_EXPORT_HTML)
+		{
+			if (c == '&')
+				esc = "&amp;";
+			else if (c == '<')
+				esc = "&lt;";
+			else if (c == '>')
+				esc = "&gt;";
+		}
+
+		if (esc != NULL)
+		{
+			exp->glyph_len[c] = strlen(esc);
+			memcpy(exp->glyph[c], esc, exp->glyph_len[c]);
+		}
+		else
+			exp->glyph_len[c] = export_utf8(cp437_unicode[c],
+							exp->glyph[c]);
+		exp->blank[c] = c == 0 || c == ' ' || c == 0xff;
+	}
+}
+
+static void export_flush(VGAExport *exp)
+{
+	if (exp->len > 0 && !exp->failed &&
+	    !exp->write(exp->data, exp->buf, exp->len))
+		exp->failed = 1;
+	exp->len = 0;
+}
+
+static void export_put(VGAExport *exp, const char *s, size_t len)
+{
+	if (len > EXPORT_BUF_SIZE - exp->len)
+		export_flush(exp);
+	if (len > EXPORT_BUF_SIZE)
+	{
+		if (!exp->failed && !exp->write(exp->data, s, len))
+			exp->failed = 1;
+		return;
+	}
+	memcpy(exp->buf + exp->len, s, len);
+	exp->len += len;
+}
+
+static void export_puts(VGAExport *exp, const char *s)
+{
+	export_put(exp, s, strlen(s));
+}
+
+/* The glyphs of @n cells, straight from the table */
+static void export_glyphs(VGAExport *exp, const unsigned char *cells, int n)
+{
+	char *dst;
+	int k;
+
+	while (n > 0)
+	{
+		k = (EXPORT_BUF_SIZE - exp->len) / EXPORT_GLYPH_MAX;
+		if (k == 0)
+		{
+			export_flush(exp);
+			continue;
+		}
+		if (k > n)
+			k = n;
+		n -= k;
+
+		/* Copy whole slots, which is one move each, and keep only
+		 * as much of each as the glyph needs */
+		dst = exp->buf + exp->len;
+		while (k-- > 0)
+		{
+			memcpy(dst, exp->glyph[*cells], EXPORT_GLYPH_MAX);
+			dst += exp->glyph_len[*cells];
+			cells += 2;
+		}
+		exp->len = dst - exp->buf;
+	}
+}
+
+/* Foreground and background shown for @attr, as fg | bg << 4 */
+static int export_colors(VGAExport *exp, unsigned char attr)
+{
+	int bg = (attr >> 4) & 0x07;
+
+	if ((attr & 0x80) && exp->icecolor)
+		bg |= 0x08;
+	return (attr & 0x0f) | (bg << 4);
+}
+
+static void export_begin(VGAExport *exp)
+{
+	exp->started = 1;
+	if (exp->format == VGA_EXPORT_HTML)
+		export_puts(exp, "<!DOCTYPE html>\n<html>\n<head>\n"
+			    "<meta charset=\"utf-8\">\n</head>\n<body>\n"
+			    "<pre class=\"vga\">");
+}
+
+/* Close the open span and open one for @colors, unless they're plain */
+static void export_span(VGAExport *exp, int colors)
+{
+	char s[32];
+
+	if (exp->span != EXPORT_PLAIN)
+		export_puts(exp, "</span>");
+	if (colors != EXPORT_PLAIN)
+	{
+		snprintf(s, sizeof(s), "<span class=\"f%d b%d\">",
+			 colors & 0x0f, colors >> 4);
+		export_puts(exp, s);
+	}
+	exp->span = colors;
+}
+
+/* Length of the row once blanks on black are dropped from its end */
+static int export_row_end(VGAExport *exp, const unsigned char *cells,
+			  int cols)
+{
+	while (cols > 0 && exp->blank[cells[cols * 2 - 2]] &&
+	       (exp->format == VGA_EXPORT_TEXT ||
+		(export_colors(exp, cells[cols * 2 - 1]) >> 4) == 0))
+		cols--;
+	return cols;
+}
+
+static int export_run_blank(VGAExport *exp, const unsigned char *cells,
+			    int n)
+{
+	while (n-- > 0)
+	{
+		if (!exp->blank[*cells])
+			return 0;
+		cells += 2;
+	}
+	return 1;
+}
+
+/* @n cells in @attr, in a span of their colors */
+static void export_run(VGAExport *exp, const unsigned char *cells, int n,
+		       unsigned char attr)
+{
+	int colors;
+
+	/* Blanks only show the background, so they can stay in the open
+	 * span if that matches */
+	colors = export_colors(exp, attr);
+	if (export_run_blank(exp, cells, n))
+		colors = (colors & 0xf0) | (exp->span & 0x0f);
+	if (colors != exp->span)
+		export_span(exp, colors);
+	export_glyphs(exp, cells, n);
+}
+
+/*
+ * Create an exporter to @format (VGA_EXPORT_*) that hands its output to
+ * @write, in blocks of up to 64 KB.  @flags are VGA_EXPORT_* flags.
+ * Returns NULL if out of memory.
+ */
+VGAExport * vga_export_new(int format, int flags, VGAExportWriteFunc write,
+			   void *data)
+{
+	VGAExport *exp;
+	const unsigned short *c;
+	int i;
+
+	if (format != VGA_EXPORT_HTML && format != VGA_EXPORT_TEXT)
+		return NULL;
+
+	exp = calloc(1, sizeof(VGAExport));
+	if (exp == NULL)
+		return NULL;
+	exp->format = format;
+	exp->icecolor = !(flags & VGA_EXPORT_NO_ICECOLOR);
+	exp->write = write;
+	exp->data = data;
+	exp->span = EXPORT_PLAIN;
+	for (i = 0; i < 16; i++)
+	{
+		c = default_palette_rgb[pal_map[i]];
+		exp->rgb[i] = ((uint32_t) (c[0] >> 8) << 16) |
+			((c[1] >> 8) << 8) | (c[2] >> 8);
+	}
+	export_build_glyphs(exp);
+
+	return exp;
+}
+
+/*
+ * Colors for the 16 text colors, as 0xRRGGBB.  HTML gets its style
+ * sheet at the end, so this can be called any time before
+ * vga_export_finish().
+ */
+void vga_export_set_palette(VGAExport *exp, const uint32_t *rgb)
+{
+	memcpy(exp->rgb, rgb, sizeof(exp->rgb));
+}
+
+/*
+ * Export one row of @cols character and attribute pairs.  Blanks on
+ * black at the end of the row are left off.
+ */
+void vga_export_row(VGAExport *exp, const unsigned char *cells, int cols)
+{
+	unsigned char attr;
+	int x, start, end;
+
+	if (!exp->started)
+		export_begin(exp);
+	end = export_row_end(exp, cells, cols);
+
+	if (exp->format == VGA_EXPORT_TEXT)
+		export_glyphs(exp, cells, end);
+	else
+		for (x = 0; x < end; x = start)
+		{
+			/* One attribute run at a time */
+			attr = cells[x * 2 + 1];
+			for (start = x + 1; start < end &&
+			     cells[start * 2 + 1] == attr; start++)
+				;
+			export_run(exp, cells + x * 2, start - x, attr);
+		}
+
+	export_put(exp, "\n", 1);
+}
+
+/*
+ * vga_export_row() for a row whose attribute runs are already known,
+ * such as a terminal screen row from vga_get_attr_runs(), so the
+ * attributes aren't scanned again.  @runs are in column order.
+ */
+void vga_export_row_runs(VGAExport *exp, const unsigned char *cells,
+			 int cols, const VGAExportRun *runs, int n_runs)
+{
+	int i, end;
+
+	if (!exp->started)
+		export_begin(exp);
+	end = export_row_end(exp, cells, cols);
+
+	if (exp->format == VGA_EXPORT_TEXT)
+		export_glyphs(exp, cells, end);
+	else
+		for (i = 0; i < n_runs && runs[i].start < end; i++)
+			export_run(exp, cells + runs[i].start * 2,
+				   runs[i].start + runs[i].len > end ?
+				   end - runs[i].start : runs[i].len,
+				   runs[i].attr);
+
+	export_put(exp, "\n", 1);
+}
+
+/*
+ * Rows of a screen that vga_export_screen() would export: @rows, less
+ * any at the bottom that would export as nothing.
+ */
+int vga_export_screen_rows(VGAExport *exp, const unsigned char *cells,
+			   int cols, int rows)
+{
+	while (rows > 0 &&
+	       export_row_end(exp, cells + (rows - 1) * cols * 2, cols) == 0)
+		rows--;
+	return rows;
+}
+
+/*
+ * Export a screen of @rows rows, leaving off any rows at the bottom that
+ * would export as nothing.
+ */
+void vga_export_screen(VGAExport *exp, const unsigned char *cells, int cols,
+		       int rows)
+{
+	int y;
+
+	rows = vga_export_screen_rows(exp, cells, cols, rows);
+	for (y = 0; y < rows; y++)
+		vga_export_row(exp, cells + y * cols * 2, cols);
+}
+
+/*
+ * End the output and free @exp.  Returns 0 if any of it couldn't be
+ * written.
+ */
+int vga_export_finish(VGAExport *exp)
+{
+	char s[96];
+	int i, ok;
+
+	if (!exp->started)
+		export_begin(exp);
+	if (exp->format == VGA_EXPORT_HTML)
+	{
+		export_span(exp, EXPORT_PLAIN);
+
+		/* Applies to the whole page wherever it is, and only here
+		 * are the final colors known */
+		snprintf(s, sizeof(s), "</pre>\n<style>\npre.vga { "
+			 "background: #%06x; color: #%06x; }\n",
+			 (unsigned) exp->rgb[0], (unsigned) exp->rgb[7]);
+		export_puts(exp, s);
+		for (i = 0; i < 16; i++)
+		{
+			snprintf(s, sizeof(s), ".f%d { color: #%06x; } "
+				 ".b%d { background: #%06x; }\n", i,
+				 (unsigned) exp->rgb[i], i,
+				 (unsigned) exp->rgb[i]);
+			export_puts(exp, s);
+		}
+		export_puts(exp, "</style>\n</body>\n</html>\n");
+	}
+	export_flush(exp);
+
+	ok = !exp->failed;
+	free(exp);
+	return ok;
+}
+
+/* A VGAExportWriteFunc for a stdio FILE * */
+int vga_export_stdio(void *data, const char *buf, size_t len)
+{
+	return fwrite(buf, 1, len, data) == len;
+}
+
+static void export_line(void *data, const unsigned char *cells, int cols)
+{
+	vga_export_row(data, cells, cols);
+}
+
+/*
+ * Run @fname through @img from a blank screen and export everything that
+ * was on it, line by line as it scrolls off, then what's left on the
+ * screen.  The colors are the ones the file left @img with.  Returns 0
+ * if @fname couldn't be read.
+ */
+int vga_export_file(VGAExport *exp, VGAImage *img, const char *fname)
+{
+	uint32_t rgb[16];
+	int ok;
+
+	vga_image_reset(img);
+	vga_image_set_line_func(img, export_line, exp);
+	ok = vga_image_write_file(img, fname);
+	vga_image_set_line_func(img, NULL, NULL);
+
+	vga_export_screen(exp, vga_image_get_cells(img),
+			  vga_image_get_cols(img), vga_image_get_rows(img));
+	vga_image_get_palette(img, rgb);
+	vga_export_set_palette(exp, rgb);
+
+	return ok;
+}
+
+typedef struct {
+	const char *const *files;
+	const char *const *outputs;
+	int format, flags;
+	VGAImage **screens;	/* One per worker */
+	int *exported;		/* Count per worker */
+} ExportBatch;
+
+static void export_batch_job(void *data, int job, int worker)
+{
+	ExportBatch *b = data;
+	VGAExport *exp;
+	FILE *f;
+	int ok = 0;
+
+	f = fopen(b->outputs[job], "wb");
+	if (f == NULL)
+		return;
+	exp = vga_export_new(b->format, b->flags, vga_export_stdio, f);
+	if (exp != NULL)
+	{
+		ok = vga_export_file(exp, b->screens[worker], b->files[job]);
+		ok = vga_export_finish(exp) && ok;
+	}
+	ok = fclose(f) == 0 && ok;
+
+	if (ok)
+		b->exported[worker]++;
+	else
+		unlink(b->outputs[job]);
+}
+
+/*
+ * Export each of @files to the matching one of @outputs, spread over
+ * @pool with a headless screen of @cols x @rows (see vga_image_new())
+ * per worker.  An output that couldn't be finished is removed.
+ *
+ * Returns: how many files were exported, or -1 if out of memory
+ */
+int vga_export_files(WorkPool *pool, const char *const *files,
+		     const char *const *outputs, int n_files, int format,
+		     int flags, int cols, int rows, int image_flags)
+{
+	ExportBatch b;
+	int i, n_screens, total = -1;
+
+	n_screens = pool->n_threads + 1;
+	b.files = files;
+	b.outputs = outputs;
+	b.format = format;
+	b.flags = flags;
+	b.screens = calloc(n_screens, sizeof(VGAImage *));
+	b.exported = calloc(n_screens, sizeof(int));
+	if (b.screens == NULL || b.exported == NULL)
+		goto out;
+	for (i = 0; i < n_screens; i++)
+	{
+		b.screens[i] = vga_image_new(cols, rows, image_flags);
+		if (b.screens[i] == NULL)
+			goto out;
+	}
+
+	workpool_run(pool, n_files, export_batch_job, &b);
+	for (i = 0, total = 0; i < n_screens; i++)
+		total += b.exported[i];
+
+out:
+	if (b.screens != NULL)
+		for (i = 0; i < n_screens; i++)
+			if (b.screens[i] != NULL)
+				vga_image_destroy(b.screens[i]);
+	free(b.screens);
+	free(b.exported);
+	return total;
+}
+
+#ifdef UNIT_TEST
+/*
+ * Compile with:
+ *     gcc gen-atlas.c vgarender.c -o gen-atlas
+ *     ./gen-atlas palette > def_palette_rgb.h
+ *     gcc -c vgaimage.c vgaemu.c vgarender.c workpool.c
+ *     gcc vgaexport.c vgaimage.o vgaemu.o vgarender.o workpool.o \
+ *         -o vgaexport-test -DUNIT_TEST -lpthread
+ */
+#include <assert.h>
+
+#define TEST_FILES	8
+
+/* ANSI color number to VGA color */
+static const int ansi_colors[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+typedef struct {
+	char buf[256 * 1024];
+	size_t len;
+	int writes;
+} TestOut;
+
+static int test_write(void *data, const char *buf, size_t len)
+{
+	TestOut *out = data;
+
+	assert(out->len + len < sizeof(out->buf));
+	memcpy(out->buf + out->len, buf, len);
+	out->len += len;
+	out->buf[out->len] = 0;
+	out->writes++;
+	return 1;
+}
+
+static void test_row(unsigned char *cells, const char *s, unsigned char attr,
+		     int cols)
+{
+	int x;
+
+	for (x = 0; x < cols; x++)
+	{
+		cells[x * 2] = *s ? (unsigned char) *s++ : 0;
+		cells[x * 2 + 1] = attr;
+	}
+}
+
+int main(void)
+{
+	static TestOut out;
+	unsigned char row[80 * 2];
+	VGAExportRun runs[2];
+	char names[TEST_FILES][32], outputs[TEST_FILES][32];
+	const char *files[TEST_FILES], *outs[TEST_FILES];
+	VGAExport *exp;
+	VGAImage *img;
+	WorkPool *pool;
+	FILE *f;
+	int i, n;
+
+	/* Text: CP437 to UTF-8, trailing blanks dropped */
+	exp = vga_export_new(VGA_EXPORT_TEXT, 0, test_write, &out);
+	test_row(row, "a\xb0\xdb\x01<  ", 0x1f, 80);
+	vga_export_row(exp, row, 80);
+	assert(vga_export_finish(exp));
+	assert(strcmp(out.buf, "a\xe2\x96\x91\xe2\x96\x88\xe2\x98\xba<\n") == 0);
+
+	/* HTML: one span per color change, none for plain text */
+	out.len = 0;
+	exp = vga_export_new(VGA_EXPORT_HTML, 0, test_write, &out);
+	test_row(row, "plain & <b>", 0x07, 80);
+	vga_export_row(exp, row, 80);
+	test_row(row, "red", 0x0c, 80);
+	row[3 * 2] = ' ';
+	row[4 * 2] = 'x';
+	row[4 * 2 + 1] = 0x0c;
+	vga_export_row(exp, row, 80);
+	test_row(row, "ice", 0x9e, 3);
+	vga_export_row(exp, row, 3);
+	assert(vga_export_finish(exp));
+	assert(strstr(out.buf, "<pre class=\"vga\">plain &amp; &lt;b&gt;\n"
+		      "<span class=\"f12 b0\">red x\n</span>"
+		      "<span class=\"f14 b9\">ice\n</span></pre>") != NULL);
+	assert(strstr(out.buf, ".f12 { color: #ff5555; }") != NULL);
+
+	/* Given runs export the same as runs found in the cells */
+	out.len = 0;
+	exp = vga_export_new(VGA_EXPORT_HTML, 0, test_write, &out);
+	test_row(row, "red", 0x0c, 80);
+	row[3 * 2] = ' ';
+	row[4 * 2] = 'x';
+	runs[0].start = 0;
+	runs[0].len = 4;
+	runs[0].attr = 0x0c;
+	runs[1].start = 4;
+	runs[1].len = 76;
+	runs[1].attr = 0x0c;
+	vga_export_row_runs(exp, row, 80, runs, 2);
+	assert(vga_export_finish(exp));
+	assert(strstr(out.buf, "<pre class=\"vga\"><span class=\"f12 b0\">"
+		      "red x\n</span></pre>") != NULL);
+
+	/* Blank runs stay in the open span whatever their foreground */
+	out.len = 0;
+	exp = vga_export_new(VGA_EXPORT_HTML, 0, test_write, &out);
+	test_row(row, "ab", 0x1a, 2);
+	row[1 * 2] = ' ';
+	row[1 * 2 + 1] = 0x13;
+	vga_export_row(exp, row, 2);
+	assert(vga_export_finish(exp));
+	assert(strstr(out.buf, "<span class=\"f10 b1\">a \n</span>") != NULL);
+
+	/* A long history goes out in blocks, not all at once */
+	out.len = 0;
+	out.writes = 0;
+	exp = vga_export_new(VGA_EXPORT_TEXT, 0, test_write, &out);
+	test_row(row, "\xb1\xb1\xb1\xb1\xb1\xb1\xb1\xb1\xb1\xb1", 0x07, 80);
+	for (i = 0; i < 5000; i++)
+		vga_export_row(exp, row, 80);
+	assert(vga_export_finish(exp));
+	assert(out.len == 5000 * 31 && out.writes > 1);
+
+	/* A file, with what scrolls off and what's left on screen */
+	img = vga_image_new(80, 25, VGA_IMAGE_STOP_AT_EOF);
+	f = fopen("/tmp/vgaexport.ans", "wb");
+	assert(f != NULL);
+	for (i = 0; i < 100; i++)
+		fprintf(f, "line %d\r\n", i);
+	fprintf(f, "\033[2J\033[1;31mlast\033[0m\x1aSAUCE");
+	fclose(f);
+	out.len = 0;
+	exp = vga_export_new(VGA_EXPORT_TEXT, 0, test_write, &out);
+	assert(vga_export_file(exp, img, "/tmp/vgaexport.ans"));
+	assert(vga_export_finish(exp));
+	assert(strncmp(out.buf, "line 0\nline 1\n", 14) == 0);
+	assert(strstr(out.buf, "line 99\nlast\n") != NULL);
+	assert(strcmp(out.buf + out.len - 5, "last\n") == 0);
+	unlink("/tmp/vgaexport.ans");
+	vga_image_destroy(img);
+
+	/* A batch over a pool */
+	for (i = 0; i < TEST_FILES; i++)
+	{
+		snprintf(names[i], sizeof(names[i]), "/tmp/vgaexport-%d.ans", i);
+		snprintf(outputs[i], sizeof(outputs[i]),
+			 "/tmp/vgaexport-%d.html", i);
+		files[i] = names[i];
+		outs[i] = outputs[i];
+		f = fopen(names[i], "wb");
+		assert(f != NULL);
+		fprintf(f, "\033[4%dmfile %d\r\n", i % 7 + 1, i);
+		fclose(f);
+	}
+	pool = workpool_new(3);
+	assert(vga_export_files(pool, files, outs, TEST_FILES,
+				VGA_EXPORT_HTML, 0, 80, 25, 0) == TEST_FILES);
+	for (i = 0; i < TEST_FILES; i++)
+	{
+		f = fopen(outputs[i], "rb");
+		assert(f != NULL);
+		n = fread(out.buf, 1, sizeof(out.buf) - 1, f);
+		out.buf[n] = 0;
+		fclose(f);
+		snprintf((char *) row, sizeof(row),
+			 "<span class=\"f7 b%d\">file %d",
+			 ansi_colors[i % 7 + 1], i);
+		assert(strstr(out.buf, (char *) row) != NULL);
+		unlink(names[i]);
+		unlink(outputs[i]);
+	}
+	workpool_destroy(pool);
+
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Exporting screen rows as HTML or as plain UTF-8 text.  Rows are fed
+ *  in one at a time, oldest first, and go out through a write callback
+ *  in large blocks, so a history of any length is exported in the same
+ *  small amount of memory.  Glyphs come from a CP437 to UTF-8 table
+ *  built when the exporter is created, and HTML gets one span per run
+ *  of differing colors rather than per cell.
+ *
+ *  vga_export_file() runs a whole file through a headless screen (see
+ *  vgaimage.h), exporting each line as it scrolls off; vga_term_export()
+ *  in vgaterm.h exports a terminal's scrollback and screen.
+ */
+
+#ifndef __VGA_EXPORT_H__
+#define __VGA_EXPORT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vgaimage.h"
+#include "workpool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Formats */
+#define VGA_EXPORT_HTML		0
+#define VGA_EXPORT_TEXT		1
+
+/* vga_export_new() flags */
+#define VGA_EXPORT_NO_ICECOLOR	(1 << 0)	/* Blink bit is blink, not a
+						 * bright background */
+
+typedef struct _VGAExport VGAExport;
+
+/* Columns sharing a text attribute, as in a vga_attr_run */
+typedef struct {
+	unsigned short start;	/* First column of the run */
+	unsigned short len;	/* Number of columns */
+	unsigned char attr;	/* The text attribute */
+} VGAExportRun;
+
+/* Output sink; returns 0 if @len bytes at @buf couldn't be written */
+typedef int (*VGAExportWriteFunc) (void *data, const char *buf, size_t len);
+
+VGAExport *	vga_export_new		(int format, int flags,
+					 VGAExportWriteFunc write, void *data);
+void		vga_export_set_palette	(VGAExport *exp, const uint32_t *rgb);
+void		vga_export_row		(VGAExport *exp,
+					 const unsigned char *cells, int cols);
+void		vga_export_row_runs	(VGAExport *exp,
+					 const unsigned char *cells, int cols,
+					 const VGAExportRun *runs,
+					 int n_runs);
+int		vga_export_screen_rows	(VGAExport *exp,
+					 const unsigned char *cells, int cols,
+					 int rows);
+void		vga_export_screen	(VGAExport *exp,
+					 const unsigned char *cells, int cols,
+					 int rows);
+int		vga_export_finish	(VGAExport *exp);
+int		vga_export_stdio	(void *data, const char *buf,
+					 size_t len);
+int		vga_export_file		(VGAExport *exp, VGAImage *img,
+					 const char *fname);
+int		vga_export_files	(WorkPool *pool,
+					 const char *const *files,
+					 const char *const *outputs,
+					 int n_files, int format, int flags,
+					 int cols, int rows, int image_flags);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __VGA_EXPORT_H__ */
@@ -1,6 +1,8 @@
 /*
  * Compile with:
- *     gcc vgafont-demo.c vgafont.c -o vgafont-demo `pkg-config --cflags --libs gtk+-2.0`
+ *     gcc gen-atlas.c vgarender.c -o gen-atlas
+ *     ./gen-atlas font > def_atlas.h; ./gen-atlas palette > def_palette_rgb.h
+ *     gcc vgafont-demo.c vgafont.c vgarender.c marshal.c -o vgafont-demo `pkg-config --cflags --libs gtk+-2.0`
  */
 #include <gtk/gtk.h>
 #include <gdk/gdkscreen.h>
@@ -17,6 +17,8 @@
  */
 
 #include "vgafont.h"
+#include "marshal.h"
+#include "def_atlas.h"
 
 
 /* Function prototypes for Cairo user font callbacks */
@@ -56,8 +58,24 @@ static void vga_font_finalize	(GObject *gobject);
 #define VGA_FONT_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), VGA_TYPE_FONT, VGAFontPrivate))
 struct _VGAFontPrivate {
 	guchar *data;
+	gboolean shared;	/* Interned, so must never be modified */
+	guint hash;		/* Content hash, valid if shared */
+	GSList *atlases;	/* VGAAtlas, one for each scale/mode in use */
 };
 
+/*
+ * Registry of interned fonts, so that every widget using the same font
+ * data shares one font object (and so one set of atlases).  Maps a
+ * content hash to a GSList of fonts with that hash.  The registry holds
+ * a reference to each font, so interned fonts live for the life of the
+ * process, much like the stock palettes.
+ */
+G_LOCK_DEFINE_STATIC(font_registry);
+static GHashTable *font_registry = NULL;
+
+/* Protects the atlas lists, since atlases are built on first use */
+G_LOCK_DEFINE_STATIC(font_atlas);
+
 G_DEFINE_TYPE(VGAFont, vga_font, G_TYPE_OBJECT)
 
 static void vga_font_class_init(VGAFontClass *klass)
@@ -68,6 +86,20 @@ static void vga_font_class_init(VGAFontClass *klass)
 
 	obj_class->dispose = vga_font_dispose;
 	obj_class->finalize = vga_font_finalize;
+
+	/*
+	 * Emitted with the first and last glyph codes whose data actually
+	 * changed, so users of the font only redraw what they must.
+	 */
+	klass->glyphs_changed_signal =
+		g_signal_new("glyphs-changed",
+			G_OBJECT_CLASS_TYPE(klass),
+			G_SIGNAL_RUN_LAST,
+			0,
+			NULL,
+			NULL,
+			_vga_term_marshal_VOID__UINT_UINT,
+			G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_UINT);
 }
 
 static void vga_font_init(VGAFont *font)
@@ -76,6 +108,8 @@ static void vga_font_init(VGAFont *font)
 
 	font->pvt = pvt = VGA_FONT_GET_PRIVATE(font);
 	pvt->data = NULL;
+	pvt->shared = FALSE;
+	pvt->atlases = NULL;
 	font->width = -1;
 	font->height = -1;
 	font->bytes_per_glyph = -1;
@@ -111,10 +145,196 @@ static void vga_font_init(VGAFont *font)
  */
 GObject *vga_font_new(void)
 {
-fprintf(stderr, "NAC: vga_font_new(): enter\n");
 	return G_OBJECT(g_object_new(vga_font_get_type(), NULL));
 }
 
+/* FNV-1a hash of the font dimensions and glyph data */
+static guint
+vga_font_hash_data(const guchar *data, int width, int height)
+{
+	guint32 hash = 2166136261U;
+	int i, len;
+
+	len = VGA_FONT_GLYPH_BYTES(width, height) * 256;
+	hash = (hash ^ width) * 16777619U;
+	hash = (hash ^ height) * 16777619U;
+	for (i = 0; i < len; i++)
+		hash = (hash ^ data[i]) * 16777619U;
+
+	return hash;
+}
+
+/**
+ * vga_font_intern:
+ * @data: raw VGA font data for entire font
+ * @width: width, in pixels, of the font
+ * @height: height, in pixels, of the font
+ *
+ * Get the shared font object for the given font data, creating it if
+ * this is the first time it has been asked for.  Shared fonts can't be
+ * modified; use vga_font_dup() to get a private copy first.
+ *
+ * Returns: a new reference to the shared font.
+ */
+VGAFont *vga_font_intern(guchar *data, int width, int height)
+{
+	VGAFont *font;
+	GSList *list, *l;
+	guint hash;
+	int len;
+
+	g_return_val_if_fail(data != NULL, NULL);
+	g_return_val_if_fail(width > 0 && height > 0, NULL);
+
+	hash = vga_font_hash_data(data, width, height);
+	len = VGA_FONT_GLYPH_BYTES(width, height) * 256;
+
+	G_LOCK(font_registry);
+	if (font_registry == NULL)
+		font_registry = g_hash_table_new(g_direct_hash,
+						 g_direct_equal);
+
+	list = g_hash_table_lookup(font_registry, GUINT_TO_POINTER(hash));
+	for (l = list; l != NULL; l = l->next)
+	{
+		font = VGA_FONT(l->data);
+		if (font->width == width && font->height == height &&
+		    memcmp(font->pvt->data, data, len) == 0)
+		{
+			g_object_ref(font);
+			G_UNLOCK(font_registry);
+			return font;
+		}
+	}
+
+	font = VGA_FONT(vga_font_new());
+	vga_font_load(font, data, width, height);
+	font->pvt->shared = TRUE;
+	font->pvt->hash = hash;
+	g_hash_table_insert(font_registry, GUINT_TO_POINTER(hash),
+			    g_slist_prepend(list, font));
+	G_UNLOCK(font_registry);
+
+	/* One reference for the registry, one for the caller */
+	return g_object_ref(font);
+}
+
+/**
+ * vga_font_get_default:
+ *
+ * Get the shared default VGA font.  This is what new widgets use.
+ *
+ * Returns: a new reference to the shared default font.
+ */
+VGAFont *vga_font_get_default(void)
+{
+	return vga_font_intern(default_font, 8, 16);
+}
+
+/**
+ * vga_font_dup:
+ * @font: the VGA font object
+ *
+ * Make a private, modifiable copy of a font.
+ *
+ * Returns: the new font object.
+ */
+VGAFont *vga_font_dup(VGAFont *font)
+{
+	VGAFont *copy;
+
+	g_return_val_if_fail(VGA_IS_FONT(font), NULL);
+
+	copy = VGA_FONT(vga_font_new());
+	if (font->pvt->data != NULL)
+		vga_font_load(copy, font->pvt->data, font->width,
+			      font->height);
+
+	return copy;
+}
+
+/**
+ * vga_font_is_shared:
+ * @font: the VGA font object
+ *
+ * Returns: TRUE if @font came from vga_font_intern() and so must not
+ * be modified.
+ */
+gboolean vga_font_is_shared(VGAFont *font)
+{
+	g_return_val_if_fail(VGA_IS_FONT(font), FALSE);
+
+	return font->pvt->shared;
+}
+
+/**
+ * vga_font_get_atlas:
+ * @font: the VGA font object
+ * @scale: integer zoom factor
+ * @flags: VGA_ATLAS_* flags, e.g. for 9-dot mode
+ *
+ * Get the glyph atlas for the font at the given scale, building it the
+ * first time it is asked for.  The atlas belongs to the font and is
+ * shared by everything using the font.  It is kept up to date as the
+ * glyphs change, but is freed if the font is loaded with different
+ * dimensions, so don't hold on to it between renders.
+ *
+ * Returns: the atlas, or NULL if no font is loaded.
+ */
+VGAAtlas *vga_font_get_atlas(VGAFont *font, int scale, int flags)
+{
+	VGAAtlas *atlas;
+	GSList *l;
+
+	g_return_val_if_fail(VGA_IS_FONT(font), NULL);
+	g_return_val_if_fail(scale > 0, NULL);
+	if (font->pvt->data == NULL)
+		return NULL;
+
+	G_LOCK(font_atlas);
+	for (l = font->pvt->atlases; l != NULL; l = l->next)
+	{
+		atlas = l->data;
+		if (atlas->scale == scale && atlas->flags == flags)
+		{
+			G_UNLOCK(font_atlas);
+			return atlas;
+		}
+	}
+
+	/* The default font's plain atlas was already built at compile time */
+	if (scale == 1 && flags == 0 &&
+	    font->width == DEFAULT_ATLAS_FONT_WIDTH &&
+	    font->height == DEFAULT_ATLAS_FONT_HEIGHT &&
+	    memcmp(font->pvt->data, default_font, sizeof(default_font)) == 0)
+		atlas = vga_atlas_new_static(default_atlas_masks,
+					     font->width, font->height,
+					     scale, flags);
+	else
+		atlas = vga_atlas_new(font->pvt->data, font->width,
+				      font->height, scale, flags);
+	if (atlas != NULL)
+		font->pvt->atlases = g_slist_prepend(font->pvt->atlases,
+						     atlas);
+	G_UNLOCK(font_atlas);
+
+	return atlas;
+}
+
+/* Throw away all atlases, e.g. because the font dimensions changed */
+static void
+vga_font_free_atlases(VGAFont *font)
+{
+	GSList *l;
+
+	G_LOCK(font_atlas);
+	for (l = font->pvt->atlases; l != NULL; l = l->next)
+		vga_atlas_destroy(l->data);
+	g_slist_free(font->pvt->atlases);
+	font->pvt->atlases = NULL;
+	G_UNLOCK(font_atlas);
+}
+
 static void
 vga_font_dispose(GObject *gobject)
 {
@@ -143,6 +363,7 @@ vga_font_finalize(GObject *gobject)
 	VGAFont *font = VGA_FONT(gobject);
 
 	/* Finish up object destruction.  This will only be called once. */
+	vga_font_free_atlases(font);
 	if (font->pvt->data)
 		g_free(font->pvt->data);
 
@@ -160,17 +381,47 @@ vga_font_finalize(GObject *gobject)
  * Load the [partial] font into the font object.  A font must already be
  * loaded before calling this function (unless you know what you are doing).
  * The @data buffer must be large enough to account the character range
- * given.
+ * given.  @font must not be a shared font.
+ *
+ * Only glyphs whose data actually differs are re-expanded in the atlases,
+ * and "glyphs-changed" is emitted for the range that changed (if any).
  */
 gboolean vga_font_set_chars(VGAFont * font, guchar *data, guchar start_c,
 		       	guchar end_c)
 {
-	int bytes;
+	int c, first, last;
+	guchar *glyph;
+	GSList *l;
+
 	g_return_val_if_fail(data != NULL, FALSE);
 	g_return_val_if_fail(font->pvt->data != NULL, FALSE);
+	g_return_val_if_fail(!font->pvt->shared, FALSE);
 	g_assert(font->height > 0 && font->width > 0);
-	bytes = font->bytes_per_glyph * (end_c - start_c + 1);
-	memcpy(font->pvt->data + start_c, data, bytes);
+
+	first = -1;
+	last = -1;
+	glyph = font->pvt->data + start_c * font->bytes_per_glyph;
+	G_LOCK(font_atlas);
+	for (c = start_c; c <= end_c; c++)
+	{
+		if (memcmp(glyph, data, font->bytes_per_glyph) != 0)
+		{
+			memcpy(glyph, data, font->bytes_per_glyph);
+			for (l = font->pvt->atlases; l != NULL; l = l->next)
+				vga_atlas_update(l->data, font->pvt->data,
+						 c, c);
+			if (first < 0)
+				first = c;
+			last = c;
+		}
+		glyph += font->bytes_per_glyph;
+		data += font->bytes_per_glyph;
+	}
+	G_UNLOCK(font_atlas);
+
+	if (first >= 0)
+		g_signal_emit(font, VGA_FONT_GET_CLASS(font)->glyphs_changed_signal,
+			      0, (guint) first, (guint) last);
 
 	return TRUE;
 }
@@ -188,15 +439,27 @@ gboolean vga_font_set_chars(VGAFont * font, guchar *data, guchar start_c,
  */
 gboolean vga_font_load(VGAFont * font, guchar * data, int width, int height)
 {
+	g_return_val_if_fail(!font->pvt->shared, FALSE);
+
+	/* Same size: only the glyphs that differ need any work */
+	if (font->pvt->data != NULL &&
+	    width == font->width && height == font->height)
+		return vga_font_set_chars(font, data, 0, 255);
+
+	vga_font_free_atlases(font);
 	font->height = height;
 	font->width = width;
-	font->bytes_per_glyph = width * height / 8;
+	font->bytes_per_glyph = VGA_FONT_GLYPH_BYTES(width, height);
 	if (font->pvt->data)
 	{
 		g_free(font->pvt->data);
 	}
-	font->pvt->data = g_malloc(width * height * 32);
-	return vga_font_set_chars(font, data, 0, 255);
+	font->pvt->data = g_malloc(font->bytes_per_glyph * 256);
+	memcpy(font->pvt->data, data, font->bytes_per_glyph * 256);
+	g_signal_emit(font, VGA_FONT_GET_CLASS(font)->glyphs_changed_signal,
+		      0, 0U, 255U);
+
+	return TRUE;
 }
 
 /* Determine the dimensions of the characters given the font image length */
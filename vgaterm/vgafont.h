@@ -21,6 +21,7 @@
 #include <stdio.h>
 
 #include "def_font.h"
+#include "vgarender.h"
 #include <gtk/gtk.h>
 #include <string.h>
 
@@ -38,6 +39,9 @@ extern "C" {
 #define VGA_IS_FONT_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), VGA_TYPE_FONT))
 #define VGA_FONT_GET_CLASS(obj)	(G_TYPE_INSTANCE_GET_CLASS((obj), VGA_TYPE_FONT, VGAFontClass))
 
+/* Bytes of data per glyph; each row is padded out to whole bytes */
+#define VGA_FONT_GLYPH_BYTES(width, height)	(((width) + 7) / 8 * (height))
+
 typedef struct _VGAFont	VGAFont;
 typedef struct _VGAFontClass VGAFontClass;
 typedef struct _RenderedChar	RenderedChar;
@@ -49,7 +53,7 @@ struct _VGAFont
 
 	/* instance members */
 	int width, height;		/* Pixel sizes, usually 8x16 */
-	int bytes_per_glyph;		/* Normally width*height / 8 */
+	int bytes_per_glyph;		/* VGA_FONT_GLYPH_BYTES() */
 	cairo_font_face_t *face;
 
 	/* <private> */
@@ -61,12 +65,19 @@ struct _VGAFontClass
 	GObjectClass parent_class;
 
 	/* class members */
+	guint glyphs_changed_signal;
 };
 
 GType		vga_font_get_type	(void);
 
 /* Method definitions */
 GObject	*	vga_font_new		(void);
+VGAFont *	vga_font_intern		(guchar *data, int width, int height);
+VGAFont *	vga_font_get_default	(void);
+VGAFont *	vga_font_dup		(VGAFont *font);
+gboolean	vga_font_is_shared	(VGAFont *font);
+VGAAtlas *	vga_font_get_atlas	(VGAFont *font, int scale,
+					 int flags);
 gboolean	vga_font_set_chars	(VGAFont *font, guchar *data,
 						guchar start_c, guchar end_c);
 gboolean	vga_font_load		(VGAFont *font, guchar *data,
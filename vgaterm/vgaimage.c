@@ -0,0 +1,766 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vgaimage.h"
+#include "vgaemu.h"
+#include "vgarender.h"
+#include "def_font.h"
+#include "def_palette_rgb.h"
+
+#define IMAGE_FONT_HEIGHT	16
+#define IMAGE_READ_CHUNK	(64 * 1024)
+
+#define IMAGE_CLEAR_ATTR(attr)	((attr) & 0x70)
+
+struct _VGAImage {
+	int cols;
+	int base_rows;		/* Screen height, or starting canvas height */
+	int rows;		/* Current height */
+	int alloc_rows;
+	int flags;		/* VGA_IMAGE_* */
+	unsigned char *cells;	/* Character and attribute for each cell */
+	int x, y;		/* Cursor, 0 based */
+	unsigned char attr;
+	unsigned char last;	/* Last character written */
+	int eof;		/* Seen ^Z, with VGA_IMAGE_STOP_AT_EOF */
+	int icecolor;
+
+	VGAEmu emu;		/* Drives the screen through image_ops */
+	VGAEmuPalette pal;
+	unsigned char font[256 * IMAGE_FONT_HEIGHT];
+	int font_changed;	/* Since the atlas was built */
+	VGAAtlas *atlas;
+
+	VGAImageLineFunc line_func;
+	void *line_data;
+};
+
+/* Text color to palette register, as in vgapalette.c */
+static const int pal_map[16] = {
+	0, 1, 2, 3, 4, 5, 20, 7, 56, 57, 58, 59, 60, 61, 62, 63
+};
+
+static unsigned char *image_cell(VGAImage *img, int x, int y)
+{
+	return img->cells + (y * img->cols + x) * 2;
+}
+
+/* Clear @count cells from @x,@y on, wrapping onto the following rows */
+static void image_clear(VGAImage *img, unsigned char attr, int x, int y,
+			int count)
+{
+	unsigned char *cell = image_cell(img, x, y);
+
+	while (count-- > 0)
+	{
+		*cell++ = 0;
+		*cell++ = attr;
+	}
+}
+
+static void image_default_font(VGAImage *img)
+{
+	memcpy(img->font, default_font, sizeof(img->font));
+	img->font_changed = 1;
+}
+
+/* Make the canvas at least @rows tall; 0 if it can't be */
+static int image_grow(VGAImage *img, int rows)
+{
+	unsigned char *cells;
+	int n;
+
+	if (rows <= img->rows)
+		return 1;
+	if (rows > VGA_IMAGE_MAX_ROWS)
+		return 0;
+
+	if (rows > img->alloc_rows)
+	{
+		n = img->alloc_rows * 2;
+		if (n < rows)
+			n = rows;
+		if (n > VGA_IMAGE_MAX_ROWS)
+			n = VGA_IMAGE_MAX_ROWS;
+		cells = realloc(img->cells, n * img->cols * 2);
+		if (cells == NULL)
+			return 0;
+		img->cells = cells;
+		img->alloc_rows = n;
+	}
+
+	/* New canvas rows start out zeroed, like the widget's */
+	image_clear(img, 0, 0, img->rows, (rows - img->rows) * img->cols);
+	img->rows = rows;
+
+	return 1;
+}
+
+/* 1 based, clamped to the screen like vga_term_gotoxy() */
+static void image_gotoxy(VGAImage *img, int x, int y)
+{
+	int max_y;
+
+	max_y = img->flags & VGA_IMAGE_CANVAS ? VGA_IMAGE_MAX_ROWS : img->rows;
+	x = x < 1 ? 1 : (x > img->cols ? img->cols : x);
+	y = y < 1 ? 1 : (y > max_y ? max_y : y);
+	if (!image_grow(img, y))
+		y = img->rows;
+
+	img->x = x - 1;
+	img->y = y - 1;
+}
+
+/*
+ * Move the rows from @top down up by @n, or down if @n is negative,
+ * clearing the rows left behind, as vga_term_scroll_up() and
+ * vga_term_scroll_down() do.
+ */
+static void image_scroll(VGAImage *img, int top, int n)
+{
+	int rows = img->rows - top;
+
+	if (n > rows)
+		n = rows;
+	if (n < -rows)
+		n = -rows;
+
+	if (n > 0)
+	{
+		memmove(image_cell(img, 0, top), image_cell(img, 0, top + n),
+			(rows - n) * img->cols * 2);
+		image_clear(img, IMAGE_CLEAR_ATTR(img->attr), 0,
+			    img->rows - n, n * img->cols);
+	}
+	else if (n < 0)
+	{
+		n = -n;
+		memmove(image_cell(img, 0, top + n), image_cell(img, 0, top),
+			(rows - n) * img->cols * 2);
+		image_clear(img, IMAGE_CLEAR_ATTR(img->attr), 0, top,
+			    n * img->cols);
+	}
+}
+
+/* Rows with nothing ever written on them are all character 0 */
+static int image_row_empty(VGAImage *img, int y)
+{
+	unsigned char *cell = image_cell(img, 0, y);
+	int x;
+
+	for (x = 0; x < img->cols; x++, cell += 2)
+		if (cell[0] != 0)
+			return 0;
+	return 1;
+}
+
+static void image_clrscr(VGAImage *img)
+{
+	int y, n;
+
+	/* The screen goes to the line function, as to a terminal's scrollback */
+	if (img->line_func != NULL)
+	{
+		for (n = img->rows; n > 0 && image_row_empty(img, n - 1); n--)
+			;
+		for (y = 0; y < n; y++)
+			img->line_func(img->line_data, image_cell(img, 0, y),
+				       img->cols);
+	}
+
+	/* A canvas starts over */
+	if (img->flags & VGA_IMAGE_CANVAS)
+		img->rows = img->base_rows;
+	image_clear(img, IMAGE_CLEAR_ATTR(img->attr), 0, 0,
+		    img->rows * img->cols);
+	img->x = 0;
+	img->y = 0;
+}
+
+static void image_clreol(VGAImage *img)
+{
+	image_clear(img, IMAGE_CLEAR_ATTR(img->attr), img->x, img->y,
+		    img->cols - img->x);
+}
+
+/* As vga_term_writec() */
+static void image_writec(VGAImage *img, unsigned char c)
+{
+	unsigned char *cell;
+	int x = img->x, y = img->y;
+
+	switch (c)
+	{
+		case 10:
+			/* A bare LF is a CR+LF */
+			y++;
+			if (img->last != 13)
+				x = 0;
+			break;
+		case 13:
+			x = 0;
+			break;
+		case 7:
+			break;
+		case 8:
+			if (x > 0)
+				x--;
+			break;
+		default:
+			cell = image_cell(img, x, y);
+			cell[0] = c;
+			cell[1] = img->attr;
+			if (x + 1 == img->cols)
+			{
+				x = 0;
+				y++;
+			}
+			else
+				x++;
+	}
+	img->last = c;
+
+	/* Off the bottom: a canvas grows, a screen scrolls */
+	if (y >= img->rows &&
+	    !((img->flags & VGA_IMAGE_CANVAS) && image_grow(img, y + 1)))
+	{
+		if (img->line_func != NULL)
+			img->line_func(img->line_data, img->cells, img->cols);
+		image_scroll(img, 0, 1);
+		x = 0;
+		y = img->rows - 1;
+	}
+
+	img->x = x;
+	img->y = y;
+}
+
+/* Clear the lines from the top or down to the bottom, as vga_term_clrup() */
+static void image_clear_lines(VGAImage *img, int area)
+{
+	if (area == VGA_EMU_CLEAR_DOWN)
+		image_clear(img, 0, 0, img->y, (img->rows - img->y) * img->cols);
+	else
+		image_clear(img, 0, 0, 0, (img->y + 1) * img->cols);
+}
+
+/* The screen side of the emulation, see VGAScreenOps */
+
+static void image_op_writec(void *screen, unsigned char c)
+{
+	image_writec(screen, c);
+}
+
+static void image_op_gotoxy(void *screen, int x, int y)
+{
+	image_gotoxy(screen, x, y);
+}
+
+static void image_op_wherexy(void *screen, int *x, int *y)
+{
+	VGAImage *img = screen;
+
+	*x = img->x + 1;
+	*y = img->y + 1;
+}
+
+static void image_op_size(void *screen, int *cols, int *rows)
+{
+	VGAImage *img = screen;
+
+	*cols = img->cols;
+	*rows = img->rows;
+}
+
+static void image_op_scroll(void *screen, int y, int n)
+{
+	image_scroll(screen, y - 1, n);
+}
+
+static void image_op_clear(void *screen, int area)
+{
+	VGAImage *img = screen;
+
+	switch (area)
+	{
+		case VGA_EMU_CLEAR_SCREEN:
+			image_clrscr(img);
+			break;
+		case VGA_EMU_CLEAR_EOL:
+			image_clreol(img);
+			break;
+		default:
+			image_clear_lines(img, area);
+	}
+}
+
+static unsigned char image_op_get_attr(void *screen)
+{
+	return ((VGAImage *) screen)->attr;
+}
+
+static void image_op_set_attr(void *screen, unsigned char attr)
+{
+	((VGAImage *) screen)->attr = attr;
+}
+
+static void image_op_icecolor(void *screen, int on)
+{
+	((VGAImage *) screen)->icecolor = on;
+}
+
+static void image_op_font(void *screen, const unsigned char *glyphs,
+			  int first, int count)
+{
+	VGAImage *img = screen;
+
+	if (glyphs == NULL)
+	{
+		image_default_font(img);
+		return;
+	}
+	memcpy(img->font + first * IMAGE_FONT_HEIGHT, glyphs,
+	       count * IMAGE_FONT_HEIGHT);
+	img->font_changed = 1;
+}
+
+static void image_op_get_palette(void *screen, VGAEmuPalette pal)
+{
+	memcpy(pal, ((VGAImage *) screen)->pal, sizeof(VGAEmuPalette));
+}
+
+static void image_op_set_palette(void *screen, const VGAEmuPalette pal)
+{
+	memcpy(((VGAImage *) screen)->pal, pal, sizeof(VGAEmuPalette));
+}
+
+/* No windows, and no cursor to show */
+static const VGAScreenOps image_ops = {
+	image_op_writec,
+	image_op_gotoxy,
+	image_op_wherexy,
+	image_op_size,
+	image_op_scroll,
+	image_op_clear,
+	image_op_get_attr,
+	image_op_set_attr,
+	NULL,
+	NULL,
+	image_op_icecolor,
+	image_op_font,
+	image_op_get_palette,
+	image_op_set_palette
+};
+
+/*
+ * Create a headless screen of @cols x @rows, with VGA_IMAGE_* @flags.
+ * With VGA_IMAGE_CANVAS, @rows is only where the canvas starts.
+ */
+VGAImage * vga_image_new(int cols, int rows, int flags)
+{
+	VGAImage *img;
+
+	if (cols < 1 || cols > VGA_IMAGE_MAX_COLS || rows < 1 ||
+	    rows > VGA_IMAGE_MAX_ROWS)
+		return NULL;
+
+	img = calloc(1, sizeof(VGAImage));
+	if (img == NULL)
+		return NULL;
+	img->cols = cols;
+	img->base_rows = rows;
+	img->alloc_rows = rows;
+	img->flags = flags;
+	img->cells = malloc(cols * rows * 2);
+	if (img->cells == NULL)
+	{
+		free(img);
+		return NULL;
+	}
+	vga_image_reset(img);
+
+	return img;
+}
+
+void vga_image_destroy(VGAImage *img)
+{
+	if (img->atlas != NULL)
+		vga_atlas_destroy(img->atlas);
+	free(img->cells);
+	free(img);
+}
+
+/* Back to a blank screen in the default state, for the next file */
+void vga_image_reset(VGAImage *img)
+{
+	img->rows = img->base_rows;
+	image_clear(img, 0, 0, 0, img->rows * img->cols);
+	img->x = 0;
+	img->y = 0;
+	img->attr = 0x07;
+	img->last = 0;
+	img->eof = 0;
+	img->icecolor = !(img->flags & VGA_IMAGE_NO_ICECOLOR);
+
+	vga_emu_init(&img->emu, &image_ops, img);
+	memcpy(img->pal, default_palette_rgb, sizeof(img->pal));
+	if (memcmp(img->font, default_font, sizeof(img->font)) != 0)
+		image_default_font(img);
+}
+
+/* Feed output through the emulation */
+void vga_image_write(VGAImage *img, const unsigned char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && !img->eof; i++)
+	{
+		if (s[i] == 26 && (img->flags & VGA_IMAGE_STOP_AT_EOF))
+			img->eof = 1;
+		else
+			vga_emu_writec(&img->emu, s[i]);
+	}
+}
+
+/* Feed a whole file through the emulation; 0 if it couldn't be read */
+int vga_image_write_file(VGAImage *img, const char *fname)
+{
+	unsigned char *buf;
+	size_t n;
+	FILE *f;
+	int ok;
+
+	f = fopen(fname, "rb");
+	if (f == NULL)
+		return 0;
+	buf = malloc(IMAGE_READ_CHUNK);
+	if (buf == NULL)
+	{
+		fclose(f);
+		return 0;
+	}
+
+	while (!img->eof && (n = fread(buf, 1, IMAGE_READ_CHUNK, f)) > 0)
+		vga_image_write(img, buf, n);
+	ok = !ferror(f);
+
+	free(buf);
+	fclose(f);
+	return ok;
+}
+
+int vga_image_get_cols(VGAImage *img)
+{
+	return img->cols;
+}
+
+/* Current height; a canvas is as tall as it has been written to */
+int vga_image_get_rows(VGAImage *img)
+{
+	return img->rows;
+}
+
+/* Character and attribute of each cell, row after row */
+const unsigned char * vga_image_get_cells(VGAImage *img)
+{
+	return img->cells;
+}
+
+static uint32_t image_rgb(VGAImage *img, int color)
+{
+	const unsigned short *c = img->pal[pal_map[color]];
+
+	return ((uint32_t) (c[0] >> 8) << 16) | ((c[1] >> 8) << 8) |
+		(c[2] >> 8);
+}
+
+/* The 16 text colors as 0xRRGGBB, as TextFX has left them */
+void vga_image_get_palette(VGAImage *img, uint32_t *rgb)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		rgb[i] = image_rgb(img, i);
+}
+
+/*
+ * Call @func with each line that leaves the screen: the top line when
+ * it scrolls off, and all of them, up to the last one written to, when
+ * the screen is cleared.  NULL stops it.
+ */
+void vga_image_set_line_func(VGAImage *img, VGAImageLineFunc func,
+			     void *data)
+{
+	img->line_func = func;
+	img->line_data = data;
+}
+
+/*
+ * Paint the screen into a new @width x @height image, one 0xRRGGBB
+ * pixel per uint32_t, @scale times the font size.  Blinking text is
+ * drawn in its "on" state.  Returns NULL if out of memory; free() it.
+ */
+uint32_t * vga_image_render(VGAImage *img, int scale, int *width,
+			    int *height)
+{
+	unsigned char *line;
+	unsigned char attr;
+	uint32_t *pixels, *dst;
+	int x, y, start, w, h, bg;
+
+	if (img->atlas == NULL || img->atlas->scale != scale ||
+	    img->font_changed)
+	{
+		if (img->atlas != NULL)
+			vga_atlas_destroy(img->atlas);
+		img->atlas = vga_atlas_new(img->font, 8, IMAGE_FONT_HEIGHT,
+				scale, img->flags & VGA_IMAGE_NINE_DOT ?
+					VGA_ATLAS_NINE_DOT : 0);
+		img->font_changed = 0;
+		if (img->atlas == NULL)
+			return NULL;
+	}
+
+	w = img->cols * img->atlas->width;
+	h = img->rows * img->atlas->height;
+	pixels = malloc(sizeof(uint32_t) * w * h);
+	if (pixels == NULL)
+		return NULL;
+
+	for (y = 0; y < img->rows; y++)
+	{
+		line = image_cell(img, 0, y);
+		dst = pixels + y * img->atlas->height * w;
+		for (x = 0; x < img->cols; x = start)
+		{
+			/* One attribute run at a time */
+			attr = line[x * 2 + 1];
+			for (start = x + 1; start < img->cols &&
+			     line[start * 2 + 1] == attr; start++)
+				;
+
+			bg = (attr >> 4) & 0x07;
+			if ((attr & 0x80) && img->icecolor)
+				bg |= 0x08;
+			vga_atlas_paint(img->atlas, dst + x * img->atlas->width,
+					w, line + x * 2, start - x,
+					image_rgb(img, attr & 0x0f),
+					image_rgb(img, bg));
+		}
+	}
+
+	*width = w;
+	*height = h;
+	return pixels;
+}
+
+typedef struct {
+	const char *const *files;
+	int scale;
+	VGAImageDoneFunc done;
+	void *data;
+	VGAImage **screens;	/* One per worker */
+	int *rendered;		/* Count per worker */
+} ImageBatch;
+
+static void image_batch_job(void *data, int job, int worker)
+{
+	ImageBatch *b = data;
+	VGAImage *img = b->screens[worker];
+	uint32_t *pixels = NULL;
+	int width = 0, height = 0;
+
+	vga_image_reset(img);
+	if (vga_image_write_file(img, b->files[job]))
+		pixels = vga_image_render(img, b->scale, &width, &height);
+	if (pixels != NULL)
+		b->rendered[worker]++;
+
+	b->done(b->data, job, b->files[job], pixels, width, height);
+	free(pixels);
+}
+
+/*
+ * Render each of @files on a headless screen (see vga_image_new()),
+ * spread over @pool with one screen per worker, and hand the images to
+ * @done as they're finished.
+ *
+ * Returns: how many files were rendered, or -1 if out of memory
+ */
+int vga_image_render_files(WorkPool *pool, const char *const *files,
+			   int n_files, int cols, int rows, int flags,
+			   int scale, VGAImageDoneFunc done, void *data)
+{
+	ImageBatch b;
+	int i, n_screens, total = -1;
+
+	n_screens = pool->n_threads + 1;
+	b.files = files;
+	b.scale = scale;
+	b.done = done;
+	b.data = data;
+	b.screens = calloc(n_screens, sizeof(VGAImage *));
+	b.rendered = calloc(n_screens, sizeof(int));
+	if (b.screens == NULL || b.rendered == NULL)
+		goto out;
+	for (i = 0; i < n_screens; i++)
+	{
+		b.screens[i] = vga_image_new(cols, rows, flags);
+		if (b.screens[i] == NULL)
+			goto out;
+	}
+
+	workpool_run(pool, n_files, image_batch_job, &b);
+	for (i = 0, total = 0; i < n_screens; i++)
+		total += b.rendered[i];
+
+out:
+	if (b.screens != NULL)
+		for (i = 0; i < n_screens; i++)
+			if (b.screens[i] != NULL)
+				vga_image_destroy(b.screens[i]);
+	free(b.screens);
+	free(b.rendered);
+	return total;
+}
+
+#ifdef UNIT_TEST
+/*
+ * Compile with:
+ *     gcc gen-atlas.c vgarender.c -o gen-atlas
+ *     ./gen-atlas palette > def_palette_rgb.h
+ *     gcc -c vgaemu.c vgarender.c workpool.c
+ *     gcc vgaimage.c vgaemu.o vgarender.o workpool.o -o vgaimage-test \
+ *         -DUNIT_TEST -lpthread
+ */
+#include <assert.h>
+#include <unistd.h>
+
+#define WRITE(img, s)	vga_image_write(img, (const unsigned char *) s, \
+					sizeof(s) - 1)
+#define CH(img, x, y)	(image_cell(img, x, y)[0])
+#define AT(img, x, y)	(image_cell(img, x, y)[1])
+
+#define TEST_FILES	24
+
+/* ANSI color number to VGA color */
+static const int ansi_colors[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+static int done_count[TEST_FILES];
+
+static void count_done(void *data, int job, const char *fname,
+		       const uint32_t *pixels, int width, int height)
+{
+	assert(fname != NULL && strstr(fname, "/tmp/vgaimage-") == fname);
+	assert(pixels != NULL && width == 80 * 8 && height == 25 * 16);
+	/* Each file starts with a space in its own background color */
+	assert(pixels[0] == image_rgb(data, ansi_colors[job % 7 + 1]));
+	__sync_fetch_and_add(&done_count[job], 1);
+}
+
+int main(void)
+{
+	char names[TEST_FILES][32];
+	const char *files[TEST_FILES];
+	VGAImage *img;
+	WorkPool *pool;
+	uint32_t *pixels;
+	FILE *f;
+	int i, w, h;
+
+	img = vga_image_new(80, 25, VGA_IMAGE_STOP_AT_EOF);
+	assert(img != NULL);
+
+	/* Positioning and colors */
+	WRITE(img, "\033[3;5H\033[1;31;44mX\033[0mY");
+	assert(CH(img, 4, 2) == 'X' && AT(img, 4, 2) == 0x1c);
+	assert(CH(img, 5, 2) == 'Y' && AT(img, 5, 2) == 0x07);
+	assert(img->x == 6 && img->y == 2);
+	WRITE(img, "\033[2A\033[10D");
+	assert(img->x == 0 && img->y == 0);
+
+	/* A bare LF is CR+LF, but not straight after a CR */
+	WRITE(img, "ab\ncd\r\n");
+	assert(CH(img, 0, 1) == 'c' && img->x == 0 && img->y == 2);
+
+	/* Wrapping and scrolling off the bottom */
+	WRITE(img, "\033[25;80HZ");
+	assert(CH(img, 79, 23) == 'Z' && img->y == 24 && img->x == 0);
+	assert(CH(img, 4, 1) == 'X');
+
+	/* Avatar attribute and TextFX repeat */
+	WRITE(img, "\026\001\x4e" "\033r#\003");
+	assert(CH(img, 2, 24) == '#' && AT(img, 2, 24) == 0x4e);
+
+	/* Everything after ^Z is ignored */
+	WRITE(img, "\032\033[1;1HQ");
+	assert(CH(img, 0, 0) != 'Q');
+
+	/* Render size and colors: bright white on blue */
+	vga_image_reset(img);
+	WRITE(img, "\033[1;37;44m\333");
+	pixels = vga_image_render(img, 1, &w, &h);
+	assert(pixels != NULL && w == 640 && h == 400);
+	assert(pixels[0] == 0xffffff && pixels[8] == 0x000000);
+	free(pixels);
+	pixels = vga_image_render(img, 2, &w, &h);
+	assert(w == 1280 && h == 800);
+	free(pixels);
+	vga_image_destroy(img);
+
+	/* Positions are kept in bytes, so no wider than the widget */
+	assert(vga_image_new(VGA_IMAGE_MAX_COLS + 1, 25, 0) == NULL);
+
+	/* A canvas grows instead of scrolling */
+	img = vga_image_new(80, 25, VGA_IMAGE_CANVAS);
+	for (i = 0; i < 100; i++)
+		WRITE(img, "line\r\n");
+	assert(vga_image_get_rows(img) == 101 && CH(img, 0, 99) == 'l');
+	WRITE(img, "\033[2J");
+	assert(vga_image_get_rows(img) == 25);
+	vga_image_destroy(img);
+
+	/* A batch over a pool */
+	img = vga_image_new(80, 25, 0);
+	for (i = 0; i < TEST_FILES; i++)
+	{
+		snprintf(names[i], sizeof(names[i]), "/tmp/vgaimage-%d.ans", i);
+		files[i] = names[i];
+		f = fopen(names[i], "wb");
+		assert(f != NULL);
+		fprintf(f, "\033[4%dm \033[0m\r\nfile %d\r\n", i % 7 + 1, i);
+		fclose(f);
+	}
+	pool = workpool_new(3);
+	assert(vga_image_render_files(pool, files, TEST_FILES, 80, 25, 0, 1,
+				      count_done, img) == TEST_FILES);
+	for (i = 0; i < TEST_FILES; i++)
+	{
+		assert(done_count[i] == 1);
+		unlink(names[i]);
+	}
+	workpool_destroy(pool);
+	vga_image_destroy(img);
+
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Headless text screen: the terminal's ANSI/Avatar/TextFX parser (see
+ *  vgaemu.h) driving a plain cell buffer instead of a widget, which
+ *  renders straight to a 32 bits per pixel image with the glyph atlas.
+ *  No GTK, no display and no shared state, so any number of screens can
+ *  run on different threads at once, e.g. to turn a pile of art files
+ *  into thumbnails (see vga_image_render_files()).
+ */
+
+#ifndef __VGA_IMAGE_H__
+#define __VGA_IMAGE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "workpool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* vga_image_new() flags */
+#define VGA_IMAGE_CANVAS	(1 << 0)	/* Grow down instead of
+						 * scrolling, for full
+						 * canvas images */
+#define VGA_IMAGE_STOP_AT_EOF	(1 << 1)	/* Ignore everything from
+						 * a ^Z on, e.g. SAUCE */
+#define VGA_IMAGE_NINE_DOT	(1 << 2)	/* 9 pixel wide cells */
+#define VGA_IMAGE_NO_ICECOLOR	(1 << 3)	/* Blink bit is blink, and
+						 * is drawn as not blinking */
+
+#define VGA_IMAGE_MAX_COLS	255		/* As VGA_MAX_COLS */
+#define VGA_IMAGE_MAX_ROWS	4096		/* Canvas height limit */
+
+typedef struct _VGAImage VGAImage;
+
+/*
+ * Called by vga_image_render_files() as each file is done, from the
+ * worker thread that did it.  @pixels is NULL if the file couldn't be
+ * read or rendered, and is only valid during the call.
+ */
+typedef void (*VGAImageDoneFunc) (void *data, int job, const char *fname,
+				  const uint32_t *pixels, int width,
+				  int height);
+
+/* See vga_image_set_line_func(); @cells is only valid during the call */
+typedef void (*VGAImageLineFunc) (void *data, const unsigned char *cells,
+				  int cols);
+
+VGAImage *	vga_image_new		(int cols, int rows, int flags);
+void		vga_image_destroy	(VGAImage *img);
+void		vga_image_reset		(VGAImage *img);
+void		vga_image_write		(VGAImage *img,
+					 const unsigned char *s, size_t len);
+int		vga_image_write_file	(VGAImage *img, const char *fname);
+int		vga_image_get_cols	(VGAImage *img);
+int		vga_image_get_rows	(VGAImage *img);
+const unsigned char *
+		vga_image_get_cells	(VGAImage *img);
+void		vga_image_get_palette	(VGAImage *img, uint32_t *rgb);
+void		vga_image_set_line_func	(VGAImage *img, VGAImageLineFunc func,
+					 void *data);
+uint32_t *	vga_image_render	(VGAImage *img, int scale,
+					 int *width, int *height);
+int		vga_image_render_files	(WorkPool *pool,
+					 const char *const *files,
+					 int n_files, int cols, int rows,
+					 int flags, int scale,
+					 VGAImageDoneFunc done, void *data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __VGA_IMAGE_H__ */
@@ -17,7 +17,7 @@
  */
 
 #include "vgapalette.h"
-#include "def_palette.h"
+#include "def_palette_rgb.h"
 
 
 
@@ -31,8 +31,13 @@ static void vga_palette_finalize	(GObject *gobject);
 /* Private data */
 struct _VGAPalettePrivate {
 	GdkColor color[PAL_REGS];
+	guint version;		/* See vga_palette_get_version() */
 };
 
+/* Source of palette versions, shared so no two palettes ever match */
+static guint palette_serial;
+#define vga_palette_changed(pal)	((pal)->pvt->version = ++palette_serial)
+
 G_DEFINE_TYPE(VGAPalette, vga_palette, G_TYPE_OBJECT)
 
 static void vga_palette_class_init(VGAPaletteClass *klass)
@@ -50,6 +55,7 @@ static void vga_palette_init(VGAPalette *pal)
 	VGAPalettePrivate *pvt;
 
 	pal->pvt = pvt = VGA_PALETTE_GET_PRIVATE(pal);
+	vga_palette_changed(pal);
 }
 
 
@@ -193,6 +199,7 @@ VGAPalette * vga_palette_copy_from(VGAPalette * pal, VGAPalette * srcpal)
 {
 	memcpy(pal->pvt->color, srcpal->pvt->color,
 			PAL_REGS * sizeof(GdkColor));
+	vga_palette_changed(pal);
 	return pal;
 }
 
@@ -233,6 +240,7 @@ gboolean vga_palette_load(VGAPalette * pal, guchar * data, int size)
 		pal->pvt->color[n].green = TO_GDK_RGB(*((guchar *) (data + i + 1)));
 		pal->pvt->color[n++].blue = TO_GDK_RGB(*((guchar *) (data + i + 2)));
 	}
+	vga_palette_changed(pal);
 
 	return TRUE;
 }
@@ -298,6 +306,7 @@ void vga_palette_set_reg(VGAPalette * pal, guchar reg, guchar r, guchar g,
 	pal->pvt->color[reg].red = TO_GDK_RGB(r);
 	pal->pvt->color[reg].green = TO_GDK_RGB(g);
 	pal->pvt->color[reg].blue = TO_GDK_RGB(b); 
+	vga_palette_changed(pal);
 }
 
 GdkColor *vga_palette_get_reg(VGAPalette *pal, guchar reg)
@@ -305,6 +314,48 @@ GdkColor *vga_palette_get_reg(VGAPalette *pal, guchar reg)
 	return &pal->pvt->color[reg];
 }
 
+/**
+ * vga_palette_get_regs16:
+ * @pal: the VGA Palette object
+ * @rgb: Returns PAL_REGS * 3 values
+ *
+ * Get every register exactly as held, as 16 bit red, green and blue
+ * values, e.g. for saving the palette to be restored later with
+ * vga_palette_set_regs16().
+ */
+void vga_palette_get_regs16(VGAPalette *pal, guint16 *rgb)
+{
+	int i;
+
+	for (i = 0; i < PAL_REGS; i++)
+	{
+		*rgb++ = pal->pvt->color[i].red;
+		*rgb++ = pal->pvt->color[i].green;
+		*rgb++ = pal->pvt->color[i].blue;
+	}
+}
+
+/**
+ * vga_palette_set_regs16:
+ * @pal: the VGA Palette object
+ * @rgb: PAL_REGS * 3 values, as from vga_palette_get_regs16()
+ *
+ * Set every register from 16 bit red, green and blue values.
+ */
+void vga_palette_set_regs16(VGAPalette *pal, const guint16 *rgb)
+{
+	int i;
+
+	for (i = 0; i < PAL_REGS; i++)
+	{
+		pal->pvt->color[i].pixel = -1;
+		pal->pvt->color[i].red = *rgb++;
+		pal->pvt->color[i].green = *rgb++;
+		pal->pvt->color[i].blue = *rgb++;
+	}
+	vga_palette_changed(pal);
+}
+
 /*
  * Standard EGA palette index -> palette register # mapping 
  * Map the standard 0..15 color attributes to their proper 0..63 register
@@ -324,8 +375,17 @@ GdkColor *vga_palette_get_color(VGAPalette *pal, guchar pal_index)
  */
 void vga_palette_load_default(VGAPalette * pal)
 {
-	/* FIXME: Hardcoded default palette size */
-	vga_palette_load(pal, default_palette, 192);
+	int i;
+
+	/* Converted from def_palette.h at build time */
+	for (i = 0; i < G_N_ELEMENTS(default_palette_rgb); i++)
+	{
+		pal->pvt->color[i].pixel = -1;
+		pal->pvt->color[i].red = default_palette_rgb[i][0];
+		pal->pvt->color[i].green = default_palette_rgb[i][1];
+		pal->pvt->color[i].blue = default_palette_rgb[i][2];
+	}
+	vga_palette_changed(pal);
 }
 
 
@@ -367,4 +427,19 @@ void vga_palette_morph_to_step(VGAPalette * pal, VGAPalette * srcpal)
 						srcpal->pvt->color[i].blue);
 
 	}
+	vga_palette_changed(pal);
+}
+
+/**
+ * vga_palette_get_version:
+ * @pal: the VGA palette object
+ *
+ * Get a number that changes whenever the colors of @pal are changed
+ * through the palette methods, and that no other palette ever has.
+ * Useful for caching things rendered with the palette.  Changes made
+ * through the pointer returned by vga_palette_get_reg() aren't seen.
+ */
+guint vga_palette_get_version(VGAPalette *pal)
+{
+	return pal->pvt->version;
 }
@@ -114,10 +114,15 @@ void		vga_palette_set_reg		(VGAPalette *pal, guchar reg,
 							guchar r, guchar g,
 							guchar b);
 GdkColor *	vga_palette_get_reg		(VGAPalette *pal, guchar reg);
+void		vga_palette_get_regs16		(VGAPalette *pal,
+							guint16 *rgb);
+void		vga_palette_set_regs16		(VGAPalette *pal,
+							const guint16 *rgb);
 GdkColor *	vga_palette_get_color		(VGAPalette *pal, guchar pal_index);
 void		vga_palette_load_default	(VGAPalette *pal);
 void		vga_palette_morph_to_step	(VGAPalette *pal,
 							VGAPalette * srcpal);
+guint		vga_palette_get_version		(VGAPalette *pal);
 
 #ifdef __cplusplus
 }
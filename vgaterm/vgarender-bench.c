@@ -0,0 +1,176 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Full frame paint benchmark for the glyph atlas at a range of grid
+ *  sizes and scales.  Each frame paints every cell in attribute runs of
+ *  8 cells, which is about what a busy ANSI screen looks like to the
+ *  renderer.  The cost per cell should stay flat as the grid grows.
+ *
+ *  Every frame is timed painted serially and spread over a work pool,
+ *  one row per job like vga_render_rows() does.
+ *
+ *  Compile with:
+ *     gcc -O2 vgarender-bench.c vgarender.c workpool.c -o vgarender-bench -lpthread
+ *  Usage: vgarender-bench [frames [threads]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "vgarender.h"
+#include "workpool.h"
+#include "def_font.h"
+
+#define RUN_LEN		8
+
+static const struct {
+	int cols, rows;
+} geometry[] = {
+	{ 80, 25 }, { 80, 50 }, { 132, 43 }, { 160, 64 }, { 200, 75 },
+	{ 255, 100 },
+};
+
+typedef struct {
+	VGAAtlas *atlas;
+	int cols, rows;
+	int stride;
+	uint32_t *img;
+	unsigned char *cells;
+} Frame;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void paint_row(void *data, int y, int worker)
+{
+	Frame *f = data;
+	uint32_t *line;
+	int x, i, n;
+
+	line = f->img + y * f->atlas->height * f->stride;
+	for (x = 0; x < f->cols; x += RUN_LEN)
+	{
+		n = f->cols - x < RUN_LEN ? f->cols - x : RUN_LEN;
+		i = y * f->cols + x;
+		vga_atlas_paint(f->atlas, line + x * f->atlas->width,
+				f->stride, f->cells + i * 2, n,
+				0xaaaaaa ^ f->cells[i * 2 + 1], 0x000000);
+	}
+}
+
+/* Average ns per frame, serially if @pool is NULL */
+static double time_frames(Frame *f, WorkPool *pool, int frames)
+{
+	double start;
+	int i, y;
+
+	start = now_ns();
+	for (i = 0; i < frames; i++)
+	{
+		if (pool != NULL)
+			workpool_run(pool, f->rows, paint_row, f);
+		else
+			for (y = 0; y < f->rows; y++)
+				paint_row(f, y, 0);
+	}
+
+	return (now_ns() - start) / frames;
+}
+
+static void bench(VGAAtlas *atlas, WorkPool *pool, int cols, int rows,
+		  int frames)
+{
+	Frame f;
+	double serial, parallel;
+	int i;
+
+	f.atlas = atlas;
+	f.cols = cols;
+	f.rows = rows;
+	f.stride = cols * atlas->width;
+	f.img = malloc(sizeof(uint32_t) * f.stride * rows * atlas->height);
+	f.cells = malloc(cols * rows * 2);
+	if (f.img == NULL || f.cells == NULL)
+	{
+		fprintf(stderr, "vgarender-bench: out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < cols * rows; i++)
+	{
+		f.cells[i * 2] = 0x20 + (i * 7) % 0xe0;
+		f.cells[i * 2 + 1] = (i / RUN_LEN) % 0x7f + 1;
+	}
+
+	serial = time_frames(&f, NULL, frames);
+	parallel = time_frames(&f, pool, frames);
+
+	printf("%4dx%-4d x%d %6d cells %9.1f us %7.2f ns/cell | "
+	       "%9.1f us %7.2f ns/cell %5.2fx\n",
+	       cols, rows, atlas->scale, cols * rows,
+	       serial / 1000, serial / (cols * rows),
+	       parallel / 1000, parallel / (cols * rows),
+	       serial / parallel);
+
+	free(f.img);
+	free(f.cells);
+}
+
+int main(int argc, char *argv[])
+{
+	VGAAtlas *atlas;
+	WorkPool *pool;
+	int frames, threads, scale, i;
+
+	frames = argc > 1 ? atoi(argv[1]) : 200;
+	if (frames < 1)
+		frames = 1;
+	threads = argc > 2 ? atoi(argv[2]) : workpool_default_threads();
+
+	pool = workpool_new(threads);
+	if (pool == NULL)
+	{
+		fprintf(stderr, "vgarender-bench: out of memory\n");
+		return 1;
+	}
+	printf("%-21s %-30s | %d+1 threads\n", "", "serial",
+	       pool->n_threads);
+
+	for (scale = 1; scale <= 2; scale++)
+	{
+		atlas = vga_atlas_new(default_font, 8, 16, scale, 0);
+		if (atlas == NULL)
+		{
+			fprintf(stderr, "vgarender-bench: out of memory\n");
+			return 1;
+		}
+
+		for (i = 0; i < sizeof(geometry) / sizeof(geometry[0]); i++)
+			bench(atlas, pool, geometry[i].cols, geometry[i].rows,
+			      frames);
+
+		vga_atlas_destroy(atlas);
+	}
+
+	workpool_destroy(pool);
+
+	return 0;
+}
@@ -0,0 +1,447 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include "vgarender.h"
+
+#define VGA_LINE_GRAPHICS_FIRST	0xc0
+#define VGA_LINE_GRAPHICS_LAST	0xdf
+
+/*
+ * Expand glyphs @first..@last of the raw VGA font data into the atlas.
+ * Each glyph row is (font_width + 7) / 8 bytes with the leftmost pixel
+ * in the high bit, same as the VGA hardware uses.  The 9th column of
+ * 9-dot atlases is worked out here too, so painting never has to.
+ */
+static void
+vga_atlas_expand(VGAAtlas *atlas, const unsigned char *font_data,
+		 int first, int last)
+{
+	int g, fx, fy, sx, sy;
+	int row_bytes, glyph_bytes, cols, extend;
+	const unsigned char *row;
+	uint32_t mask, *m;
+
+	row_bytes = (atlas->font_width + 7) / 8;
+	glyph_bytes = row_bytes * atlas->font_height;
+	cols = atlas->width / atlas->scale;
+	mask = 0;
+
+	for (g = first; g <= last; g++)
+	{
+		extend = (g >= VGA_LINE_GRAPHICS_FIRST &&
+			  g <= VGA_LINE_GRAPHICS_LAST);
+		m = atlas->masks + g * atlas->glyph_size;
+		for (fy = 0; fy < atlas->font_height; fy++)
+		{
+			row = font_data + g * glyph_bytes + fy * row_bytes;
+			for (sy = 0; sy < atlas->scale; sy++)
+			{
+				for (fx = 0; fx < cols; fx++)
+				{
+					if (fx < atlas->font_width)
+						mask = (row[fx / 8] &
+							(0x80 >> (fx % 8))) ?
+							0xffffffff : 0;
+					else if (!extend)
+						mask = 0;
+					/* else repeat the last column */
+					for (sx = 0; sx < atlas->scale; sx++)
+						*m++ = mask;
+				}
+			}
+		}
+	}
+}
+
+/* Works for any glyph size */
+static void
+vga_atlas_paint_generic(const VGAAtlas *atlas, uint32_t *dst, int stride,
+			const unsigned char *cells, int count,
+			uint32_t fg, uint32_t bg)
+{
+	int i, x, y;
+	const uint32_t *m;
+	uint32_t *d;
+	uint32_t diff = fg ^ bg;
+
+	for (i = 0; i < count; i++)
+	{
+		m = atlas->masks + cells[i * 2] * atlas->glyph_size;
+		d = dst + i * atlas->width;
+		for (y = 0; y < atlas->height; y++)
+		{
+			for (x = 0; x < atlas->width; x++)
+				d[x] = bg ^ (m[x] & diff);
+			m += atlas->width;
+			d += stride;
+		}
+	}
+}
+
+/*
+ * Specialized painters for the cell sizes that make up nearly everything
+ * we display: 8x8, 8x14 and 8x16 fonts, unscaled, in 8 or 9-dot mode.
+ * The glyph size is known at compile time, so every row is written out
+ * in full and there are no loops other than the one over the cells.
+ */
+#define VGA_PAINT_PIXELS_8 \
+	d[0] = bg ^ (m[0] & diff); \
+	d[1] = bg ^ (m[1] & diff); \
+	d[2] = bg ^ (m[2] & diff); \
+	d[3] = bg ^ (m[3] & diff); \
+	d[4] = bg ^ (m[4] & diff); \
+	d[5] = bg ^ (m[5] & diff); \
+	d[6] = bg ^ (m[6] & diff); \
+	d[7] = bg ^ (m[7] & diff);
+
+#define VGA_PAINT_ROW_8 \
+	VGA_PAINT_PIXELS_8 \
+	m += 8; \
+	d += stride;
+
+#define VGA_PAINT_ROW_9 \
+	VGA_PAINT_PIXELS_8 \
+	d[8] = bg ^ (m[8] & diff); \
+	m += 9; \
+	d += stride;
+
+#define VGA_PAINT_ROW(w)	VGA_PAINT_ROW_##w
+#define VGA_PAINT_ROWS_2(w)	VGA_PAINT_ROW(w) VGA_PAINT_ROW(w)
+#define VGA_PAINT_ROWS_4(w)	VGA_PAINT_ROWS_2(w) VGA_PAINT_ROWS_2(w)
+#define VGA_PAINT_ROWS_8(w)	VGA_PAINT_ROWS_4(w) VGA_PAINT_ROWS_4(w)
+#define VGA_PAINT_ROWS_14(w)	VGA_PAINT_ROWS_8(w) VGA_PAINT_ROWS_4(w) \
+				VGA_PAINT_ROWS_2(w)
+#define VGA_PAINT_ROWS_16(w)	VGA_PAINT_ROWS_8(w) VGA_PAINT_ROWS_8(w)
+
+#define VGA_DEFINE_PAINT(w, h) \
+static void \
+vga_atlas_paint_##w##x##h(const VGAAtlas *atlas, uint32_t *dst, int stride, \
+			  const unsigned char *cells, int count, \
+			  uint32_t fg, uint32_t bg) \
+{ \
+	int i; \
+	const uint32_t *m; \
+	uint32_t *d; \
+	uint32_t diff = fg ^ bg; \
+ \
+	for (i = 0; i < count; i++) \
+	{ \
+		m = atlas->masks + cells[i * 2] * (w * h); \
+		d = dst + i * w; \
+		VGA_PAINT_ROWS_##h(w) \
+	} \
+}
+
+VGA_DEFINE_PAINT(8, 8)
+VGA_DEFINE_PAINT(8, 14)
+VGA_DEFINE_PAINT(8, 16)
+VGA_DEFINE_PAINT(9, 8)
+VGA_DEFINE_PAINT(9, 14)
+VGA_DEFINE_PAINT(9, 16)
+
+/* Pick the fastest painter that can handle the atlas' glyph size */
+static VGAAtlasPaintFunc
+vga_atlas_pick_paint(const VGAAtlas *atlas)
+{
+	if (atlas->width == 8)
+	{
+		switch (atlas->height)
+		{
+			case 8:
+				return vga_atlas_paint_8x8;
+			case 14:
+				return vga_atlas_paint_8x14;
+			case 16:
+				return vga_atlas_paint_8x16;
+		}
+	}
+	else if (atlas->width == 9)
+	{
+		switch (atlas->height)
+		{
+			case 8:
+				return vga_atlas_paint_9x8;
+			case 14:
+				return vga_atlas_paint_9x14;
+			case 16:
+				return vga_atlas_paint_9x16;
+		}
+	}
+
+	return vga_atlas_paint_generic;
+}
+
+/* Allocate an atlas and fill in its geometry, but not its masks */
+static VGAAtlas *
+vga_atlas_alloc(int font_width, int font_height, int scale, int flags)
+{
+	VGAAtlas *atlas;
+
+	atlas = malloc(sizeof(VGAAtlas));
+	if (atlas == NULL)
+		return NULL;
+
+	atlas->font_width = font_width;
+	atlas->font_height = font_height;
+	atlas->scale = scale;
+	atlas->flags = flags;
+	atlas->width = font_width * scale;
+	if (flags & VGA_ATLAS_NINE_DOT)
+		atlas->width += scale;
+	atlas->height = font_height * scale;
+	atlas->glyph_size = atlas->width * atlas->height;
+	atlas->paint = vga_atlas_pick_paint(atlas);
+	atlas->masks = NULL;
+	atlas->static_masks = 0;
+
+	return atlas;
+}
+
+/**
+ * vga_atlas_new:
+ * @font_data: raw VGA font data for all 256 glyphs
+ * @font_width: glyph width of the font in pixels
+ * @font_height: glyph height of the font in pixels
+ * @scale: integer zoom factor to build the atlas for
+ * @flags: VGA_ATLAS_* flags
+ *
+ * Returns: a new atlas, or NULL if out of memory.
+ */
+VGAAtlas * vga_atlas_new(const unsigned char *font_data,
+			 int font_width, int font_height, int scale, int flags)
+{
+	VGAAtlas *atlas;
+
+	atlas = vga_atlas_alloc(font_width, font_height, scale, flags);
+	if (atlas == NULL)
+		return NULL;
+
+	atlas->masks = malloc(sizeof(uint32_t) * atlas->glyph_size *
+			      VGA_ATLAS_GLYPHS);
+	if (atlas->masks == NULL)
+	{
+		free(atlas);
+		return NULL;
+	}
+
+	vga_atlas_expand(atlas, font_data, 0, VGA_ATLAS_GLYPHS - 1);
+
+	return atlas;
+}
+
+/**
+ * vga_atlas_new_static:
+ * @masks: already expanded glyph masks, laid out as vga_atlas_new()
+ * would have built them for the given parameters
+ * @font_width: glyph width of the font in pixels
+ * @font_height: glyph height of the font in pixels
+ * @scale: integer zoom factor @masks was built for
+ * @flags: VGA_ATLAS_* flags @masks was built with
+ *
+ * Wrap a prebuilt set of masks (e.g. generated at build time) in an
+ * atlas without copying them.  @masks must outlive the atlas.
+ *
+ * Returns: a new atlas, or NULL if out of memory.
+ */
+VGAAtlas * vga_atlas_new_static(const uint32_t *masks,
+				int font_width, int font_height,
+				int scale, int flags)
+{
+	VGAAtlas *atlas;
+
+	atlas = vga_atlas_alloc(font_width, font_height, scale, flags);
+	if (atlas == NULL)
+		return NULL;
+
+	atlas->masks = (uint32_t *) masks;
+	atlas->static_masks = 1;
+
+	return atlas;
+}
+
+void vga_atlas_destroy(VGAAtlas *atlas)
+{
+	if (atlas == NULL)
+		return;
+
+	if (!atlas->static_masks)
+		free(atlas->masks);
+	free(atlas);
+}
+
+/*
+ * Re-expand glyphs @first..@last after the font data they came from has
+ * changed.  @font_data is the whole font, not just the changed range.
+ */
+void vga_atlas_update(VGAAtlas *atlas, const unsigned char *font_data,
+		      int first, int last)
+{
+	if (first < 0)
+		first = 0;
+	if (last > VGA_ATLAS_GLYPHS - 1)
+		last = VGA_ATLAS_GLYPHS - 1;
+	if (first > last)
+		return;
+
+	/* Static masks are read-only; switch to a private copy first */
+	if (atlas->static_masks)
+	{
+		uint32_t *masks;
+
+		masks = malloc(sizeof(uint32_t) * atlas->glyph_size *
+			       VGA_ATLAS_GLYPHS);
+		if (masks == NULL)
+			return;
+		memcpy(masks, atlas->masks, sizeof(uint32_t) *
+		       atlas->glyph_size * VGA_ATLAS_GLYPHS);
+		atlas->masks = masks;
+		atlas->static_masks = 0;
+	}
+
+	vga_atlas_expand(atlas, font_data, first, last);
+}
+
+/**
+ * vga_atlas_paint:
+ * @atlas: glyph atlas
+ * @dst: top left pixel of the first cell in a 32 bits per pixel image
+ * @stride: image stride, in pixels
+ * @cells: @count character cells in video buffer (char, attr) format
+ * @count: number of cells
+ * @fg: foreground pixel value
+ * @bg: background pixel value
+ *
+ * Paint a row of cells that all share one text attribute.  The
+ * attribute byte of each cell is ignored; @fg and @bg are used instead.
+ */
+void vga_atlas_paint(const VGAAtlas *atlas, uint32_t *dst, int stride,
+		     const unsigned char *cells, int count,
+		     uint32_t fg, uint32_t bg)
+{
+	atlas->paint(atlas, dst, stride, cells, count, fg, bg);
+}
+
+#ifdef UNIT_TEST
+/* Compile with: gcc vgarender.c -o vgarender-test -DUNIT_TEST */
+#include <assert.h>
+#include "def_font.h"
+int main(void)
+{
+	VGAAtlas *atlas;
+	unsigned char cells[4] = { 'A', 0x07, 0xdb, 0x07 };
+	uint32_t img[16 * 16 * 2];
+	int x, y;
+
+	atlas = vga_atlas_new(default_font, 8, 16, 1, 0);
+	assert(atlas != NULL);
+	assert(atlas->width == 8 && atlas->height == 16);
+
+	vga_atlas_paint(atlas, img, 16, cells, 2, 0xffffff, 0x000000);
+	for (y = 0; y < 16; y++)
+	{
+		for (x = 0; x < 8; x++)
+		{
+			/* Glyph pixels come straight from the font data */
+			assert(img[y * 16 + x] ==
+			       ((default_font['A' * 16 + y] & (0x80 >> x)) ?
+				0xffffff : 0x000000));
+			assert(img[y * 16 + 8 + x] ==
+			       ((default_font[0xdb * 16 + y] & (0x80 >> x)) ?
+				0xffffff : 0x000000));
+		}
+	}
+	vga_atlas_destroy(atlas);
+
+	/* Scaled atlas: every font pixel becomes a 2x2 block */
+	atlas = vga_atlas_new(default_font, 8, 16, 2, 0);
+	assert(atlas->width == 16 && atlas->height == 32);
+	vga_atlas_paint(atlas, img, 16, cells, 1, 1, 0);
+	for (y = 0; y < 32; y++)
+		for (x = 0; x < 16; x++)
+			assert(img[y * 16 + x] ==
+			       ((default_font['A' * 16 + y / 2] &
+				 (0x80 >> (x / 2))) ? 1 : 0));
+	vga_atlas_destroy(atlas);
+
+	/* Specialized painters must match the generic one */
+	{
+		static unsigned char font[16 * 256];
+		unsigned char row[2 * 256];
+		static uint32_t a[9 * 256 * 16], b[9 * 256 * 16];
+		int heights[] = { 8, 14, 16 };
+		int h, i, w;
+
+		for (i = 0; i < (int) sizeof(font); i++)
+			font[i] = rand();
+		for (i = 0; i < 256; i++)
+		{
+			row[i * 2] = i;
+			row[i * 2 + 1] = 0x07;
+		}
+		for (h = 0; h < 6; h++)
+		{
+			w = (h < 3) ? 8 : 9;
+			atlas = vga_atlas_new(font, 8, heights[h % 3], 1,
+					      (w == 9) ? VGA_ATLAS_NINE_DOT : 0);
+			assert(atlas->width == w);
+			assert(atlas->paint != vga_atlas_paint_generic);
+			atlas->paint(atlas, a, w * 256, row, 256,
+				     0xaaaaaa, 0x555555);
+			vga_atlas_paint_generic(atlas, b, w * 256, row, 256,
+						0xaaaaaa, 0x555555);
+			assert(memcmp(a, b, sizeof(uint32_t) * w * 256 *
+				      heights[h % 3]) == 0);
+			vga_atlas_destroy(atlas);
+		}
+	}
+
+	/* A static atlas paints the same, and copies itself on update */
+	{
+		VGAAtlas *dyn, *stat;
+		static uint32_t a[16 * 8], b[16 * 8];
+
+		dyn = vga_atlas_new(default_font, 8, 16, 1, 0);
+		stat = vga_atlas_new_static(dyn->masks, 8, 16, 1, 0);
+		assert(stat->paint == dyn->paint);
+		vga_atlas_paint(dyn, a, 8, cells, 1, 7, 0);
+		vga_atlas_paint(stat, b, 8, cells, 1, 7, 0);
+		assert(memcmp(a, b, sizeof(a)) == 0);
+		vga_atlas_update(stat, default_font, 'A', 'A');
+		assert(stat->masks != dyn->masks && !stat->static_masks);
+		vga_atlas_destroy(stat);
+		vga_atlas_destroy(dyn);
+	}
+
+	/* 9-dot: column 9 repeats column 8 only for line graphics */
+	atlas = vga_atlas_new(default_font, 8, 16, 1, VGA_ATLAS_NINE_DOT);
+	cells[0] = 0xc4;	/* Horizontal line */
+	cells[2] = 'A';
+	vga_atlas_paint(atlas, img, 18, cells, 2, 1, 0);
+	for (y = 0; y < 16; y++)
+	{
+		assert(img[y * 18 + 8] == img[y * 18 + 7]);
+		assert(img[y * 18 + 9 + 8] == 0);
+	}
+	assert(img[7 * 18 + 8] == 1);
+	vga_atlas_destroy(atlas);
+
+	printf("All tests passed.\n");
+	return 0;
+}
+#endif
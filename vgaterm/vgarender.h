@@ -0,0 +1,88 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Software text rasterizer.  A glyph atlas holds every glyph of a VGA
+ *  font expanded to one 32-bit mask per pixel, so that painting a cell
+ *  into a 32 bits per pixel image is a masked copy with no per-pixel
+ *  branching.  Atlases never change once built (other than through
+ *  vga_atlas_update()), so one can be shared by any number of widgets.
+ */
+
+#ifndef __VGA_RENDER_H__
+#define __VGA_RENDER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define VGA_ATLAS_GLYPHS	256
+
+/*
+ * vga_atlas_new() flags.  VGA_ATLAS_NINE_DOT builds glyphs one pixel
+ * wider than the font, like VGA 9-dot text mode: the extra column is
+ * blank, except for the line drawing glyphs 0xC0-0xDF which repeat
+ * their last column so box drawing joins up.
+ */
+#define VGA_ATLAS_NINE_DOT	(1 << 0)
+
+typedef struct _VGAAtlas VGAAtlas;
+
+typedef void (*VGAAtlasPaintFunc) (const VGAAtlas *atlas, uint32_t *dst,
+				   int stride,
+				   const unsigned char *cells, int count,
+				   uint32_t fg, uint32_t bg);
+
+struct _VGAAtlas {
+	int font_width;		/* Glyph size in font pixels, e.g. 8x16 */
+	int font_height;
+	int scale;		/* Integer zoom factor */
+	int flags;		/* VGA_ATLAS_* */
+	int width;		/* Glyph size in image pixels, including the
+				 * 9th column if any, times scale */
+	int height;
+	int glyph_size;		/* width * height */
+	uint32_t *masks;	/* 0 or 0xffffffff for each pixel of each
+				 * glyph, VGA_ATLAS_GLYPHS * glyph_size */
+	int static_masks;	/* masks is not ours, e.g. it is const data
+				 * generated at build time */
+	VGAAtlasPaintFunc paint;	/* Picked for the glyph size when
+					 * the atlas is built */
+};
+
+VGAAtlas *	vga_atlas_new		(const unsigned char *font_data,
+					 int font_width, int font_height,
+					 int scale, int flags);
+VGAAtlas *	vga_atlas_new_static	(const uint32_t *masks,
+					 int font_width, int font_height,
+					 int scale, int flags);
+void		vga_atlas_destroy	(VGAAtlas *atlas);
+void		vga_atlas_update	(VGAAtlas *atlas,
+					 const unsigned char *font_data,
+					 int first, int last);
+void		vga_atlas_paint		(const VGAAtlas *atlas, uint32_t *dst,
+					 int stride,
+					 const unsigned char *cells, int count,
+					 uint32_t fg, uint32_t bg);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __VGA_RENDER_H__ */
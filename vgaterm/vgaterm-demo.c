@@ -1,6 +1,8 @@
 /*
  * Compile with:
- *     CFILES="vgaterm-demo.c vgaterm.c vgatext.c vgafont.c vgapalette.c emulation.c scrollbuf.c cbuf.c"
+ *     gcc gen-atlas.c vgarender.c -o gen-atlas
+ *     ./gen-atlas font > def_atlas.h; ./gen-atlas palette > def_palette_rgb.h
+ *     CFILES="vgaterm-demo.c vgaterm.c vgatext.c vgafont.c vgapalette.c vgarender.c rowcache.c workpool.c vgaemu.c emulation.c scrollbuf.c cbuf.c marshal.c"
  *     gcc $CFILES -o vgaterm-demo `pkg-config --cflags --libs gtk+-2.0 gthread-2.0`
  */
 
@@ -0,0 +1,258 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Render ANSI/Avatar/TextFX files to PNG images, without a display.
+ *  Files are spread over a work pool, each worker with its own headless
+ *  screen (see vgaimage.h), and written out as <outdir>/<name>.png, or
+ *  <outdir>/<name>.<index>.png if inputs from different directories
+ *  share a name.
+ *  With -e, each file is exported whole, including everything that
+ *  scrolled off, as <outdir>/<name>.html or .txt instead (see vgaexport.h).
+ *
+ *  Compile with:
+ *     gcc gen-atlas.c vgarender.c -o gen-atlas
+ *     ./gen-atlas palette > def_palette_rgb.h
+ *     gcc -O2 vgaterm-render.c vgaimage.c vgaexport.c vgarender.c workpool.c \
+ *         -o vgaterm-render \
+ *         `pkg-config --cflags --libs gdk-pixbuf-2.0 gthread-2.0` -lpthread
+ *  Usage: vgaterm-render [-o outdir] [-s scale] [-c cols] [-r rows]
+ *                        [-t threads] [-f] [-9] [-e html|text] file...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include "vgaimage.h"
+#include "vgaexport.h"
+
+typedef struct {
+	gchar **names;		/* Output file of each job */
+	int failed;
+} RenderOut;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: vgaterm-render [-o outdir] [-s scale] [-c cols] "
+		"[-r rows]\n"
+		"                      [-t threads] [-f] [-9] [-e html|text] "
+		"file...\n"
+		"  -f  Full canvas: the image grows down with the file "
+		"instead of scrolling\n"
+		"  -9  9 pixel wide cells\n"
+		"  -e  Export as HTML or UTF-8 text instead of PNG\n");
+	exit(1);
+}
+
+/* Save an image as PNG; FALSE on failure */
+static gboolean save_png(const char *fname, const uint32_t *pixels,
+			 int width, int height)
+{
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+	guchar *rgb, *p;
+	gboolean result;
+	size_t i, n;
+
+	n = (size_t) width * height;
+	rgb = malloc(n * 3);
+	if (rgb == NULL)
+		return FALSE;
+	for (i = 0, p = rgb; i < n; i++)
+	{
+		*p++ = pixels[i] >> 16;
+		*p++ = pixels[i] >> 8;
+		*p++ = pixels[i];
+	}
+
+	pixbuf = gdk_pixbuf_new_from_data(rgb, GDK_COLORSPACE_RGB, FALSE, 8,
+					  width, height, width * 3,
+					  NULL, NULL);
+	result = gdk_pixbuf_save(pixbuf, fname, "png", &error, NULL);
+	if (!result)
+	{
+		fprintf(stderr, "vgaterm-render: %s: %s\n", fname,
+			error->message);
+		g_error_free(error);
+	}
+	g_object_unref(pixbuf);
+	free(rgb);
+
+	return result;
+}
+
+static void file_done(void *data, int job, const char *fname,
+		      const uint32_t *pixels, int width, int height)
+{
+	RenderOut *out = data;
+
+	if (pixels == NULL)
+	{
+		fprintf(stderr, "vgaterm-render: %s: can't render\n", fname);
+		__sync_fetch_and_add(&out->failed, 1);
+		return;
+	}
+
+	if (!save_png(out->names[job], pixels, width, height))
+		__sync_fetch_and_add(&out->failed, 1);
+}
+
+/*
+ * Output file of each of @files, as <outdir>/<name><ext>.  Inputs from
+ * different directories can share a name, so those get the file's
+ * index as well, as <outdir>/<name>.<index><ext>, rather than
+ * overwriting each other.  Free with g_strfreev().
+ */
+static gchar **output_names(const char *outdir, char *const *files,
+			    int n_files, const char *ext)
+{
+	GHashTable *seen;
+	gchar **names, *base, *name;
+	int i;
+
+	/* How many inputs have each name */
+	seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; i < n_files; i++)
+	{
+		base = g_path_get_basename(files[i]);
+		g_hash_table_insert(seen, base, GINT_TO_POINTER(
+			GPOINTER_TO_INT(g_hash_table_lookup(seen, base)) + 1));
+	}
+
+	names = g_new0(gchar *, n_files + 1);
+	for (i = 0; i < n_files; i++)
+	{
+		base = g_path_get_basename(files[i]);
+		if (GPOINTER_TO_INT(g_hash_table_lookup(seen, base)) > 1)
+			name = g_strdup_printf("%s.%d%s", base, i, ext);
+		else
+			name = g_strconcat(base, ext, NULL);
+		names[i] = g_build_filename(outdir, name, NULL);
+		g_free(name);
+		g_free(base);
+	}
+	g_hash_table_destroy(seen);
+
+	return names;
+}
+
+int main(int argc, char *argv[])
+{
+	RenderOut out;
+	WorkPool *pool;
+	GTimer *timer;
+	const char *outdir = ".";
+	int cols = 80, rows = 25, scale = 1, threads = -1;
+	int flags = VGA_IMAGE_STOP_AT_EOF;
+	int format = -1;
+	int opt, n_files, n;
+
+	out.failed = 0;
+	while ((opt = getopt(argc, argv, "o:s:c:r:t:f9e:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+				outdir = optarg;
+				break;
+			case 's':
+				scale = atoi(optarg);
+				break;
+			case 'c':
+				cols = atoi(optarg);
+				break;
+			case 'r':
+				rows = atoi(optarg);
+				break;
+			case 't':
+				threads = atoi(optarg);
+				break;
+			case 'f':
+				flags |= VGA_IMAGE_CANVAS;
+				break;
+			case '9':
+				flags |= VGA_IMAGE_NINE_DOT;
+				break;
+			case 'e':
+				if (strcmp(optarg, "html") == 0)
+					format = VGA_EXPORT_HTML;
+				else if (strcmp(optarg, "text") == 0)
+					format = VGA_EXPORT_TEXT;
+				else
+					usage();
+				break;
+			default:
+				usage();
+		}
+	}
+	n_files = argc - optind;
+	if (n_files < 1 || scale < 1 || cols < 1 ||
+	    cols > VGA_IMAGE_MAX_COLS || rows < 1 ||
+	    rows > VGA_IMAGE_MAX_ROWS)
+		usage();
+
+	g_type_init();
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
+	/* Every file is a job of its own, so use every core */
+	if (threads < 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	pool = workpool_new(threads > 0 ? threads : 0);
+	if (pool == NULL)
+	{
+		fprintf(stderr, "vgaterm-render: out of memory\n");
+		return 1;
+	}
+
+	out.names = output_names(outdir, argv + optind, n_files,
+				 format < 0 ? ".png" :
+				 format == VGA_EXPORT_HTML ? ".html" : ".txt");
+
+	timer = g_timer_new();
+	if (format >= 0)
+	{
+		n = vga_export_files(pool, (const char *const *) argv + optind,
+				     (const char *const *) out.names, n_files,
+				     format, 0, cols, rows, flags);
+		if (n >= 0 && n < n_files)
+		{
+			fprintf(stderr, "vgaterm-render: %d files couldn't be "
+				"exported\n", n_files - n);
+			out.failed = n_files - n;
+		}
+	}
+	else
+		n = vga_image_render_files(pool,
+					   (const char *const *) argv + optind,
+					   n_files, cols, rows, flags, scale,
+					   file_done, &out);
+	if (n < 0)
+	{
+		fprintf(stderr, "vgaterm-render: out of memory\n");
+		return 1;
+	}
+	fprintf(stderr, "%d files in %.2f s, %d+1 threads\n", n_files,
+		g_timer_elapsed(timer, NULL), pool->n_threads);
+
+	g_timer_destroy(timer);
+	g_strfreev(out.names);
+	workpool_destroy(pool);
+
+	return out.failed > 0;
+}
@@ -45,10 +45,32 @@ vga_term_scroll				(GtkWidget *widget,
 					 GdkEventScroll *event);
 static void
 vga_term_emit_pending_signals		(VGATerm *term);
+static void
+vga_term_grid_resized			(VGAText *vga, int cols, int rows);
+static void
+vga_term_set_property			(GObject *object, guint prop_id,
+					 const GValue *value,
+					 GParamSpec *pspec);
+static void
+vga_term_get_property			(GObject *object, guint prop_id,
+					 GValue *value, GParamSpec *pspec);
+static void
+vga_term_map				(GtkWidget *widget);
+static void
+vga_term_viewed				(VGATerm *term);
+static void
+vga_term_enforce_budget			(VGATerm *spare);
+static void
+vga_term_clamp_scroll			(VGATerm *term);
 
 
 static void
 vga_term_scrollbuf_add_lines(VGATerm *term, int start_y, int count);
+static gboolean
+vga_term_spool_line(VGATerm *term);
+
+/* Lines the view moves per mouse wheel step in canvas mode */
+#define VGA_TERM_CANVAS_SCROLL_LINES	3
 
 /* Terminal private data */
 #define VGA_TERM_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), VGA_TYPE_TERM, VGATermPrivate))
@@ -58,13 +80,46 @@ struct _VGATermPrivate {
 	ScrollBuf *sbuf;
 	int scroll_line;	/* scroll line visible at top line, or 0
 				    for scrollback not shown */
+	VGASnapshot *scroll_snap;	/* The screen as it was when the
+					   scrollback was brought up */
 	GtkAdjustment *adjustment;
 	gboolean adjustment_changed_pending;
 	gboolean adjustment_value_changed_pending;
+	int grid_cols, grid_rows;	/* Grid size the window was last fit to */
+	int sbuf_bytes, sbuf_lines;	/* Scrollback size asked for; the
+					   budget may have trimmed sbuf */
+	guint64 viewed;			/* view_clock when last viewed */
+
+	/*
+	 * Inside a write batch, lines scrolled in at the bottom of a full
+	 * width window are kept here instead of scrolling the screen for
+	 * each one.  Anything that isn't plain writing on the bottom line
+	 * applies them first, as a single scroll of spool_lines lines.
+	 */
+	int batch;			/* vga_term_begin_batch() depth */
+	vga_charcell *spool;		/* spool_size cells */
+	int spool_size;
+	int spool_cols;			/* Line width when spooling started */
+	int spool_lines;
 };
 
 G_DEFINE_TYPE(VGATerm, vga_term, VGA_TYPE_TEXT);
 
+enum {
+	PROP_0,
+	PROP_SCROLLBACK_BYTES,
+	PROP_SCROLLBACK_LINES
+};
+
+/*
+ * Scrollback budget shared by every terminal in the process.  When the
+ * total goes over it, the sessions viewed least recently give up
+ * history first.  Only touched from the GTK thread.
+ */
+static GList *all_terms = NULL;
+static gsize scrollback_budget = 0;	/* 0 for no limit */
+static guint64 view_clock = 0;
+
 static void vga_term_class_init(VGATermClass * klass)
 {
 	GObjectClass *obj_class = G_OBJECT_CLASS(klass);
@@ -75,6 +130,21 @@ static void vga_term_class_init(VGATermClass * klass)
 	g_type_class_add_private(klass, sizeof(VGATermPrivate));
 
 	obj_class->finalize = vga_term_finalize;
+	obj_class->set_property = vga_term_set_property;
+	obj_class->get_property = vga_term_get_property;
+
+	g_object_class_install_property(obj_class, PROP_SCROLLBACK_BYTES,
+		g_param_spec_int("scrollback-bytes", "Scrollback bytes",
+				 "Character cell data kept as scrollback",
+				 VGA_TERM_MIN_SCROLLBUF_BYTES, G_MAXINT,
+				 VGA_TERM_DEFAULT_SCROLLBUF_BYTES,
+				 G_PARAM_READWRITE));
+	g_object_class_install_property(obj_class, PROP_SCROLLBACK_LINES,
+		g_param_spec_int("scrollback-lines", "Scrollback lines",
+				 "Lines kept as scrollback",
+				 VGA_TERM_MIN_SCROLLBUF_LINES, G_MAXINT,
+				 VGA_TERM_DEFAULT_SCROLLBUF_LINES,
+				 G_PARAM_READWRITE));
 
 	/* Hackish way of making a scrollable widget in Gtk+ 2.x */
 	klass->set_scroll_adjustments =	vga_term_set_scroll_adjustments;
@@ -90,6 +160,9 @@ static void vga_term_class_init(VGATermClass * klass)
 			     GTK_TYPE_ADJUSTMENT, GTK_TYPE_ADJUSTMENT);
 
 	widget_class->scroll_event = vga_term_scroll;
+	widget_class->map = vga_term_map;
+
+	((VGATextClass *) klass)->grid_resized = vga_term_grid_resized;
 
 	/* widget_class->size_request = vga_term_size_request; */
 	/* same for size_allocate */
@@ -103,22 +176,110 @@ static void vga_term_init(VGATerm *term)
 	term->textattr = 0x07;
 	term->win_top_left_x = 1;
 	term->win_top_left_y = 1;
-	term->win_bot_right_x = 80;
-	term->win_bot_right_y = 25;
+	term->win_bot_right_x = vga_get_cols(VGA_TEXT(term));
+	term->win_bot_right_y = vga_get_rows(VGA_TEXT(term));
 
 	/* Initialize private data */
 	pvt = term->pvt = VGA_TERM_GET_PRIVATE(term);
+	pvt->grid_cols = term->win_bot_right_x;
+	pvt->grid_rows = term->win_bot_right_y;
 
-	/* FIXME: Configurable scroll buffer size */
-	pvt->sbuf = scrollbuf_new(VGA_TERM_DEFAULT_SCROLLBUF_BYTES,
-				  VGA_TERM_DEFAULT_SCROLLBUF_LINES);
+	pvt->sbuf_bytes = VGA_TERM_DEFAULT_SCROLLBUF_BYTES;
+	pvt->sbuf_lines = VGA_TERM_DEFAULT_SCROLLBUF_LINES;
+	pvt->sbuf = scrollbuf_new(pvt->sbuf_bytes, pvt->sbuf_lines);
 	pvt->scroll_line = 0;
+	pvt->scroll_snap = NULL;
 
 	pvt->adjustment = NULL;
 	vga_term_set_vadjustment(term, NULL);
 
+	/* A new session counts as the one being looked at */
+	all_terms = g_list_prepend(all_terms, term);
+	vga_term_viewed(term);
 }
 
+static void
+vga_term_set_property(GObject *object, guint prop_id, const GValue *value,
+		      GParamSpec *pspec)
+{
+	VGATerm *term = VGA_TERM(object);
+
+	switch (prop_id) {
+	case PROP_SCROLLBACK_BYTES:
+		vga_term_set_scrollback(term, g_value_get_int(value),
+					term->pvt->sbuf_lines);
+		break;
+	case PROP_SCROLLBACK_LINES:
+		vga_term_set_scrollback(term, term->pvt->sbuf_bytes,
+					g_value_get_int(value));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+vga_term_get_property(GObject *object, guint prop_id, GValue *value,
+		      GParamSpec *pspec)
+{
+	VGATerm *term = VGA_TERM(object);
+
+	switch (prop_id) {
+	case PROP_SCROLLBACK_BYTES:
+		g_value_set_int(value, term->pvt->sbuf_bytes);
+		break;
+	case PROP_SCROLLBACK_LINES:
+		g_value_set_int(value, term->pvt->sbuf_lines);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+vga_term_map(GtkWidget *widget)
+{
+	GTK_WIDGET_CLASS(vga_term_parent_class)->map(widget);
+
+	vga_term_viewed(VGA_TERM(widget));
+}
+
+
+/*
+ * Keep the text window inside the grid when it changes size.  A window
+ * covering the whole screen grows and shrinks with it.
+ */
+static void
+vga_term_grid_resized(VGAText *vga, int cols, int rows)
+{
+	VGATerm *term = VGA_TERM(vga);
+
+	if (term->win_top_left_x == 1 && term->win_top_left_y == 1 &&
+	    term->win_bot_right_x == term->pvt->grid_cols &&
+	    term->win_bot_right_y == term->pvt->grid_rows)
+	{
+		term->win_bot_right_x = cols;
+		term->win_bot_right_y = rows;
+	}
+	else if (term->win_top_left_x > cols || term->win_top_left_y > rows)
+	{
+		/* Nothing left of it, start over */
+		term->win_top_left_x = 1;
+		term->win_top_left_y = 1;
+		term->win_bot_right_x = cols;
+		term->win_bot_right_y = rows;
+	}
+	else
+	{
+		term->win_bot_right_x = MIN(term->win_bot_right_x, cols);
+		term->win_bot_right_y = MIN(term->win_bot_right_y, rows);
+	}
+
+	term->pvt->grid_cols = cols;
+	term->pvt->grid_rows = rows;
+}
 
 GtkWidget *vga_term_new(void)
 {
@@ -129,8 +290,12 @@ static void vga_term_finalize(GObject *gobject)
 {
 	VGATerm *term = VGA_TERM(gobject);
 
+	all_terms = g_list_remove(all_terms, term);
 	if (term->pvt->sbuf)
 		scrollbuf_destroy(term->pvt->sbuf);
+	g_free(term->pvt->spool);
+	if (term->pvt->scroll_snap)
+		vga_snapshot_unref(term->pvt->scroll_snap);
 	
 	/* Chain up to the parent class */
 	G_OBJECT_CLASS (vga_term_parent_class)->finalize(gobject);
@@ -259,6 +424,15 @@ vga_term_scroll (GtkWidget *widget, GdkEventScroll *event)
 		return FALSE;
 	}
 
+	/* In canvas mode the wheel moves the view over the canvas */
+	if (vga_get_canvas_rows(VGA_TEXT(term)) > 0 &&
+	    term->pvt->scroll_line == 0) {
+		vga_set_view_top(VGA_TEXT(term),
+				 vga_get_view_top(VGA_TEXT(term)) -
+				 (int) v * VGA_TERM_CANVAS_SCROLL_LINES);
+		return TRUE;
+	}
+
 	v += term->pvt->scroll_line;
 	v = MAX(v, 0);
 	printf("v = %6.2f\n", v);
@@ -381,6 +555,7 @@ void vga_term_writec(VGATerm *term, guchar c)
 	gboolean cursor_vis;
 	int x = -1, y = -1, cx, cy;
 	VGAText *vga;
+	vga_charcell *cell;
 	
 	g_return_if_fail(term != NULL);
 	g_return_if_fail(VGA_IS_TERM(term));
@@ -436,7 +611,17 @@ void vga_term_writec(VGATerm *term, guchar c)
 			if (c == '[')
 				g_print("@<%d,%d>", cx, cy);
 			*/
-			vga_put_char(vga, c, term->textattr, cx, cy);
+			if (term->pvt->spool_lines > 0)
+			{
+				/* On the bottom line, which is being spooled */
+				cell = term->pvt->spool +
+					(term->pvt->spool_lines - 1) *
+					term->pvt->spool_cols + cx;
+				cell->c = c;
+				cell->attr = term->textattr;
+			}
+			else
+				vga_put_char(vga, c, term->textattr, cx, cy);
 
 			/* Go to next line? */
 			if (cx+1 == term->win_bot_right_x)
@@ -449,6 +634,13 @@ void vga_term_writec(VGATerm *term, guchar c)
 	}
 	lc = c;
 	/* Check if we need to scroll down */
+	if (y > (term->win_bot_right_y - term->win_top_left_y + 1) &&
+	    vga_term_spool_line(term))
+	{
+		vga_cursor_move(vga, term->win_top_left_x - 1,
+				term->win_bot_right_y - 1);
+	}
+	else
 	if (y > (term->win_bot_right_y - term->win_top_left_y + 1))
 	{
 		cursor_vis = vga_cursor_is_visible(vga);
@@ -476,8 +668,11 @@ void vga_term_writec(VGATerm *term, guchar c)
 gint vga_term_write(VGATerm *term, guchar * s)
 {
 	int i = 0;
+
+	vga_term_begin_batch(term);
 	while (s[i] != '\0')
 		vga_term_writec(term, s[i++]);
+	vga_term_end_batch(term);
 	return i;
 }
 
@@ -528,7 +723,8 @@ void vga_term_window(VGATerm *term, int x1, int y1, int x2, int y2)
 	g_assert(y1 > 0 && y1 <= y2);
 	g_assert(x2 <= vga_get_cols(VGA_TEXT(term)));
 	g_assert(y2 <= vga_get_rows(VGA_TEXT(term)));
-			
+
+	vga_term_flush_scroll(term);
 	term->win_top_left_x = x1;
 	term->win_top_left_y = y1;
 	term->win_bot_right_x = x2;
@@ -548,6 +744,10 @@ void vga_term_gotoxy(VGATerm *term, int x, int y)
 	x = MIN(term->win_bot_right_x - term->win_top_left_x + 1, x);
 	y = MIN(term->win_bot_right_y - term->win_top_left_y + 1, y);
 
+	/* Spooled lines only last while we stay on the bottom line */
+	if (y != term->win_bot_right_y - term->win_top_left_y + 1)
+		vga_term_flush_scroll(term);
+
 	/* Adjust for window offsets */	
 	x += term->win_top_left_x - 1;
 	y += term->win_top_left_y - 1;
@@ -592,13 +792,16 @@ void vga_term_clrscr(VGATerm *term)
 {
 	g_return_if_fail(term != NULL);
 	g_return_if_fail(VGA_IS_TERM(term));
+	vga_term_flush_scroll(term);
 
 	/* If full clear screen, save current screen to scroll buffer */
 	if (term->win_top_left_x == 1 &&
 	    term->win_top_left_y == 1 &&
 	    term->win_bot_right_x == vga_get_cols(VGA_TEXT(term)) &&
 	    term->win_bot_right_y == vga_get_rows(VGA_TEXT(term))) {
+#ifdef ENABLE_DEBUG
 	    printf("Saving all lines due to clrscr\n");
+#endif
 		vga_term_scrollbuf_add_lines(term, 1,
 					     vga_get_rows(VGA_TEXT(term)));
 	}
@@ -660,6 +863,7 @@ void vga_term_clrdown(VGATerm *term)
 
 	g_return_if_fail(term != NULL);
 	g_return_if_fail(VGA_IS_TERM(term));
+	vga_term_flush_scroll(term);
 
 	y = vga_cursor_y(VGA_TEXT(term));
 	vga_clear_area(VGA_TEXT(term), 0x00,
@@ -677,6 +881,7 @@ void vga_term_clrup(VGATerm *term)
 
 	g_return_if_fail(term != NULL);
 	g_return_if_fail(VGA_IS_TERM(term));
+	vga_term_flush_scroll(term);
 
 	y = vga_cursor_y(VGA_TEXT(term));
 	vga_clear_area(VGA_TEXT(term), 0x00,
@@ -692,6 +897,7 @@ void vga_term_clreol(VGATerm *term)
 	g_return_if_fail(term != NULL);
 	g_return_if_fail(VGA_IS_TERM(term));
 	vga = VGA_TEXT(term);
+	vga_term_flush_scroll(term);
 
 	vga_clear_area(vga, SETBG(0x00, GETBG(term->textattr)),
 			vga_cursor_x(vga), vga_cursor_y(vga),
@@ -736,67 +942,37 @@ void vga_term_clreol(VGATerm *term)
  */
 void vga_term_scroll_up(VGATerm *term, int top_row, int lines)
 {
-	guchar * video_buf;
-	//struct { guchar c; guchar attr; } cell;
-	//gint16 * cellword;
-	int ofs, cols, win_cols, y, start_y, end_y;
+	int cols, win_cols, start_y;
 	VGAText *vga;
 	
 	g_return_if_fail(term != NULL);
 	g_return_if_fail(VGA_IS_TERM(term));
 	vga = VGA_TEXT(term);
 	cols = vga_get_cols(vga);
+	vga_term_flush_scroll(term);
 
-	video_buf = vga_get_video_buf(vga);
 	win_cols = term->win_bot_right_x - term->win_top_left_x + 1;
 	// start_y = relative_to_absolute(top_row)
 	start_y = term->win_top_left_y + top_row - 2;
-	end_y = term->win_bot_right_y - lines;
 	
-	/* 
-	 * In the case where the window is as wide as the display, we
-	 * can optimize the shifting by using a single memmove() call
-	 */
+	/* Lines only go to the scrollback if they leave the whole screen */
 	if (win_cols == cols)
 	{
+#ifdef ENABLE_DEBUG
 		printf("NAC: add line because of scroll_up\n");
+#endif
 		vga_term_scrollbuf_add_lines(term, top_row, lines);
-		ofs = start_y * cols * 2;
-		memmove(video_buf + ofs, video_buf + ofs + cols*2*lines,
-				cols*2*(term->win_bot_right_y - lines));
 	}
-	else
-	{
-		for (y = start_y; y < end_y; y++)
-		{
-			/* Source is line below y at column of window start */
-			ofs = (y*cols + term->win_top_left_x - 1) * 2;
-			/* Shift line up */
-			memmove(video_buf + ofs, video_buf + ofs + cols*2,
-					win_cols*2);
-		}
-	}
-	
-	/* Now clear the free'd up lines at the bottom */
-	vga_clear_area(vga, SETBG(0x00, GETBG(term->textattr)),
-			term->win_top_left_x - 1, end_y, win_cols, lines);
-		
-/*	
-	cell.c = 0x00;
-	cell.attr = SETBG(0x00, GETBG(term->textattr));
-	cellword = (gint16 *) &cell;
-	ofs = (end_y*cols + term->win_top_left_x-1) * 2;
-	for (y = 0; y < lines; y++)
-	{
-		memsetword(video_buf + ofs, *cellword, win_cols);
-		ofs += (2*cols);
-	}
-	*/
 
-#if 1
-	vga_mark_region_dirty(vga, term->win_top_left_x-1, term->win_top_left_y-1, win_cols,
-				term->win_bot_right_y - term->win_top_left_y + 1);
-#else
+	/*
+	 * Shift the lines up and clear the free'd up lines at the bottom.
+	 * This also takes care of marking the region dirty.
+	 */
+	vga_scroll_rows(vga, SETBG(0x00, GETBG(term->textattr)),
+			term->win_top_left_x - 1, start_y, win_cols,
+			term->win_bot_right_y - start_y, lines);
+
+#if 0
 	/* FIXME: Use actual font height?  Or some other way of knowing
 	 pixels per line */
 	gdk_window_scroll(GTK_WIDGET(term)->window, 0, -lines * 16);
@@ -814,66 +990,24 @@ void vga_term_scroll_up(VGATerm *term, int top_row, int lines)
 
 void vga_term_scroll_down(VGATerm *term, int top_row, int lines)
 {
-	guchar * video_buf;
-	//struct { guchar c; guchar attr; } cell;
-	//gint16 * cellword;
-	int ofs, cols, win_cols, y, start_y;
+	int win_cols, start_y;
 	VGAText *vga;
 	
 	g_return_if_fail(term != NULL);
 	g_return_if_fail(VGA_IS_TERM(term));
 	vga = VGA_TEXT(term);
+	vga_term_flush_scroll(term);
 
-	cols = vga_get_cols(vga);
-	
-	video_buf = vga_get_video_buf(vga);
 	win_cols = term->win_bot_right_x - term->win_top_left_x + 1;
 	// start_y = relative_to_absolute(top_row)
 	start_y = term->win_top_left_y + top_row - 2;
 
-	/* 
-	 * In the case where the window is as wide as the display, we
-	 * can optimize the shifting by using a single memmove() call
-	 */
-	if (win_cols == cols)
-	{
-		ofs = start_y * cols * 2;
-		memmove(video_buf + ofs + cols*2*lines, video_buf + ofs,
-				cols*2*(term->win_bot_right_y - start_y - 1));
-	}
-	else
-	{
-		/* Start from the bottom */
-		for (y = term->win_bot_right_y - 1; y > start_y; y--)
-		{
-			/* Source is line above y at column of window start */
-			ofs = ((y-1)*cols + term->win_top_left_x - 1) * 2;
-			/* Shift line down */
-			memmove(video_buf + ofs + win_cols*2, video_buf + ofs,
-					win_cols*2);
-		}
-	}
-	
-	/* Now clear the gap lines */
-	vga_clear_area(vga, SETBG(0x00, GETBG(term->textattr)),
-		term->win_top_left_x - 1, start_y, win_cols, lines);
-			
-#if 0	
-	cell.c = 0x00;
-	cell.attr = SETBG(0x00, GETBG(term->textattr));
-	cellword = (gint16 *) &cell;
-	ofs = (start_y * cols + term->win_top_left_x - 1) * 2;
-	for (y = 0; y < lines; y++)
-	{
-		memsetword(video_buf + ofs, *cellword, win_cols);
-		ofs += (2*cols);
-	}
-#endif
+	/* Shift the lines down and clear the gap lines */
+	vga_scroll_rows(vga, SETBG(0x00, GETBG(term->textattr)),
+			term->win_top_left_x - 1, start_y, win_cols,
+			term->win_bot_right_y - start_y, -lines);
 
-#if 1
-	vga_mark_region_dirty(vga, term->win_top_left_x, term->win_top_left_y, win_cols,
-				term->win_bot_right_y - term->win_top_left_y + 1);
-#else
+#if 0
 	/* FIXME: Use actual font height?  Or some other way of knowing
 	 pixels per line */
 	gdk_window_scroll(GTK_WIDGET(term)->window, 0, lines * 16);
@@ -968,7 +1102,9 @@ void vga_term_delline(VGATerm *term)
 	 * scrollback buffer
 	 */
 	if (vga_term_wherey(term) == 1) {
+#ifdef ENABLE_DEBUG
 		printf("NAC: add line because of delline\n");
+#endif
 		vga_term_scrollbuf_add_lines(term, 1, 1);
 	}
 #endif
@@ -1070,22 +1206,121 @@ void vga_term_set_bg(VGATerm *term, guchar bg)
 static void
 vga_term_scrollbuf_add_lines(VGATerm *term, int start_y, int count)
 {
-	int i;
 	int cols;
-	long ofs;
 	guchar * video_buf;
 
 	if (term->pvt->sbuf == NULL)
 		return;
 
+	/* Rows are contiguous in the video buffer, so it's one block */
 	cols = vga_get_cols(VGA_TEXT(term));
 	video_buf = vga_get_video_buf(VGA_TEXT(term));
-	ofs = (start_y-1) * cols * 2;
+	scrollbuf_add_lines(term->pvt->sbuf,
+			    video_buf + (start_y-1) * cols * 2, cols * 2,
+			    count);
+}
+
+/*
+ * Scroll the bottom line of the window off in the spool rather than on
+ * screen, if we're in a write batch and the window allows it.  Returns
+ * FALSE if the caller has to scroll for real.
+ */
+static gboolean
+vga_term_spool_line(VGATerm *term)
+{
+	VGATermPrivate *pvt = term->pvt;
+	vga_charcell *line;
+	int i, cols, rows;
+
+	cols = vga_get_cols(VGA_TEXT(term));
+	rows = term->win_bot_right_y - term->win_top_left_y + 1;
+	if (pvt->batch == 0 || term->win_top_left_x != 1 ||
+	    term->win_bot_right_x != cols)
+		return FALSE;
+
+	/* A whole window's worth replaces everything anyway */
+	if (pvt->spool_lines == rows)
+		vga_term_flush_scroll(term);
 
-	for (i = 0; i < count; i++) {
-		scrollbuf_add_line(term->pvt->sbuf, video_buf + ofs, cols*2);
-		ofs += (cols * 2);
+	if (pvt->spool_lines == 0)
+	{
+		if (pvt->spool_size < cols * rows)
+		{
+			g_free(pvt->spool);
+			pvt->spool_size = cols * rows;
+			pvt->spool = g_new(vga_charcell, pvt->spool_size);
+		}
+		pvt->spool_cols = cols;
 	}
+
+	/* Cleared like vga_term_scroll_up() would */
+	line = pvt->spool + pvt->spool_lines * cols;
+	for (i = 0; i < cols; i++)
+	{
+		line[i].c = 0x00;
+		line[i].attr = SETBG(0x00, GETBG(term->textattr));
+	}
+	pvt->spool_lines++;
+
+	return TRUE;
+}
+
+/**
+ * vga_term_flush_scroll:
+ * @term: VGATerm to operate on
+ *
+ * Apply the scrolling held back by the current write batch: one
+ * scrollback append and one scroll of the window for all of the lines,
+ * then the spooled lines copied in at the bottom.  Called by anything
+ * that needs the screen to be up to date.
+ */
+void vga_term_flush_scroll(VGATerm *term)
+{
+	VGATermPrivate *pvt;
+	VGAText *vga;
+	int i, n, rows, top;
+
+	g_return_if_fail(VGA_IS_TERM(term));
+	pvt = term->pvt;
+	if (pvt->spool_lines == 0)
+		return;
+
+	vga = VGA_TEXT(term);
+	n = pvt->spool_lines;
+	pvt->spool_lines = 0;
+	top = term->win_top_left_y - 1;
+	rows = term->win_bot_right_y - top;
+
+	vga_term_scrollbuf_add_lines(term, term->win_top_left_y, n);
+	vga_scroll_rows(vga, pvt->spool[0].attr, 0, top, pvt->spool_cols,
+			rows, n);
+	for (i = 0; i < n; i++)
+		vga_put_cells(vga, pvt->spool + i * pvt->spool_cols,
+			      pvt->spool_cols, 0, top + rows - n + i);
+}
+
+/**
+ * vga_term_begin_batch:
+ * @term: VGATerm to operate on
+ *
+ * Start a batch of writes.  Until the matching vga_term_end_batch(),
+ * scrolling caused by text running off the bottom of the window is
+ * saved up and done in one go.  Batches nest.
+ */
+void vga_term_begin_batch(VGATerm *term)
+{
+	g_return_if_fail(VGA_IS_TERM(term));
+
+	term->pvt->batch++;
+}
+
+void vga_term_end_batch(VGATerm *term)
+{
+	g_return_if_fail(VGA_IS_TERM(term));
+	g_return_if_fail(term->pvt->batch > 0);
+
+	if (--term->pvt->batch == 0)
+		vga_term_flush_scroll(term);
 }
 
 /*
@@ -1095,21 +1330,28 @@ vga_term_scrollbuf_add_lines(VGATerm *term, int start_y, int count)
  */
 void vga_term_set_scroll(VGATerm *term, int line)
 {
-	guchar *video_buf, *sec_buf;
+	guchar *sec_buf;
 	guchar *linebuf;
 	int cols, rows;
-	int buf_size, line_bytes;
+	int line_bytes;
 	int start_row;
 	int i;
 	long ofs;
 	int scroll_i;
+	VGASnapshot *snap;
 
 	if (term->pvt->scroll_line == line)
 		return;	/* Nothing to do */
+	vga_term_flush_scroll(term);
+	term->pvt->viewed = ++view_clock;
 
 	term->pvt->scroll_line = line;
 
 	if (line == 0) {
+		if (term->pvt->scroll_snap) {
+			vga_snapshot_unref(term->pvt->scroll_snap);
+			term->pvt->scroll_snap = NULL;
+		}
 		vga_show_secondary(VGA_TEXT(term), FALSE);
 		vga_refresh(VGA_TEXT(term));
 		return;
@@ -1143,16 +1385,29 @@ for (i = 0; i < term->pvt->sbuf->max_bytes; i++) {
 	printf("\n");
 #endif
 
-	video_buf = vga_get_video_buf(VGA_TEXT(term));
 	sec_buf = vga_get_sec_buf(VGA_TEXT(term));
 	cols = vga_get_cols(VGA_TEXT(term));
 	rows = vga_get_rows(VGA_TEXT(term));
-	buf_size = vga_video_buf_size(VGA_TEXT(term));
+
+	/*
+	 * Keep showing the screen as it was when scrolling back started,
+	 * whatever output comes in meanwhile.  Taking it only copies the
+	 * lines changed since it was last taken.
+	 */
+	snap = term->pvt->scroll_snap;
+	if (snap == NULL || vga_snapshot_get_cols(snap) != cols ||
+	    vga_snapshot_get_rows(snap) != rows) {
+		if (snap)
+			vga_snapshot_unref(snap);
+		snap = term->pvt->scroll_snap =
+			vga_snapshot_new(VGA_TEXT(term));
+	}
 
 	if (line < rows) {
 		/* Show partial primary buffer, partial scrollback */
-		memcpy(sec_buf + 2*cols*line, video_buf,
-		       buf_size - (2*cols*line));
+		for (i = line; i < rows; i++)
+			memcpy(sec_buf + 2*cols*i,
+			       vga_snapshot_get_line(snap, i - line), 2*cols);
 		start_row = line - 1;
 		scroll_i = 0;
 	} else {
@@ -1202,3 +1457,318 @@ printf("\n");
 	vga_show_secondary(VGA_TEXT(term), TRUE);
 	vga_refresh(VGA_TEXT(term));
 }
+
+/*
+ * Resize the scrollback to hold @max_bytes of character cells in at
+ * most @max_lines lines, keeping the newest lines that still fit.
+ */
+void
+vga_term_set_scrollback(VGATerm *term, int max_bytes, int max_lines)
+{
+	VGATermPrivate *pvt;
+
+	g_return_if_fail(VGA_IS_TERM(term));
+	g_return_if_fail(max_bytes >= VGA_TERM_MIN_SCROLLBUF_BYTES);
+	g_return_if_fail(max_lines >= VGA_TERM_MIN_SCROLLBUF_LINES);
+
+	pvt = term->pvt;
+	if (max_bytes == pvt->sbuf_bytes && max_lines == pvt->sbuf_lines)
+		return;
+
+	vga_term_flush_scroll(term);
+	if (scrollbuf_resize(pvt->sbuf, max_bytes, max_lines) < 0)
+	{
+		g_warning("vga_term_set_scrollback: out of memory");
+		return;
+	}
+	vga_term_clamp_scroll(term);
+
+	g_object_freeze_notify(G_OBJECT(term));
+	if (max_bytes != pvt->sbuf_bytes)
+		g_object_notify(G_OBJECT(term), "scrollback-bytes");
+	if (max_lines != pvt->sbuf_lines)
+		g_object_notify(G_OBJECT(term), "scrollback-lines");
+	pvt->sbuf_bytes = max_bytes;
+	pvt->sbuf_lines = max_lines;
+	g_object_thaw_notify(G_OBJECT(term));
+
+	vga_term_enforce_budget(term);
+}
+
+int
+vga_term_get_scrollback_bytes(VGATerm *term)
+{
+	g_return_val_if_fail(VGA_IS_TERM(term), 0);
+
+	return term->pvt->sbuf_bytes;
+}
+
+int
+vga_term_get_scrollback_lines(VGATerm *term)
+{
+	g_return_val_if_fail(VGA_IS_TERM(term), 0);
+
+	return term->pvt->sbuf_lines;
+}
+
+/*
+ * Append the scrollback of @term to @out: the size asked for with
+ * vga_term_set_scrollback() (two gint32s), then a scrollbuf image.
+ */
+void
+vga_term_save_scrollback(VGATerm *term, GByteArray *out)
+{
+	gint32 size[2];
+	guint ofs;
+
+	g_return_if_fail(VGA_IS_TERM(term));
+
+	size[0] = term->pvt->sbuf_bytes;
+	size[1] = term->pvt->sbuf_lines;
+	g_byte_array_append(out, (guint8 *) size, sizeof(size));
+
+	ofs = out->len;
+	g_byte_array_set_size(out, ofs + scrollbuf_image_size(term->pvt->sbuf));
+	scrollbuf_save_image(term->pvt->sbuf, out->data + ofs);
+}
+
+/*
+ * Export the scrollback of @term, oldest line first, then its screen,
+ * in its current colors, to @exp.  Lines go out one at a time straight
+ * from the scrollback, so a long history costs no extra memory, and
+ * screen rows use the attribute runs the widget already keeps.  Make
+ * @exp with VGA_EXPORT_NO_ICECOLOR if vga_get_icecolor() is off.
+ */
+void
+vga_term_export(VGATerm *term, VGAExport *exp)
+{
+	VGAText *vga;
+	GdkColor *c;
+	const guchar *line, *cells;
+	const vga_attr_run *runs;
+	VGAExportRun row_runs[VGA_MAX_COLS];
+	uint32_t rgb[16];
+	int i, y, cols, rows, line_bytes, n_runs;
+
+	g_return_if_fail(VGA_IS_TERM(term));
+	vga = VGA_TEXT(term);
+	vga_term_flush_scroll(term);
+
+	for (i = 0; i < 16; i++) {
+		c = vga_palette_get_color(vga_get_palette(vga), i);
+		rgb[i] = ((c->red >> 8) << 16) | ((c->green >> 8) << 8) |
+			(c->blue >> 8);
+	}
+	vga_export_set_palette(exp, rgb);
+
+	cols = vga_get_cols(vga);
+	rows = vga_get_rows(vga);
+	if (term->pvt->sbuf != NULL) {
+		for (i = scrollbuf_line_count(term->pvt->sbuf) - 1; i >= 0;
+		     i--) {
+			line = scrollbuf_get_line(term->pvt->sbuf, i,
+						  &line_bytes);
+			if (line != NULL)
+				vga_export_row(exp, line,
+					       MIN(cols, line_bytes / 2));
+		}
+	}
+
+	/* The screen keeps its attribute runs, so they needn't be found
+	 * again from the cells */
+	cells = vga_get_video_buf(vga);
+	rows = vga_export_screen_rows(exp, cells, cols, rows);
+	for (y = 0; y < rows; y++) {
+		runs = vga_get_attr_runs(vga, y, &n_runs);
+		n_runs = MIN(n_runs, VGA_MAX_COLS);
+		for (i = 0; i < n_runs; i++) {
+			row_runs[i].start = runs[i].start;
+			row_runs[i].len = runs[i].len;
+			row_runs[i].attr = runs[i].attr;
+		}
+		vga_export_row_runs(exp, cells + y * cols * 2, cols,
+				    row_runs, n_runs);
+	}
+}
+
+/*
+ * Replace the scrollback of @term with one saved by
+ * vga_term_save_scrollback().  Returns FALSE, changing nothing, if
+ * that isn't what the @len bytes at @src are.
+ */
+gboolean
+vga_term_restore_scrollback(VGATerm *term, const guchar *src, gsize len)
+{
+	VGATermPrivate *pvt;
+	gint32 size[2];
+
+	g_return_val_if_fail(VGA_IS_TERM(term), FALSE);
+	pvt = term->pvt;
+
+	if (len < sizeof(size))
+		return FALSE;
+	memcpy(size, src, sizeof(size));
+	if (size[0] < VGA_TERM_MIN_SCROLLBUF_BYTES ||
+	    size[1] < VGA_TERM_MIN_SCROLLBUF_LINES)
+		return FALSE;
+
+	vga_term_set_scroll(term, 0);
+	vga_term_flush_scroll(term);
+	if (scrollbuf_load_image(pvt->sbuf, src + sizeof(size),
+				 len - sizeof(size)) < 0)
+		return FALSE;
+
+	g_object_freeze_notify(G_OBJECT(term));
+	if (size[0] != pvt->sbuf_bytes)
+		g_object_notify(G_OBJECT(term), "scrollback-bytes");
+	if (size[1] != pvt->sbuf_lines)
+		g_object_notify(G_OBJECT(term), "scrollback-lines");
+	pvt->sbuf_bytes = size[0];
+	pvt->sbuf_lines = size[1];
+	g_object_thaw_notify(G_OBJECT(term));
+
+	/* Trimmed when saved, it grows back once viewed (see vga_term_viewed) */
+	vga_term_enforce_budget(term);
+
+	return TRUE;
+}
+
+/*
+ * Cap the scrollback memory of all terminals together at @bytes, or
+ * lift the cap with 0.  Sessions that had to give up history get
+ * their full size back (though not the lines) the next time they're
+ * shown, at the expense of whichever was viewed least recently.  No
+ * session is trimmed below VGA_TERM_MIN_SCROLLBUF_BYTES and
+ * VGA_TERM_MIN_SCROLLBUF_LINES.
+ */
+void
+vga_term_set_scrollback_budget(gsize bytes)
+{
+	scrollback_budget = bytes;
+	vga_term_enforce_budget(NULL);
+}
+
+gsize
+vga_term_get_scrollback_budget(void)
+{
+	return scrollback_budget;
+}
+
+/* Memory held for scrollback by all terminals */
+gsize
+vga_term_get_scrollback_usage(void)
+{
+	GList *l;
+	gsize total = 0;
+
+	for (l = all_terms; l != NULL; l = l->next)
+		total += scrollbuf_mem_size(VGA_TERM(l->data)->pvt->sbuf);
+
+	return total;
+}
+
+/* Keep a scrolled back view within the lines left after a shrink */
+static void
+vga_term_clamp_scroll(VGATerm *term)
+{
+	VGATermPrivate *pvt = term->pvt;
+	guint64 viewed = pvt->viewed;
+	int lines;
+
+	lines = scrollbuf_line_count(pvt->sbuf);
+	if (pvt->scroll_line <= lines)
+		return;
+
+	/* The user didn't look at it, so it doesn't count as viewed */
+	vga_term_set_scroll(term, lines);
+	pvt->viewed = viewed;
+}
+
+/* Shrink @term's scrollback by about @excess bytes, down to the minimum */
+static gboolean
+vga_term_trim(VGATerm *term, gsize excess)
+{
+	ScrollBuf *sbuf = term->pvt->sbuf;
+	long before;
+	double keep;
+	int bytes, lines;
+
+	before = scrollbuf_mem_size(sbuf);
+	keep = MAX(0.0, 1.0 - (double) excess / before);
+	bytes = MAX(VGA_TERM_MIN_SCROLLBUF_BYTES,
+		    (int) (sbuf->max_bytes * keep));
+	lines = MAX(VGA_TERM_MIN_SCROLLBUF_LINES,
+		    (int) (sbuf->max_lines * keep));
+	if (scrollbuf_resize(sbuf, bytes, lines) < 0)
+		return FALSE;
+	vga_term_clamp_scroll(term);
+
+	return scrollbuf_mem_size(sbuf) < before;
+}
+
+static gboolean
+vga_term_trimmable(VGATerm *term)
+{
+	return term->pvt->sbuf->max_bytes > VGA_TERM_MIN_SCROLLBUF_BYTES ||
+	       term->pvt->sbuf->max_lines > VGA_TERM_MIN_SCROLLBUF_LINES;
+}
+
+/*
+ * Trim sessions until the total fits the budget: hidden ones before
+ * shown ones, least recently viewed first.  @spare only goes once
+ * nothing else can.
+ */
+static void
+vga_term_enforce_budget(VGATerm *spare)
+{
+	VGATerm *term, *victim;
+	GList *l;
+	gsize total;
+
+	if (scrollback_budget == 0)
+		return;
+
+	while ((total = vga_term_get_scrollback_usage()) > scrollback_budget)
+	{
+		victim = NULL;
+		for (l = all_terms; l != NULL; l = l->next)
+		{
+			term = l->data;
+			if (term == spare || !vga_term_trimmable(term))
+				continue;
+			if (victim == NULL ||
+			    GTK_WIDGET_MAPPED(victim) > GTK_WIDGET_MAPPED(term) ||
+			    (GTK_WIDGET_MAPPED(victim) ==
+			     GTK_WIDGET_MAPPED(term) &&
+			     term->pvt->viewed < victim->pvt->viewed))
+				victim = term;
+		}
+		if (victim == NULL && spare != NULL &&
+		    vga_term_trimmable(spare))
+			victim = spare;
+
+		if (victim == NULL ||
+		    !vga_term_trim(victim, total - scrollback_budget))
+			break;
+	}
+}
+
+/*
+ * Stamp @term as the most recently viewed session, and give back any
+ * history the budget took from it while it was out of sight.
+ */
+static void
+vga_term_viewed(VGATerm *term)
+{
+	VGATermPrivate *pvt = term->pvt;
+
+	pvt->viewed = ++view_clock;
+	if (pvt->sbuf->max_bytes == pvt->sbuf_bytes &&
+	    pvt->sbuf->max_lines == pvt->sbuf_lines)
+		return;
+
+	/* If there's no memory for it, it just stays trimmed for now */
+	if (scrollbuf_resize(pvt->sbuf, pvt->sbuf_bytes, pvt->sbuf_lines) < 0)
+		return;
+	vga_term_enforce_budget(term);
+}
@@ -29,6 +29,7 @@
 
 #include <gdk/gdk.h>
 #include "vgatext.h"
+#include "vgaexport.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,6 +46,10 @@ extern "C" {
 #define VGA_TERM_DEFAULT_SCROLLBUF_LINES	2000
 #define VGA_TERM_DEFAULT_SCROLLBUF_BYTES	320000
 
+/* The scrollback budget never trims a session below this */
+#define VGA_TERM_MIN_SCROLLBUF_LINES		25
+#define VGA_TERM_MIN_SCROLLBUF_BYTES		4000
+
 typedef struct _VGATerm	VGATerm;
 typedef struct _VGATermClass VGATermClass;
 typedef struct _VGATermPrivate VGATermPrivate;
@@ -108,6 +113,20 @@ guchar		vga_term_get_attr	(VGATerm *widget);
 void		vga_term_set_fg		(VGATerm *widget, guchar fg);
 void		vga_term_set_bg		(VGATerm *widget, guchar bg);
 void		vga_term_set_scroll	(VGATerm *term, int line);
+void		vga_term_begin_batch	(VGATerm *term);
+void		vga_term_end_batch	(VGATerm *term);
+void		vga_term_flush_scroll	(VGATerm *term);
+void		vga_term_set_scrollback	(VGATerm *term, int max_bytes,
+					 int max_lines);
+int		vga_term_get_scrollback_bytes (VGATerm *term);
+int		vga_term_get_scrollback_lines (VGATerm *term);
+void		vga_term_set_scrollback_budget (gsize bytes);
+gsize		vga_term_get_scrollback_budget (void);
+gsize		vga_term_get_scrollback_usage (void);
+void		vga_term_save_scrollback (VGATerm *term, GByteArray *out);
+gboolean	vga_term_restore_scrollback (VGATerm *term,
+					 const guchar *src, gsize len);
+void		vga_term_export		(VGATerm *term, VGAExport *exp);
 
 
 #ifdef __cplusplus
@@ -42,6 +42,9 @@
  */
 
 #include "vgatext.h"
+#include "rowcache.h"
+#include "workpool.h"
+#include "marshal.h"
 #include <pthread.h>
 
 
@@ -51,14 +54,130 @@
 #endif
 #define VGA_DEBUG
 
-#define PIXEL_TO_COL(x, vgafont)	((x) / (vgafont)->width)
-#define PIXEL_TO_ROW(y, vgafont)	((y) / (vgafont)->height)
+/* Size of a character cell on screen, in pixels */
+#define CELL_WIDTH(vga)		(((vga)->pvt->font->width + \
+				  ((vga)->pvt->nine_dot ? 1 : 0)) * \
+				 (vga)->pvt->scale)
+#define CELL_HEIGHT(vga)	((vga)->pvt->font->height * (vga)->pvt->scale)
+
+#define PIXEL_TO_COL(x, vga)	((x) / CELL_WIDTH(vga))
+#define PIXEL_TO_ROW(y, vga)	((y) / CELL_HEIGHT(vga))
+
+#define VGA_GLYPH_MAP_WORDS	(256 / 32)
+#define ROW_GLYPH_MAP(scr, row)	((scr)->row_glyphs + (row) * VGA_GLYPH_MAP_WORDS)
+#define GLYPH_MAP_SET(map, c)	((map)[(c) >> 5] |= 1U << ((c) & 31))
+#define GLYPH_MAP_TEST(map, c)	((map)[(c) >> 5] & (1U << ((c) & 31)))
+
+/* Lines rendered around the view in canvas mode: a screen either side */
+#define VGA_CANVAS_BAND_ROWS(view_rows)	((view_rows) * 3)
+
+/* Budget for rendered rows kept around by the row cache */
+#define VGA_ROW_CACHE_BYTES	(4 * 1024 * 1024)
+#define VGA_ROW_CACHE_ROWS	256
+
+/* Fewer dirty lines than this aren't worth waking the render workers */
+#define VGA_PARALLEL_MIN_ROWS	4
+
+/* Output backlog that counts as a flood, see vga_set_backlog() */
+#define VGA_FLOOD_BACKLOG	(64 * 1024)
+#define VGA_FLOOD_FRAME_TICKS	4	/* About 8 frames a second */
 
 #define CURSOR_BLINK_PERIOD_MS	229
 #define BLINK_PERIOD_MS		498
 
 typedef struct _VGAScreen VGAScreen;
 
+/*
+ * A line of cells shared between snapshots (and the console it was
+ * taken from while the line stays unchanged there).  Never modified
+ * once made; it goes away with its last reference.
+ */
+typedef struct {
+	gint refs;
+	int cols;
+	vga_charcell *cells;	/* Right after the struct */
+} VGASnapRow;
+
+struct _VGASnapshot {
+	gint refs;
+	int cols, rows;
+	gboolean cursor_visible;
+	int cursor_x, cursor_y;
+	VGASnapRow **lines;	/* Right after the struct */
+};
+
+/*
+ * What goes into a row cache key besides the cells themselves.  Must be
+ * zeroed before filling in since it is compared as raw bytes.
+ */
+typedef struct {
+	VGAFont *font;
+	guint font_serial;
+	guint pal_version;
+	guint blink;		/* VGA_ROW_* or the blink state */
+} vga_row_key_extra;
+
+#define VGA_ROW_NO_BLINK	2	/* No blinking cells on the line */
+#define VGA_ROW_ICECOLOR	3	/* Blink bits shown as bright bg */
+
+/*
+ * One virtual console: a screen of cells, everything kept up to date
+ * about them as they are written, and the surface they were last
+ * rendered onto.  A console that isn't shown only collects dirty bits;
+ * showing it again just re-checks its lines against row_hash, so only
+ * what changed in the meantime gets rendered.
+ */
+struct _VGAScreen {
+	vga_charcell *video_buf;
+
+	char *dirty_buf;	/* 1 or 0 for each cell in video_buf */
+	gboolean *dirty_line_buf;	/* 1 or 0 for each line in video_buf */
+				/* Yes, it's redundant with dirty_buf.. but
+				 * only indicates line status for speed */
+
+	/*
+	 * Attribute runs for each line of video_buf, kept up to date by
+	 * the write methods so the renderer never has to compare cell
+	 * attributes.  Line y's runs start at runs[y * cols] (a line can
+	 * never have more runs than columns).  A run_count of 0 means
+	 * the line was modified behind our back and must be rebuilt.
+	 */
+	vga_attr_run *runs;
+	guint16 *run_count;
+
+	/*
+	 * Glyph usage of video_buf, so that when glyphs of the font change
+	 * only the cells showing them are redrawn.  glyph_count is the
+	 * number of cells holding each glyph code (recounted on demand if
+	 * glyph_count_stale).  row_glyphs is a 256 bit map per line of the
+	 * glyphs that *may* be on it; bits are only cleared when the line
+	 * is cleared or rescanned.
+	 */
+	guint glyph_count[256];
+	gboolean glyph_count_stale;
+	guint32 *row_glyphs;	/* VGA_GLYPH_MAP_WORDS per line */
+
+	/*
+	 * Key hash of what each line of the band shows on surface_buf,
+	 * and the key itself, row_key_len bytes a line, to rule out hash
+	 * collisions
+	 */
+	guint64 *row_hash;
+	guchar *row_keys;
+	cairo_surface_t *surface_buf;
+
+	gboolean cursor_visible;
+	int cursor_x;		/* 0-based */
+	int cursor_y;
+
+	/*
+	 * The snapshot line each line of video_buf was last captured as,
+	 * or NULL if it changed since.  The next snapshot shares these
+	 * instead of copying them.  See vga_snapshot_new().
+	 */
+	VGASnapRow **snap_rows;
+};
+
 /* Widget private data */
 struct _VGATextPrivate {
 	/* int keypad? */
@@ -69,8 +188,8 @@ struct _VGATextPrivate {
 	 * We maintain two buffers, dubbed primary (video_buf) and
 	 * secondary (sec_buf).
 	 *
-	 * The primary buffer (video_buf) is ALWAYS the target for
-	 * any kind of write/output/manipulation operations.
+	 * The primary buffer (video_buf of the selected console) is ALWAYS
+	 * the target for any kind of write/output/manipulation operations.
 	 *
 	 * The secondary buffer is conditionally used only for rendering
 	 * purposes.  The renderer can temporarily switch to displaying
@@ -81,40 +200,107 @@ struct _VGATextPrivate {
 	 * is being displayed.
 	 *
 	 * For now, it is expected that any manipulation of the secondary
-	 * buffer is done manually in raw format.  It might be a better
-	 * idea to just have two "equal" buffers, and each operation
-	 * has an argument to indicate which buffer it should manipulate,
-	 * or use some kind of context to determine that.  This is similar
-	 * in concept to virtual consoles in Linux.
+	 * buffer is done manually in raw format.
 	 *
-	 * We don't really want the concept of a widget-wide "current"
-	 * buffer, because we need to support displaying one while
-	 * modifying another.
+	 * Like Linux VCs, there can be several consoles (VGAScreen), each
+	 * a primary buffer with its own cursor.  Writes go to the selected
+	 * one (scr) while another may be shown (vis), so one can be
+	 * displayed while others are modified.
 	 */
 	int video_buf_len;
-	vga_charcell *video_buf;
 	vga_charcell *sec_buf;
 	gboolean render_sec_buf;
 
-	guchar *line_buf;	/* Length == # of columns */
-	cairo_glyph_t *glyphs;
+	VGAScreen *screens;
+	int n_screens;
+	VGAScreen *scr;		/* Selected for writing */
+	VGAScreen *vis;		/* Shown */
 
-	char *dirty_buf;	/* 1 or 0 for each cell in video_buf */
-	gboolean *dirty_line_buf;	/* 1 or 0 for each line in video_buf */
-				/* Yes, it's redundant with dirty_buf.. but
-				 * only indicates line status for speed */
+	vga_attr_run *run_tmp;	/* Scratch lines of runs, cols long, one
+				 * per render worker (run_tmp is the
+				 * render thread's own) */
+
+	/*
+	 * Everything above whose size depends on the grid, along with the
+	 * consoles and the pixels of their surfaces, lives in this one
+	 * block so that resizing is a single allocation.  See
+	 * vga_alloc_screen().
+	 */
+	guchar *arena;
+
+	/*
+	 * Canvas mode: the grid (rows) can be taller than what is shown.
+	 * view_rows lines starting at view_top are visible, and only the
+	 * band_rows lines starting at band_top (the view plus a margin
+	 * either side) are rendered onto surface_buf.  Dirty lines outside
+	 * the band are left dirty until the band moves over them.  Without
+	 * a canvas all of these cover the whole grid.
+	 */
+	int canvas_rows;	/* Requested canvas height, 0 for none */
+	int view_rows, view_top;
+	int band_rows, band_top;
+
+	/*
+	 * Rendered lines are remembered by the hash of their row cache
+	 * key (see vga_row_key()), so identical lines can be copied in
+	 * instead of rendered.  A console's row_hash is the key hash of
+	 * what each line of the band currently shows on its surface, 0 if
+	 * unknown; a dirty line that still hashes the same needs nothing
+	 * done.
+	 */
+	RowCache *row_cache;
+	guchar *row_key;	/* Scratch key, row_key_len bytes */
+	int row_key_len;
+	guint font_serial;	/* Bumped whenever glyphs may have changed */
+
+	/*
+	 * Lines that need rasterizing are handed to the shared render
+	 * workers when there are enough of them; see vga_render_rows().
+	 */
+	WorkPool *workers;
+	int *render_jobs;	/* Line numbers, rows long */
+	VGAAtlas *render_atlas;	/* For the batch being run */
+	guint32 *render_pixels;
+	int render_stride;	/* In pixels */
+
+	/*
+	 * Widget area the current render pass changed, in widget pixels.
+	 * It is handed to GDK as one invalidate at the end of the pass.
+	 */
+	GdkRegion *damage;
+
+	/*
+	 * Frames are numbered by render passes that handed damage to GDK
+	 * (frame), and the window has been painted up to presented_frame.
+	 * frame_waits holds VGAFrameWait for vga_notify_frame(), sorted
+	 * by frame.
+	 */
+	guint frame, presented_frame;
+	GSList *frame_waits;
+
+	/*
+	 * Output bytes still waiting to be parsed, as last reported with
+	 * vga_set_backlog().  Set from any thread, so always accessed
+	 * atomically.  Past VGA_FLOOD_BACKLOG the render thread only
+	 * presents every VGA_FLOOD_FRAME_TICKS'th frame, and only the
+	 * visible lines, to leave the GDK lock to the parser.
+	 */
+	volatile gint backlog;
+	/*
+	 * Set by the render thread while it waits for the GDK lock, so a
+	 * writer holding it can step aside; see vga_yield_frame().
+	 */
+	volatile gint frame_wanted;
 	VGAFont * font;
+	int scale;		/* Integer zoom factor for the whole display */
+	gboolean nine_dot;	/* 9 pixel wide cells, like VGA text mode */
 	VGAPalette * pal;
 	gboolean icecolor;
-	gboolean cursor_visible;
-	int cursor_x;		/* 0-based */
-	int cursor_y;
 
 #ifdef USE_DEPRECATED_GDK
 	GdkBitmap * glyphs;
 	GdkGC * gc;
 #endif
-	cairo_surface_t *surface_buf;
 	guchar fg, bg;	/* Local copy of gc text attribute state */
 	
 	gboolean cursor_blink_state;
@@ -124,6 +310,21 @@ struct _VGATextPrivate {
 	gboolean blink_state;
 	guint blink_timeout_id;	/* -1 when no blinking chars on screen */
 
+	/*
+	 * Nothing is rendered and no timers run while the widget can't be
+	 * seen: unmapped (e.g. a background tab) or fully obscured.  The
+	 * dirty bitmap keeps collecting changes, and the whole lot gets
+	 * rendered in one go once it shows again.  The render thread
+	 * sleeps on show_cond meanwhile, rather than taking the GDK lock
+	 * every frame to find out.
+	 */
+	gboolean shown;
+	pthread_mutex_t show_lock;	/* Guards changes to shown and
+					 * render_enabled */
+	pthread_cond_t show_cond;	/* Signalled when either changes */
+	GdkVisibilityState visibility;
+	gboolean blink_paused;	/* Blink timer is due when shown again */
+
 	pthread_t thread;
 	gboolean render_enabled;
 };
@@ -132,12 +333,311 @@ struct _VGATextPrivate {
 static void vga_paint_region(GtkWidget * widget,
 			int top_left_x, int top_left_y,
 			int cols, int rows);
+static void vga_mark_cells_dirty(VGAText *vga, VGAScreen *scr,
+			int top_left_x, int top_left_y,
+			int cols, int rows);
+static gboolean vga_update_surface(VGAText *vga);
+static gboolean vga_alloc_screen(VGAText *vga, int cols, int rows,
+			int n_screens);
+static void vga_forget_rows(VGAText *vga, VGAScreen *scr,
+			int top_y, int rows);
+static void vga_rows_changed(VGAScreen *scr, int top_y, int rows);
+static gboolean vga_paint_row(VGAText *vga, VGAAtlas *atlas,
+			guint32 *pixels, int stride,
+			int row, int col, int count,
+			vga_attr_run *scratch);
+static void vga_start_blink_timer(VGAText *vga);
+
+/*
+ * Render workers, shared by every widget so that however many there
+ * are, rasterizing never has more threads than there are cores.  Made
+ * for the first widget and stopped with the last; workpool_run() has
+ * the widgets' batches take turns.
+ */
+G_LOCK_DEFINE_STATIC(render_pool);
+static WorkPool *render_pool = NULL;
+static int render_pool_users = 0;
+
+static WorkPool *
+vga_render_pool_ref(void)
+{
+	WorkPool *pool;
+
+	G_LOCK(render_pool);
+	if (render_pool == NULL)
+		render_pool = workpool_new(workpool_default_threads());
+	if (render_pool != NULL)
+		render_pool_users++;
+	pool = render_pool;
+	G_UNLOCK(render_pool);
+
+	return pool;
+}
+
+static void
+vga_render_pool_unref(void)
+{
+	WorkPool *pool = NULL;
+
+	G_LOCK(render_pool);
+	if (--render_pool_users == 0)
+	{
+		pool = render_pool;
+		render_pool = NULL;
+	}
+	G_UNLOCK(render_pool);
+
+	workpool_destroy(pool);
+}
 
 GtkWidget * vga_text_new(void)
 {
 	return GTK_WIDGET(g_object_new(vga_get_type(), NULL));
 }
 
+/*
+ * Build the attribute run list for a line of @cols cells into @runs.
+ * Returns the number of runs (always at least 1).
+ */
+static int
+vga_build_runs(const vga_charcell *cells, int cols, vga_attr_run *runs)
+{
+	int col, n;
+
+	n = 0;
+	runs[0].start = 0;
+	runs[0].attr = cells[0].attr;
+	for (col = 1; col < cols; col++)
+	{
+		if (cells[col].attr != runs[n].attr)
+		{
+			runs[n].len = col - runs[n].start;
+			n++;
+			runs[n].start = col;
+			runs[n].attr = cells[col].attr;
+		}
+	}
+	runs[n].len = cols - runs[n].start;
+
+	return n + 1;
+}
+
+/* Get the runs for a line of video_buf, rebuilding them if stale */
+static vga_attr_run *
+vga_row_runs(VGAText *vga, VGAScreen *scr, int row, int *n_runs)
+{
+	vga_attr_run *runs;
+
+	runs = scr->runs + row * vga->pvt->cols;
+	if (scr->run_count[row] == 0)
+		scr->run_count[row] = vga_build_runs(
+				scr->video_buf + row * vga->pvt->cols,
+				vga->pvt->cols, runs);
+	*n_runs = scr->run_count[row];
+	return runs;
+}
+
+/* Make a line consist of a single run of @attr */
+static void
+vga_runs_set_uniform(VGAText *vga, VGAScreen *scr, int row, guchar attr)
+{
+	vga_attr_run *runs;
+
+	runs = scr->runs + row * vga->pvt->cols;
+	runs[0].start = 0;
+	runs[0].len = vga->pvt->cols;
+	runs[0].attr = attr;
+	scr->run_count[row] = 1;
+}
+
+/* Append a run to @runs, merging it with the last one if possible */
+static inline int
+vga_runs_append(vga_attr_run *runs, int n, int start, int len, guchar attr)
+{
+	if (n > 0 && runs[n-1].attr == attr)
+	{
+		runs[n-1].len += len;
+		return n;
+	}
+	runs[n].start = start;
+	runs[n].len = len;
+	runs[n].attr = attr;
+	return n + 1;
+}
+
+/*
+ * Record that cells [col, col + len) of @row now all have attribute
+ * @attr.  Only the runs overlapping the span are touched, so on a line
+ * with a uniform attribute this is a couple of compares.
+ */
+static void
+vga_runs_set_span(VGAText *vga, VGAScreen *scr, int row, int col, int len,
+		  guchar attr)
+{
+	vga_attr_run *runs, *tmp;
+	int i, n, m, end, r_end;
+
+	if (len <= 0)
+		return;
+	n = scr->run_count[row];
+	if (n == 0)
+		return;		/* Stale anyway, rebuilt on next use */
+
+	runs = scr->runs + row * vga->pvt->cols;
+	end = col + len;
+
+	/* Find the first run that ends past the start of the span */
+	for (i = 0; i < n; i++)
+		if (runs[i].start + runs[i].len > col)
+			break;
+
+	/* Common case: span lies within a run of the same attribute */
+	if (runs[i].attr == attr && runs[i].start + runs[i].len >= end)
+		return;
+
+	tmp = vga->pvt->run_tmp;
+	memcpy(tmp, runs, i * sizeof(vga_attr_run));
+	m = i;
+	if (runs[i].start < col)
+		m = vga_runs_append(tmp, m, runs[i].start,
+				    col - runs[i].start, runs[i].attr);
+	m = vga_runs_append(tmp, m, col, len, attr);
+	for (; i < n; i++)
+	{
+		r_end = runs[i].start + runs[i].len;
+		if (r_end <= end)
+			continue;
+		m = vga_runs_append(tmp, m, MAX(runs[i].start, end),
+				    r_end - MAX(runs[i].start, end),
+				    runs[i].attr);
+	}
+
+	memcpy(runs, tmp, m * sizeof(vga_attr_run));
+	scr->run_count[row] = m;
+}
+
+/*
+ * Add @delta to the usage count of every glyph in a rectangle of
+ * video_buf.  Only needed for cells that are about to be overwritten
+ * or duplicated wholesale; single cells are counted inline.
+ */
+static void
+vga_glyphs_count(VGAText *vga, VGAScreen *scr, int top_left_x,
+		 int top_left_y, int cols, int rows, int delta)
+{
+	vga_charcell *cell;
+	int x, y;
+
+	if (scr->glyph_count_stale)
+		return;
+
+	for (y = top_left_y; y < top_left_y + rows; y++)
+	{
+		cell = scr->video_buf + y * vga->pvt->cols + top_left_x;
+		for (x = 0; x < cols; x++)
+			scr->glyph_count[cell[x].c] += delta;
+	}
+}
+
+/* Count glyph usage and rebuild the line maps from scratch */
+static void
+vga_glyphs_rebuild(VGAText *vga, VGAScreen *scr)
+{
+	vga_charcell *cell;
+	guint32 *map;
+	int x, y;
+
+	memset(scr->glyph_count, 0, sizeof(scr->glyph_count));
+	cell = scr->video_buf;
+	for (y = 0; y < vga->pvt->rows; y++)
+	{
+		map = ROW_GLYPH_MAP(scr, y);
+		memset(map, 0, sizeof(guint32) * VGA_GLYPH_MAP_WORDS);
+		for (x = 0; x < vga->pvt->cols; x++, cell++)
+		{
+			scr->glyph_count[cell->c]++;
+			GLYPH_MAP_SET(map, cell->c);
+		}
+	}
+	scr->glyph_count_stale = FALSE;
+}
+
+/*
+ * Glyphs @first..@last of our font were changed.  Dirty only the cells
+ * that show one of them, so e.g. animating a few custom glyphs redraws
+ * a handful of cells rather than the whole screen.  Consoles that
+ * aren't shown are checked over when they are shown again anyway.
+ */
+static void
+vga_font_glyphs_changed(VGAFont *font, guint first, guint last,
+			gpointer data)
+{
+	VGAText *vga = VGA_TEXT(data);
+	VGAScreen *vis = vga->pvt->vis;
+	vga_charcell *cell;
+	guint32 *map;
+	guint c;
+	int x, y;
+
+	vga->pvt->font_serial++;
+
+	/* A new font size means everything is redrawn anyway */
+	if (vga_update_surface(vga))
+		return;
+
+	/* The secondary buffer is written raw, so we know nothing about it */
+	if (vga->pvt->render_sec_buf)
+	{
+		vga_mark_cells_dirty(vga, vis, 0, 0, vga->pvt->cols,
+				     vga->pvt->rows);
+		return;
+	}
+
+	if (vis->glyph_count_stale)
+		vga_glyphs_rebuild(vga, vis);
+
+	for (c = first; c <= last; c++)
+		if (vis->glyph_count[c] > 0)
+			break;
+	if (c > last)
+		return;		/* Not on screen */
+
+	for (y = 0; y < vga->pvt->rows; y++)
+	{
+		map = ROW_GLYPH_MAP(vis, y);
+		for (c = first; c <= last; c++)
+			if (GLYPH_MAP_TEST(map, c))
+				break;
+		if (c > last)
+			continue;
+
+		/* Rescan the line, tightening up its map while we're at it */
+		memset(map, 0, sizeof(guint32) * VGA_GLYPH_MAP_WORDS);
+		cell = vis->video_buf + y * vga->pvt->cols;
+		for (x = 0; x < vga->pvt->cols; x++)
+		{
+			GLYPH_MAP_SET(map, cell[x].c);
+			if (cell[x].c >= first && cell[x].c <= last)
+				vga_mark_cells_dirty(vga, vis, x, y, 1, 1);
+		}
+	}
+}
+
+/*
+ * Switch to listening to @font for glyph changes.  Shared fonts can't
+ * change, so there is no point having every widget connect to them.
+ */
+static void
+vga_watch_font(VGAText *vga, VGAFont *old_font, VGAFont *font)
+{
+	if (old_font != NULL)
+		g_signal_handlers_disconnect_by_func(old_font,
+				G_CALLBACK(vga_font_glyphs_changed), vga);
+	if (font != NULL && !vga_font_is_shared(font))
+		g_signal_connect(font, "glyphs-changed",
+				 G_CALLBACK(vga_font_glyphs_changed), vga);
+}
+
 static void
 vga_invalidate_cells(VGAText * vga, glong col_start, gint col_count,
 			glong row_start, gint row_count)
@@ -152,10 +652,10 @@ vga_invalidate_cells(VGAText * vga, glong col_start, gint col_count,
 
 	/* Convert the col/row start and end to pixel values by multiplying
 	 * by the size of a character cell. */
-	rect.x = col_start * vga->pvt->font->width;
-	rect.width = col_count * vga->pvt->font->width;
-	rect.y = row_start * vga->pvt->font->height;
-	rect.height = row_count * vga->pvt->font->height;
+	rect.x = col_start * CELL_WIDTH(vga);
+	rect.width = col_count * CELL_WIDTH(vga);
+	rect.y = (row_start - vga->pvt->view_top) * CELL_HEIGHT(vga);
+	rect.height = row_count * CELL_HEIGHT(vga);
 
 	gdk_window_invalidate_rect(widget->window, &rect, TRUE);
 }
@@ -166,6 +666,229 @@ vga_invalidate_all(VGAText *vga)
 	vga_invalidate_cells(vga, 0, vga->cols, 0, vga->rows);
 }
 
+#define ARENA_ALIGN(n)	(((n) + 15) & ~((gsize) 15))
+
+/* Number of lines of a rows high grid that get rendered, see band_rows */
+static int
+vga_band_rows(VGAText *vga, int rows)
+{
+	if (vga->pvt->canvas_rows == 0)
+		return rows;
+	return MIN(rows, VGA_CANVAS_BAND_ROWS(vga->pvt->view_rows));
+}
+
+/* Put the band around the view */
+static int
+vga_band_top(VGAText *vga)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+
+	return CLAMP(pvt->view_top - (pvt->band_rows - pvt->view_rows) / 2,
+		     0, pvt->rows - pvt->band_rows);
+}
+
+/*
+ * (Re)allocate the arena for a cols x rows grid of @n_screens consoles
+ * at the current cell size and lay out the screen buffers and surfaces
+ * in it.  What fits of the old contents is kept, anchored at the top
+ * left, and everything is marked dirty.  On failure nothing is changed.
+ */
+static gboolean
+vga_alloc_screen(VGAText *vga, int cols, int rows, int n_screens)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+	gsize surface_len, cells_len, runs_len, key_len, screen_len, len;
+	int width, height, stride, y, i, copy_cols, copy_rows, band_rows;
+	int scr_i, vis_i;
+	guchar *arena, *p;
+	VGAScreen *screens, *scr, *old;
+	vga_charcell *sec_buf;
+
+	band_rows = vga_band_rows(vga, rows);
+	width = CELL_WIDTH(vga) * cols;
+	height = CELL_HEIGHT(vga) * band_rows;
+	stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, width);
+	if (stride < 0)
+		return FALSE;
+
+	surface_len = ARENA_ALIGN((gsize) stride * height);
+	cells_len = ARENA_ALIGN(sizeof(vga_charcell) * cols * rows);
+	runs_len = ARENA_ALIGN(sizeof(vga_attr_run) * cols * rows);
+	key_len = sizeof(vga_charcell) * cols + sizeof(vga_row_key_extra);
+	screen_len = surface_len + cells_len + runs_len +
+		ARENA_ALIGN(sizeof(guint64) * rows) +
+		ARENA_ALIGN(key_len * rows) +
+		ARENA_ALIGN(sizeof(char) * cols * rows) +
+		ARENA_ALIGN(sizeof(gboolean) * rows) +
+		ARENA_ALIGN(sizeof(guint16) * rows) +
+		ARENA_ALIGN(sizeof(guint32) * VGA_GLYPH_MAP_WORDS * rows) +
+		ARENA_ALIGN(sizeof(VGASnapRow *) * rows);
+	len = ARENA_ALIGN(sizeof(VGAScreen) * n_screens) +
+		screen_len * n_screens + cells_len +
+		ARENA_ALIGN(key_len) +
+		ARENA_ALIGN(sizeof(vga_attr_run) * cols *
+			    (pvt->workers->n_threads + 1)) +
+		ARENA_ALIGN(sizeof(int) * rows);
+
+	arena = g_try_malloc0(len);
+	if (arena == NULL)
+		return FALSE;
+
+	p = arena;
+	screens = (VGAScreen *) p;
+	p += ARENA_ALIGN(sizeof(VGAScreen) * n_screens);
+	for (i = 0; i < n_screens; i++)
+	{
+		scr = &screens[i];
+		scr->surface_buf = cairo_image_surface_create_for_data(p,
+				CAIRO_FORMAT_RGB24, width, height, stride);
+		p += surface_len;
+		scr->video_buf = (vga_charcell *) p;
+		p += cells_len;
+		scr->runs = (vga_attr_run *) p;
+		p += runs_len;
+		scr->row_hash = (guint64 *) p;		/* All unknown */
+		p += ARENA_ALIGN(sizeof(guint64) * rows);
+		scr->row_keys = p;
+		p += ARENA_ALIGN(key_len * rows);
+		scr->dirty_buf = (char *) p;
+		p += ARENA_ALIGN(sizeof(char) * cols * rows);
+		scr->dirty_line_buf = (gboolean *) p;
+		p += ARENA_ALIGN(sizeof(gboolean) * rows);
+		scr->run_count = (guint16 *) p;		/* All stale */
+		p += ARENA_ALIGN(sizeof(guint16) * rows);
+		scr->row_glyphs = (guint32 *) p;
+		p += ARENA_ALIGN(sizeof(guint32) * VGA_GLYPH_MAP_WORDS * rows);
+		scr->snap_rows = (VGASnapRow **) p;	/* Nothing shared */
+		p += ARENA_ALIGN(sizeof(VGASnapRow *) * rows);
+		scr->cursor_visible = TRUE;
+	}
+	sec_buf = (vga_charcell *) p;
+	p += cells_len;
+
+	scr_i = vis_i = 0;
+	if (pvt->arena != NULL)
+	{
+		copy_cols = MIN(cols, pvt->cols);
+		copy_rows = MIN(rows, pvt->rows);
+		for (i = 0; i < MIN(n_screens, pvt->n_screens); i++)
+		{
+			old = &pvt->screens[i];
+			scr = &screens[i];
+			for (y = 0; y < copy_rows; y++)
+				memcpy(scr->video_buf + y * cols,
+				       old->video_buf + y * pvt->cols,
+				       sizeof(vga_charcell) * copy_cols);
+			scr->cursor_visible = old->cursor_visible;
+			scr->cursor_x = MIN(old->cursor_x, cols - 1);
+			scr->cursor_y = MIN(old->cursor_y, rows - 1);
+		}
+		for (y = 0; y < copy_rows; y++)
+			memcpy(sec_buf + y * cols, pvt->sec_buf + y * pvt->cols,
+			       sizeof(vga_charcell) * copy_cols);
+
+		scr_i = MIN(pvt->scr - pvt->screens, n_screens - 1);
+		vis_i = MIN(pvt->vis - pvt->screens, n_screens - 1);
+
+		/* The old surfaces draw from the old arena */
+		for (i = 0; i < pvt->n_screens; i++)
+		{
+			cairo_surface_destroy(pvt->screens[i].surface_buf);
+			vga_rows_changed(&pvt->screens[i], 0, pvt->rows);
+		}
+	}
+	g_free(pvt->arena);
+
+	pvt->arena = arena;
+	pvt->screens = screens;
+	pvt->n_screens = n_screens;
+	pvt->scr = &screens[scr_i];
+	pvt->vis = &screens[vis_i];
+	pvt->sec_buf = sec_buf;
+	pvt->row_key = p;
+	pvt->row_key_len = key_len;
+	p += ARENA_ALIGN(key_len);
+	pvt->run_tmp = (vga_attr_run *) p;
+	p += ARENA_ALIGN(sizeof(vga_attr_run) * cols *
+			 (pvt->workers->n_threads + 1));
+	pvt->render_jobs = (int *) p;
+
+	pvt->cols = vga->cols = cols;
+	pvt->rows = vga->rows = rows;
+	pvt->video_buf_len = sizeof(vga_charcell) * cols * rows;
+	if (pvt->canvas_rows == 0)
+		pvt->view_rows = rows;
+	pvt->view_rows = MIN(pvt->view_rows, rows);
+	pvt->view_top = CLAMP(pvt->view_top, 0, rows - pvt->view_rows);
+	pvt->band_rows = band_rows;
+	pvt->band_top = vga_band_top(vga);
+	rowcache_reset(pvt->row_cache, key_len,
+		       sizeof(guint32) * CELL_WIDTH(vga) * cols,
+		       CELL_HEIGHT(vga));
+
+	for (i = 0; i < n_screens; i++)
+	{
+		vga_glyphs_rebuild(vga, &screens[i]);
+		vga_mark_cells_dirty(vga, &screens[i], 0, 0, cols, rows);
+	}
+
+	return TRUE;
+}
+
+/*
+ * Make sure the surface buffer is the right size for the current font
+ * and scale, re-laying out the screen (and re-rendering everything) if
+ * it isn't.  Returns TRUE if the size changed.
+ */
+static gboolean
+vga_update_surface(VGAText *vga)
+{
+	int width, height;
+
+	width = CELL_WIDTH(vga) * vga->pvt->cols;
+	height = CELL_HEIGHT(vga) * vga_band_rows(vga, vga->pvt->rows);
+	if (vga->pvt->vis != NULL &&
+	    cairo_image_surface_get_width(vga->pvt->vis->surface_buf) == width &&
+	    cairo_image_surface_get_height(vga->pvt->vis->surface_buf) == height)
+		return FALSE;
+
+	if (!vga_alloc_screen(vga, vga->pvt->cols, vga->pvt->rows,
+			      vga->pvt->n_screens))
+		return FALSE;
+	gtk_widget_queue_resize(GTK_WIDGET(vga));
+
+	return TRUE;
+}
+
+/*
+ * Resize the grid for a cols x view_rows view and let everyone know
+ * about it.  In canvas mode the grid keeps its canvas height.
+ */
+static gboolean
+vga_resize_grid(VGAText *vga, int cols, int view_rows)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+	int rows;
+
+	pvt->view_rows = view_rows;
+	rows = pvt->canvas_rows ? MAX(pvt->canvas_rows, view_rows) : view_rows;
+	if (cols == pvt->cols && rows == pvt->rows)
+	{
+		/* Same grid, but the band may have to follow the view */
+		pvt->view_top = MIN(pvt->view_top, rows - view_rows);
+		vga_update_surface(vga);
+		return TRUE;
+	}
+	if (!vga_alloc_screen(vga, cols, rows, pvt->n_screens))
+		return FALSE;
+
+	g_signal_emit(G_OBJECT(vga),
+		((VGATextClass *) VGA__GET_CLASS(vga))->grid_resized_signal,
+		0, cols, rows);
+
+	return TRUE;
+}
+
 /* FIXME: This doesn't seem to be used by anything */
 /* Scroll a rectangular region up or down by a fixed number of lines. */
 static void
@@ -182,7 +905,7 @@ vga_scroll_region(VGAText *vga,
 	if (row == 0 && count == vga->rows)
 	{
 		widget = GTK_WIDGET(vga);
-		gdk_window_scroll(widget->window, 0, delta * vga->pvt->font->height);
+		gdk_window_scroll(widget->window, 0, delta * CELL_HEIGHT(vga));
 		repaint = FALSE;
 	}
 
@@ -264,6 +987,7 @@ vga_realize(GtkWidget *widget)
 	attributes.colormap = gtk_widget_get_colormap(widget);
 	attributes.event_mask = gtk_widget_get_events(widget) |
 				GDK_EXPOSURE_MASK |
+				GDK_VISIBILITY_NOTIFY_MASK |
 				GDK_BUTTON_PRESS_MASK |
 				GDK_BUTTON_RELEASE_MASK |
 				GDK_POINTER_MOTION_MASK |
@@ -381,7 +1105,7 @@ vga_paint_cursor(VGAText *vga, VGAFont * font, gboolean state,
 	cr = gdk_cairo_create(GTK_WIDGET(vga)->window);
 
 	/* Set clip region for speed */
-	cairo_rectangle(cr, x, y, font->width, font->height / 8);
+	cairo_rectangle(cr, x, y, CELL_WIDTH(vga), CELL_HEIGHT(vga) / 8);
 	cairo_clip(cr);
 
 	if (state)
@@ -390,52 +1114,340 @@ vga_paint_cursor(VGAText *vga, VGAFont * font, gboolean state,
 	else
 		gdk_cairo_set_source_color(cr,
 			vga_palette_get_color(vga->pvt->pal, 0));
-	cairo_rectangle(cr, x, y, font->width, font->height / 8);
+	cairo_rectangle(cr, x, y, CELL_WIDTH(vga), CELL_HEIGHT(vga) / 8);
 	cairo_fill(cr);
 	cairo_destroy(cr);
 #endif
 }
 
 /*
- * For regions of VGA buffer that are 'dirty', render them onto the
- * Cairo off-screen surface buffer.  This function is invoked
- * as a periodic timer.
+ * Build the row cache key of line @y as it would be rendered right now:
+ * its cells plus everything else that decides what they look like.
+ * The key is left in row_key and its hash returned (never 0).  @blinks
+ * is set if the line has text that needs the blink timer.
  */
-static gboolean
-vga_render_buf(gpointer data)
+static guint64
+vga_row_key(VGAText *vga, int y, gboolean *blinks)
 {
-	int y;
-	GtkWidget *widget = (GtkWidget *) data;
-	VGAText *vga = VGA_TEXT(widget);
+	struct _VGATextPrivate *pvt = vga->pvt;
+	vga_row_key_extra extra;
+	vga_charcell *line;
+	guint64 hash;
+	int x;
+
+	if (pvt->render_sec_buf)
+		line = pvt->sec_buf + y * pvt->cols;
+	else
+		line = pvt->vis->video_buf + y * pvt->cols;
+
+	memset(&extra, 0, sizeof(extra));
+	extra.font = pvt->font;
+	extra.font_serial = pvt->font_serial;
+	extra.pal_version = vga_palette_get_version(pvt->pal);
+	extra.blink = VGA_ROW_NO_BLINK;
+	for (x = 0; x < pvt->cols; x++)
+	{
+		if (GETBLINK(line[x].attr))
+		{
+			extra.blink = pvt->icecolor ? VGA_ROW_ICECOLOR :
+				pvt->blink_state;
+			break;
+		}
+	}
+	*blinks = extra.blink != VGA_ROW_NO_BLINK && !pvt->icecolor;
+
+	memcpy(pvt->row_key, line, sizeof(vga_charcell) * pvt->cols);
+	memcpy(pvt->row_key + sizeof(vga_charcell) * pvt->cols, &extra,
+	       sizeof(extra));
+	hash = rowcache_hash(pvt->row_key, pvt->row_key_len,
+			     ROWCACHE_HASH_INIT);
+
+	return hash ? hash : 1;
+}
+
+/* The key of what line @y of @scr shows on its surface */
+#define VGA_ROW_KEY(vga, scr, y) \
+	((scr)->row_keys + (gsize) (y) * (vga)->pvt->row_key_len)
+
+/* Remember that line @y now shows the key in row_key, hashing to @hash */
+static void
+vga_set_row_hash(VGAText *vga, VGAScreen *scr, int y, guint64 hash)
+{
+	scr->row_hash[y] = hash;
+	memcpy(VGA_ROW_KEY(vga, scr, y), vga->pvt->row_key,
+	       vga->pvt->row_key_len);
+}
+
+/* Forget what lines are on the surface and have them rendered again */
+static void
+vga_forget_rows(VGAText *vga, VGAScreen *scr, int top_y, int rows)
+{
+	memset(scr->row_hash + top_y, 0, sizeof(guint64) * rows);
+	vga_mark_cells_dirty(vga, scr, 0, top_y, vga->pvt->cols, rows);
+}
+
+/*
+ * Add cells of line @y to the damage of this render pass, if it is in
+ * view.  GdkRegion merges touching and overlapping rectangles, so a
+ * whole screen of changed lines ends up as a single band.
+ */
+static void
+vga_queue_draw_cells(VGAText *vga, int x, int y, int cols)
+{
+	GdkRectangle rect;
+
+	if (y < vga->pvt->view_top ||
+	    y >= vga->pvt->view_top + vga->pvt->view_rows)
+		return;
+
+	rect.x = x * CELL_WIDTH(vga);
+	rect.y = (y - vga->pvt->view_top) * CELL_HEIGHT(vga);
+	rect.width = cols * CELL_WIDTH(vga);
+	rect.height = CELL_HEIGHT(vga);
+	gdk_region_union_with_rect(vga->pvt->damage, &rect);
+}
+
+/*
+ * Queue one expose for everything the render pass changed.  This is
+ * what makes a new frame.
+ */
+static void
+vga_flush_damage(VGAText *vga)
+{
+	GtkWidget *widget = GTK_WIDGET(vga);
+
+	if (gdk_region_empty(vga->pvt->damage))
+		return;
+
+	gdk_window_invalidate_region(widget->window, vga->pvt->damage, TRUE);
+	gdk_region_destroy(vga->pvt->damage);
+	vga->pvt->damage = gdk_region_new();
+	vga->pvt->frame++;
+}
+
+typedef struct {
+	guint frame;
+	VGAFrameFunc func;
+	gpointer data;
+} VGAFrameWait;
+
+/* Frame numbers wrap, so compare them like this rather than with <= */
+#define FRAME_REACHED(current, frame)	((gint) ((current) - (frame)) >= 0)
+
+/* Call whoever was waiting for a frame that has been painted by now */
+static void
+vga_run_frame_waits(VGAText *vga)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+	VGAFrameWait *wait;
+
+	while (pvt->frame_waits != NULL)
+	{
+		wait = pvt->frame_waits->data;
+		if (!FRAME_REACHED(pvt->presented_frame, wait->frame))
+			break;
+		pvt->frame_waits = g_slist_delete_link(pvt->frame_waits,
+						       pvt->frame_waits);
+		wait->func(vga, pvt->presented_frame, wait->data);
+		g_free(wait);
+	}
+}
+
+/* Everything queued so far has been painted */
+static void
+vga_frame_presented(VGAText *vga)
+{
+	vga->pvt->presented_frame = vga->pvt->frame;
+	vga_run_frame_waits(vga);
+}
+
+/* Render worker job: the dirty cells of one line */
+static void
+vga_render_job(void *data, int job, int worker)
+{
+	VGAText *vga = data;
+	struct _VGATextPrivate *pvt = vga->pvt;
+	int x, y, start;
+	char *dirty;
+
+	y = pvt->render_jobs[job];
+	dirty = pvt->vis->dirty_buf + y * pvt->cols;
+	x = 0;
+	while (x < pvt->cols) {
+		if (!dirty[x]) {
+			x++;
+			continue;
+		}
+		start = x;
+		while (x < pvt->cols && dirty[x])
+			dirty[x++] = 0;	/* Mark as clean */
+
+		vga_paint_row(vga, pvt->render_atlas, pvt->render_pixels,
+			      pvt->render_stride, y, start, x - start,
+			      pvt->run_tmp + worker * pvt->cols);
+	}
+	pvt->vis->dirty_line_buf[y] = 0;
+}
+
+/*
+ * Rasterize the lines in render_jobs on the render workers.  Every line
+ * is a separate job writing only its own part of the surface, and
+ * everything they read is left alone until they are done.
+ */
+static void
+vga_render_jobs_parallel(VGAText *vga, int n_jobs)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+	VGAScreen *vis = pvt->vis;
+	int i, n_runs;
+
+	pvt->render_atlas = vga_font_get_atlas(pvt->font, pvt->scale,
+				pvt->nine_dot ? VGA_ATLAS_NINE_DOT : 0);
+	if (pvt->render_atlas == NULL)
+		return;
+
+	/* Bring the runs up to date first, since that writes to them */
+	if (!pvt->render_sec_buf)
+		for (i = 0; i < n_jobs; i++)
+			vga_row_runs(vga, vis, pvt->render_jobs[i], &n_runs);
+
+	cairo_surface_flush(vis->surface_buf);
+	pvt->render_pixels = (guint32 *)
+		cairo_image_surface_get_data(vis->surface_buf);
+	pvt->render_stride =
+		cairo_image_surface_get_stride(vis->surface_buf) / 4;
+
+	workpool_run(pvt->workers, n_jobs, vga_render_job, vga);
+
+	for (i = 0; i < n_jobs; i++)
+	{
+		cairo_surface_mark_dirty_rectangle(vis->surface_buf, 0,
+			(pvt->render_jobs[i] - pvt->band_top) * CELL_HEIGHT(vga),
+			pvt->cols * CELL_WIDTH(vga), CELL_HEIGHT(vga));
+		vga_queue_draw_cells(vga, 0, pvt->render_jobs[i], pvt->cols);
+	}
+}
+
+/*
+ * Render the dirty cells of lines first..last onto the surface buffer.
+ * A line that hashes the same as what the surface already shows is
+ * left alone, and one found in the row cache is copied in whole.  The
+ * rest are rasterized, spread over the render workers if there are
+ * enough of them to be worth it.
+ */
+static void
+vga_render_rows(VGAText *vga, int first, int last)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+	VGAScreen *vis = pvt->vis;
+	int i, x, y, start, stride, n_jobs;
+	char *dirty;
+	guchar *line;
+	guint64 hash;
+	gboolean blinks;
+
+	stride = cairo_image_surface_get_stride(vis->surface_buf);
+
+	n_jobs = 0;
+	for (y = first; y <= last; y++) {
+		if (!vis->dirty_line_buf[y])
+			continue;
+
+		dirty = vis->dirty_buf + y * pvt->cols;
+		line = cairo_image_surface_get_data(vis->surface_buf) +
+			(y - pvt->band_top) * CELL_HEIGHT(vga) * stride;
+
+		hash = vga_row_key(vga, y, &blinks);
+		if (hash == vis->row_hash[y] &&
+		    memcmp(pvt->row_key, VGA_ROW_KEY(vga, vis, y),
+			   pvt->row_key_len) == 0)
+		{
+			/* Changed back, or "changed" to the same thing */
+			memset(dirty, 0, pvt->cols);
+			vis->dirty_line_buf[y] = 0;
+			continue;
+		}
+
+		cairo_surface_flush(vis->surface_buf);
+		if (rowcache_fetch(pvt->row_cache, hash, pvt->row_key,
+				   line, stride))
+		{
+			cairo_surface_mark_dirty_rectangle(vis->surface_buf,
+				0, (y - pvt->band_top) * CELL_HEIGHT(vga),
+				pvt->cols * CELL_WIDTH(vga), CELL_HEIGHT(vga));
+			memset(dirty, 0, pvt->cols);
+			vis->dirty_line_buf[y] = 0;
+			vga_set_row_hash(vga, vis, y, hash);
+			vga_queue_draw_cells(vga, 0, y, pvt->cols);
+			continue;
+		}
+
+		pvt->render_jobs[n_jobs++] = y;
+	}
+
+	if (n_jobs >= VGA_PARALLEL_MIN_ROWS && pvt->workers->n_threads > 0)
+		vga_render_jobs_parallel(vga, n_jobs);
+	else for (i = 0; i < n_jobs; i++) {
+		y = pvt->render_jobs[i];
+		dirty = vis->dirty_buf + y * pvt->cols;
+
+		/* Render each span of dirty cells on the line */
+		x = 0;
+		while (x < pvt->cols) {
+			if (!dirty[x]) {
+				x++;
+				continue;
+			}
+			start = x;
+			while (x < pvt->cols && dirty[x])
+				dirty[x++] = 0;	/* Mark as clean */
+
+			vga_render_region(vga, start, y, x - start, 1);
+			vga_queue_draw_cells(vga, start, y, x - start);
+		}
+		vis->dirty_line_buf[y] = 0;
+	}
+
+	/* The clean cells were already right, so the lines are whole */
+	for (i = 0; i < n_jobs; i++) {
+		y = pvt->render_jobs[i];
+		line = cairo_image_surface_get_data(vis->surface_buf) +
+			(y - pvt->band_top) * CELL_HEIGHT(vga) * stride;
+		hash = vga_row_key(vga, y, &blinks);
+		rowcache_store(pvt->row_cache, hash, pvt->row_key, line, stride);
+		vga_set_row_hash(vga, vis, y, hash);
+
+		if (blinks && pvt->blink_timeout_id == -1)
+			vga_start_blink_timer(vga);
+	}
+}
+
+/*
+ * For regions of VGA buffer that are 'dirty', render them onto the
+ * Cairo off-screen surface buffer.  This function is invoked
+ * as a periodic timer.
+ *
+ * Only lines in the band are rendered, the visible ones first.
+ */
+static gboolean
+vga_render_buf(gpointer data)
+{
+	VGAText *vga;
 
 	if (!GTK_WIDGET_REALIZED(GTK_WIDGET(data)))
 		return TRUE;
 	
 	vga = VGA_TEXT(data);
+	if (!vga->pvt->shown)
+		return TRUE;
 
-	for (y = 0; y < vga->pvt->rows; y++) {
-		if (vga->pvt->dirty_line_buf[y]) {
-			/* For now, just to get this working, we ignore the per-cell
-			 * dirty buf and just handle the entire line.  Wasteful but
-			 * easy */
-			vga_render_region(vga, 0, y, vga->pvt->cols, 1);
-			/* Mark as clean */
-			vga->pvt->dirty_line_buf[y] = 0;
-			/* Now paint that region.. not sure if we should
-			 * be doing this here as it could slow things down */
-			//vga_paint_region(widget, 0, y, vga->pvt->cols, 1);
-			//
-			/* 
-			 * Invalidate the region to queue up an expose event
-			 * to the widget.  This is basically the same as doing
-			 * a gdk_window_invalidate_rect()
-			 */
-			gtk_widget_queue_draw_area(widget, 0,
-					y * vga->pvt->font->height,
-					vga->pvt->font->width * vga->pvt->cols,
-					vga->pvt->font->height);
-		}
-	}
+	vga_render_rows(vga, vga->pvt->view_top,
+			vga->pvt->view_top + vga->pvt->view_rows - 1);
+	if (vga->pvt->band_rows > vga->pvt->view_rows &&
+	    g_atomic_int_get(&vga->pvt->backlog) < VGA_FLOOD_BACKLOG)
+		vga_render_rows(vga, vga->pvt->band_top,
+				vga->pvt->band_top + vga->pvt->band_rows - 1);
+	vga_flush_damage(vga);
 
 	/* Return TRUE to keep timer enabled */
 	return TRUE;
@@ -445,23 +1457,25 @@ static gboolean
 vga_blink_cursor(gpointer data)
 {
 	VGAText * vga;
+	VGAScreen * vis;
 
 	if (!GTK_WIDGET_REALIZED(GTK_WIDGET(data)))
 		return TRUE;
 	
 	vga = VGA_TEXT(data);
+	vis = vga->pvt->vis;
 
 	/* Don't do anything if we're already how we want it */
-	if (!vga->pvt->cursor_visible && !vga->pvt->cursor_blink_state)
+	if (!vis->cursor_visible && !vga->pvt->cursor_blink_state)
 		return TRUE;
 	
 	vga->pvt->cursor_blink_state = !vga->pvt->cursor_blink_state;
 	vga_paint_cursor(vga, vga->pvt->font,
 				vga->pvt->cursor_blink_state,
-				vga->pvt->cursor_x * vga->pvt->font->width,
-				(vga->pvt->cursor_y + 1) *
-					vga->pvt->font->height -
-					(vga->pvt->font->height / 8) );
+				vis->cursor_x * CELL_WIDTH(vga),
+				(vis->cursor_y - vga->pvt->view_top + 1) *
+					CELL_HEIGHT(vga) -
+					(CELL_HEIGHT(vga) / 8) );
 
 	return TRUE;
 
@@ -478,9 +1492,10 @@ vga_blink_cursor(gpointer data)
 static gboolean
 vga_blink_char(gpointer data)
 {
-	int x, y;
+	int i, n, y;
 	GtkWidget * widget;
 	VGAText * vga;
+	vga_attr_run *runs;
 
 	widget = GTK_WIDGET(data);
 	if (!GTK_WIDGET_REALIZED(widget))
@@ -493,22 +1508,24 @@ vga_blink_char(gpointer data)
 	
 	vga->pvt->blink_state = !vga->pvt->blink_state;
 
-	for (y = 0; y < vga->pvt->rows; y++)
+	/* Lines outside the band are redrawn when it gets to them anyway */
+	for (y = vga->pvt->band_top;
+	     y < vga->pvt->band_top + vga->pvt->band_rows; y++)
 	{
-		for (x = 0; x < vga->pvt->cols; x++)
+		runs = vga_row_runs(vga, vga->pvt->vis, y, &n);
+		for (i = 0; i < n; i++)
 		{
 			/* 
 			 * If you encounter a blink bit, refresh it
 			 * and the rest of the line, then move on to the
 			 * next line
 			 */
-			if (GETBLINK(vga->pvt->video_buf[y*vga->pvt->cols + x].attr))
+			if (GETBLINK(runs[i].attr))
 			{
-				g_print("blink bit encountered on line %d\n", y);
-				vga_mark_region_dirty(vga, x, y,
-				//vga_render_region(widget, x, y,
-							vga->pvt->cols - x,
-							1);
+				vga_mark_cells_dirty(vga, vga->pvt->vis,
+						runs[i].start, y,
+						vga->pvt->cols - runs[i].start,
+						1);
 				break;
 			}
 		}
@@ -521,24 +1538,116 @@ vga_blink_char(gpointer data)
 static
 void vga_start_blink_timer(VGAText *vga)
 {
+	if (!vga->pvt->shown)
+	{
+		vga->pvt->blink_paused = TRUE;
+		return;
+	}
+
 	vga->pvt->blink_timeout_id = g_timeout_add(BLINK_PERIOD_MS,
 			vga_blink_char, vga);
 }
 
 /*
- * vga_set_textattr:
- * @vga: VGAtext object
- * @textattr: VGA text attribute byte
- *
- * Set the VGAText's graphics context to use the text attribute given using
- * the current VGA palette.  May not actually result in a call to the
- * graphics server, since redundant calls may be optimized out.
+ * Work out whether the widget can be seen, and if that changed, stop
+ * or restart rendering and the timers.  Coming back into view renders
+ * everything that changed in the meantime right away, so the expose
+ * that follows shows the current screen.
  */
 static void
-vga_set_textattr(VGAText *vga, guchar textattr)
+vga_update_shown(VGAText *vga)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+	gboolean shown;
+
+	shown = GTK_WIDGET_MAPPED(vga) &&
+		pvt->visibility != GDK_VISIBILITY_FULLY_OBSCURED;
+	if (shown == pvt->shown)
+		return;
+	pthread_mutex_lock(&pvt->show_lock);
+	g_atomic_int_set(&pvt->shown, shown);
+	pthread_cond_signal(&pvt->show_cond);
+	pthread_mutex_unlock(&pvt->show_lock);
+
+	if (!shown)
+	{
+		if (pvt->cursor_timeout_id != -1)
+			g_source_remove(pvt->cursor_timeout_id);
+		pvt->cursor_timeout_id = -1;
+		if (pvt->blink_timeout_id != -1)
+		{
+			g_source_remove(pvt->blink_timeout_id);
+			pvt->blink_timeout_id = -1;
+			pvt->blink_paused = TRUE;
+		}
+		return;
+	}
+
+	/* 229 ms is about how often the cursor blink is toggled in DOS */
+	pvt->cursor_timeout_id = g_timeout_add(CURSOR_BLINK_PERIOD_MS,
+			vga_blink_cursor, vga);
+	if (pvt->blink_paused)
+	{
+		pvt->blink_paused = FALSE;
+		vga_start_blink_timer(vga);
+	}
+
+	vga_render_buf(vga);
+}
+
+static void
+vga_map(GtkWidget *widget)
+{
+	GtkWidgetClass *widget_class;
+
+	g_return_if_fail(VGA_IS_TEXT(widget));
+
+	widget_class = g_type_class_peek(GTK_TYPE_WIDGET);
+	widget_class->map(widget);
+
+	vga_update_shown(VGA_TEXT(widget));
+}
+
+static void
+vga_unmap(GtkWidget *widget)
+{
+	GtkWidgetClass *widget_class;
+
+	g_return_if_fail(VGA_IS_TEXT(widget));
+
+	widget_class = g_type_class_peek(GTK_TYPE_WIDGET);
+	widget_class->unmap(widget);
+
+	vga_update_shown(VGA_TEXT(widget));
+}
+
+static gboolean
+vga_visibility_notify(GtkWidget *widget, GdkEventVisibility *event)
+{
+	VGAText *vga;
+
+	g_return_val_if_fail(VGA_IS_TEXT(widget), FALSE);
+	vga = VGA_TEXT(widget);
+
+	vga->pvt->visibility = event->state;
+	vga_update_shown(vga);
+
+	return FALSE;
+}
+
+/*
+ * Work out which palette indexes @textattr is drawn with right now.
+ * Doesn't touch any widget state, so render workers can use it.
+ * Returns TRUE if the attribute blinks, meaning the blink timer has to
+ * be running.
+ */
+static gboolean
+vga_attr_indexes(VGAText *vga, guchar textattr, guchar *fg_ret,
+		 guchar *bg_ret)
 {
 	guchar fg, bg;
-	
+	gboolean blinks = FALSE;
+
 	/* 
 	 * Blink logic for text attributes
 	 * -----------------------------------
@@ -562,19 +1671,39 @@ vga_set_textattr(VGAText *vga, guchar textattr)
 	{	/* Blinking, but in on state so it appears normal */
 		fg = GETFG(textattr);
 		bg = GETBG(textattr);
-
-		if (vga->pvt->blink_timeout_id == -1)
-			vga_start_blink_timer(vga);
+		blinks = TRUE;
 	}
 	else
 	{	/* Hide, blink off state */
 		fg = GETBG(textattr);
 		bg = GETBG(textattr);
-
-		if (vga->pvt->blink_timeout_id == -1)
-			vga_start_blink_timer(vga);
+		blinks = TRUE;
 	}
 
+	*fg_ret = fg;
+	*bg_ret = bg;
+
+	return blinks;
+}
+
+/*
+ * vga_set_textattr:
+ * @vga: VGAtext object
+ * @textattr: VGA text attribute byte
+ *
+ * Set the VGAText's graphics context to use the text attribute given using
+ * the current VGA palette.  May not actually result in a call to the
+ * graphics server, since redundant calls may be optimized out.
+ */
+static void
+vga_set_textattr(VGAText *vga, guchar textattr)
+{
+	guchar fg, bg;
+
+	if (vga_attr_indexes(vga, textattr, &fg, &bg) &&
+	    vga->pvt->blink_timeout_id == -1)
+		vga_start_blink_timer(vga);
+
 	if (vga->pvt->fg != fg)
 	{
 #ifdef USE_DEPRECATED_GDK
@@ -629,100 +1758,68 @@ vga_paint_charcell(GtkWidget *da, VGAText *vga,
 #endif
 }
 
-/* FIXME: TEMP PROTOTYPE FOR STATIC FUNCTION */
-guchar *
-vga_font_get_glyph_data(VGAFont *font, int glyph);
-
+/* Pixel value of a GdkColor in a CAIRO_FORMAT_RGB24 image */
+#define GDK_COLOR_TO_RGB24(color) \
+	((((guint32) (color)->red >> 8) << 16) | \
+	 (((guint32) (color)->green >> 8) << 8) | \
+	 ((guint32) (color)->blue >> 8))
 
 /*
- * Paint a block of characters all in the same attribute.
- * You should have already determined that these characters have the
- * same attribute before calling this.
+ * Paint columns @col..@col+@count-1 of line @row onto the surface buffer
+ * image (@pixels, @stride pixels per line), one attribute run at a time.
+ * Only reads widget state, so render workers can call it for different
+ * lines at once; @scratch is a line of runs for the secondary buffer.
+ * Returns TRUE if any of it blinks.
  */
-static void vga_block_paint(VGAText *vga, cairo_t *cr,
-			    int col, int row, int chars)
+static gboolean
+vga_paint_row(VGAText *vga, VGAAtlas *atlas, guint32 *pixels, int stride,
+	      int row, int col, int count, vga_attr_run *scratch)
 {
-	int x, y;
-	int i, ci;
-	vga_charcell *cell;
-	vga_charcell *video_buf;
-
-//printf("vga_block_paint(col=%d, row=%d, chars=%d)\n", col, row, chars);
-	if (chars == 0)
-		return;
-
-	x = col * vga->pvt->font->width;
-	y = row * vga->pvt->font->height;
-
-	cairo_move_to(cr, x, y);
+	vga_charcell *line;
+	vga_attr_run *runs;
+	guint32 *dst;
+	guchar fg, bg;
+	gboolean blinks = FALSE;
+	int i, n_runs, run_start, run_end, last_col;
 
+	/*
+	 * The primary buffer's runs are maintained as it is written to
+	 * (and brought up to date before rendering starts).  The
+	 * secondary buffer is filled in raw by the caller, so its runs
+	 * are worked out here.
+	 */
 	if (vga->pvt->render_sec_buf)
-		video_buf = vga->pvt->sec_buf;
+	{
+		line = vga->pvt->sec_buf + row * vga->pvt->cols;
+		runs = scratch;
+		n_runs = vga_build_runs(line, vga->pvt->cols, runs);
+	}
 	else
-		video_buf = vga->pvt->video_buf;
-
-#if 1
-	/* Draw background rectangle */
-	gdk_cairo_set_source_color(cr,
-		vga_palette_get_color(vga->pvt->pal, vga->pvt->bg));
-	cairo_rectangle(cr, x, y, vga->pvt->font->width * chars,
-			vga->pvt->font->height);
-	cairo_fill(cr);
-#endif
-
-	/* Draw characters */
-	cairo_move_to(cr, x, y);
-	gdk_cairo_set_source_color(cr,
-		vga_palette_get_color(vga->pvt->pal, vga->pvt->fg));
-	/* Build up NULL-terminated line_buf string for cairo_show_text() */
-	ci = 0;
-	for (i = 0; i < chars; i++) {
-		cell = &(video_buf[row * 80 + col + i]);
-		vga->pvt->glyphs[i].index = cell->c;
-		vga->pvt->glyphs[i].x = x + (vga->pvt->font->width * i);
-		vga->pvt->glyphs[i].y = y;
-#if 1
-		if (cell->c < 128) {
-			vga->pvt->line_buf[ci++] = (cell->c == '\0' ? ' ' : cell->c);
-		} else {
-			/* 
-			 * We have to encode our extended ASCII characters
-			 * into the Unicode PUA so that Cairo doesn't think
-			 * they are real UTF-8 bytes.  Then, in the vgafont
-			 * user font, we translate PUA area glyphs back
-			 * into the regular extended ASCII glyphs
-			 */
-
-			/* IBM 8-bit extended ASCII, use Unicode PUA (U+E000) */
-			/* 
-			 * Encoded in UTF-8 as:
-			 *     1110xxxx 10xxxxxx 10xxxxxx
-			 *     ^^^ ^^^^   ^^^^^^   ^^^^^^
-			 *      |    |       |        |
-			 *      |     \______|________|
-			 *      |            |
-			 *      |        Remaining bits concatenated to
-			 *      |        form Unicode code point value
-			 *       \
-			 *         "3 bytes in sequence"
-			 *
-			 * So for U+E000 we use:
-			 *    11101110 100000xx 10xxxxxx
-			 */
-			vga->pvt->line_buf[ci++] = 0xee;
-			vga->pvt->line_buf[ci++] = 0x80 | (cell->c >> 6);
-			vga->pvt->line_buf[ci++] = 0x80 | (cell->c & 0x3f);
-			//printf("extended char: 0x%02x\n", cell->c);
-		}
-#endif
+	{
+		line = vga->pvt->vis->video_buf + row * vga->pvt->cols;
+		runs = vga->pvt->vis->runs + row * vga->pvt->cols;
+		n_runs = vga->pvt->vis->run_count[row];
 	}
-	vga->pvt->line_buf[ci] = '\0';
-	//printf("%s\n", vga->pvt->line_buf);
 
-	//cairo_show_text(cr, (const char *) vga->pvt->line_buf);
-	cairo_show_glyphs(cr, vga->pvt->glyphs, chars);
+	dst = pixels + (row - vga->pvt->band_top) * atlas->height * stride;
+	last_col = col + count - 1;
+	for (i = 0; i < n_runs; i++)
+	{
+		run_start = MAX(runs[i].start, col);
+		run_end = MIN(runs[i].start + runs[i].len - 1, last_col);
+		if (run_start > run_end)
+			continue;
+
+		blinks |= vga_attr_indexes(vga, runs[i].attr, &fg, &bg);
+		vga_atlas_paint(atlas, dst + run_start * atlas->width, stride,
+			(guchar *) (line + run_start), run_end - run_start + 1,
+			GDK_COLOR_TO_RGB24(vga_palette_get_color(vga->pvt->pal,
+								 fg)),
+			GDK_COLOR_TO_RGB24(vga_palette_get_color(vga->pvt->pal,
+								 bg)));
+	}
 
-	//printf("show_text(x,y=%d,%d col,row=%d,%d,fg=%d,bg=%d): %s\n", x, y, col, row, vga->pvt->fg, vga->pvt->bg, vga->pvt->line_buf);
+	return blinks;
 }
 
 /*
@@ -731,163 +1828,69 @@ static void vga_block_paint(VGAText *vga, cairo_t *cr,
  * @area: Area to refresh
  *
  * For the given rectangular area, render the contents of the VGA buffer
- * onto the surface buffer (NOT on-screen).
+ * onto the surface buffer (NOT on-screen).  Whole character cells are
+ * always rendered, even if @area only covers part of them.
+ *
+ * Glyphs come from the font's shared atlas and are written straight
+ * into the image data of the surface buffer.
  */
 static void
 vga_render_area(VGAText *vga, GdkRectangle * area)
 {
-	int x, y, x2, y2;
-	int char_x, char_y, x_drawn, y_drawn, row, col;
+	VGAScreen *vis = vga->pvt->vis;
+	int x2, y2;
+	int row, first_row, last_row;
+	int col, last_col;
+	int stride, n_runs;
+	guint32 *pixels;
+	VGAAtlas *atlas;
+
+	atlas = vga_font_get_atlas(vga->pvt->font, vga->pvt->scale,
+				   vga->pvt->nine_dot ? VGA_ATLAS_NINE_DOT : 0);
+	if (atlas == NULL)
+		return;
+
 	x2 = area->x + area->width;	/* Last column in area + 1 */
 	y2 = area->y + area->height;	/* Last row in area + 1 */
-	x2 = MIN(x2, vga->pvt->font->width * vga->pvt->cols);
-	y2 = MIN(y2, vga->pvt->font->height * vga->pvt->rows);
-	y = area->y;
-	vga_charcell * cell;
-	char text[2];
-	cairo_t *cr;
-	guchar attr;
-	int cols_sameattr;
-	int col_topaint;
-	int num_cols;
-	int last_col;
-	vga_charcell *video_buf;
+	x2 = MIN(x2, atlas->width * vga->pvt->cols);
+	y2 = MIN(y2, atlas->height * vga->pvt->rows);
+	if (x2 <= area->x || y2 <= area->y)
+		return;
 
-//printf("vga_render_area(): x,y = (%d,%d), width=%d, height=%d\n", area->x, area->y, area->width, area->height);
-	/* We must create/destroy the context in each expose event */
-	//cr = gdk_cairo_create(da->window);
-	cr = cairo_create(vga->pvt->surface_buf);
-#if 1
-	/* Set clip region for speed */
-	cairo_rectangle(cr, area->x, area->y, area->width, area->height);
-	cairo_clip(cr);
-#endif
+	col = PIXEL_TO_COL(area->x, vga);
+	last_col = PIXEL_TO_COL(x2 - 1, vga);
+	first_row = PIXEL_TO_ROW(area->y, vga);
+	last_row = PIXEL_TO_ROW(y2 - 1, vga);
 
-	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-	//cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
-#if 1
-	cairo_set_font_face(cr, vga->pvt->font->face);
-	cairo_set_font_size(cr, 1.0);
-#endif
+	/* Lines outside the band have nowhere to go */
+	first_row = MAX(first_row, vga->pvt->band_top);
+	last_row = MIN(last_row, vga->pvt->band_top + vga->pvt->band_rows - 1);
+	if (first_row > last_row)
+		return;
 
-	if (vga->pvt->render_sec_buf)
-		video_buf = vga->pvt->sec_buf;
-	else
-		video_buf = vga->pvt->video_buf;
-
-#define NEW_WAY
-#ifdef NEW_WAY
-	while (y < y2) {
-	//printf("while loop: y (%d) < y2 (%d)\n", y, y2);
-		row = PIXEL_TO_ROW(y, vga->pvt->font);
-		char_y = row * vga->pvt->font->height;
-		y_drawn = (char_y + vga->pvt->font->height) - y;
-
-		col = PIXEL_TO_COL(area->x, vga->pvt->font);
-		num_cols = PIXEL_TO_COL(x2-1, vga->pvt->font) - col + 1;
-		cols_sameattr = 0;
-		x = col * vga->pvt->font->width;
-		col_topaint = col;
-		cell = &(video_buf[row * 80 + col]);
-		attr = cell->attr;
-		last_col = col + num_cols - 1;
-		//printf("col_topaint = %d, last_col = %d, num_cols=%d\n", col_topaint, last_col, num_cols);
-		while (col <= last_col) {
-			cell = &(video_buf[row * 80 + col]);
-			//printf("CHAR: '%c', cell attr = 0x%02x, old attr was 0x%02x\n", cell->c, cell->attr, attr);
-			if (cell->attr == attr) {
-				cols_sameattr++;
-			} else {
-				vga_set_textattr(vga, attr);
-				//printf("vga_block_paint() - mid line, cols_sameattr=%d\n", cols_sameattr);
-				vga_block_paint(vga, cr, col_topaint,
-						row, cols_sameattr);
-				attr = cell->attr;
-				col_topaint += cols_sameattr;
-				cols_sameattr = 1;
-			}
-			col++;
-		}
-		/* Paint last chunk of row */
-		vga_set_textattr(vga, cell->attr);
-		//printf("vga_block_paint() - last chunk, col_to_paint=%d, cols=%d\n", col_topaint, last_col-col_topaint);
-		vga_block_paint(vga, cr, col_topaint, row,
-				last_col - col_topaint + 1);
-		y += vga->pvt->font->height;
-	}
-#else	/* !NEW_WAY */
-	while (y < y2)
+	/* Make sure cairo is done with the image before we poke at it */
+	cairo_surface_flush(vis->surface_buf);
+	pixels = (guint32 *) cairo_image_surface_get_data(vis->surface_buf);
+	stride = cairo_image_surface_get_stride(vis->surface_buf) / 4;
+
+	for (row = first_row; row <= last_row; row++)
 	{
-		row = PIXEL_TO_ROW(y, vga->pvt->font);
-		char_y = row * vga->pvt->font->height;
-		y_drawn = (char_y + vga->pvt->font->height) - y;
+		/* vga_render_rows() knows what the line is once it's done */
+		vis->row_hash[row] = 0;
+
+		if (!vga->pvt->render_sec_buf)
+			vga_row_runs(vga, vis, row, &n_runs);	/* Up to date */
+		if (vga_paint_row(vga, atlas, pixels, stride, row, col,
+				  last_col - col + 1, vga->pvt->run_tmp) &&
+		    vga->pvt->blink_timeout_id == -1)
+			vga_start_blink_timer(vga);
+	}
 
-		x = area->x;
-		while (x < x2)
-		{
-		/*
-		 * x       : pixel position to start drawing at (top left)
-		 * y       : pixel position to start drawing at (top left)
-		 * row     : row of character (usually 0-24)
-		 * col     : column of character (usually 0-79)
-		 * char_x  : pixel coordinate of beginning of whole character
-		 * char_y  : pixel coordinate of beginning of whole character
-		 * x_drawn : number of columns to draw of character
-		 * y_drawn : number of rows to draw of character
-		 */
-			col = PIXEL_TO_COL(x, vga->pvt->font);
-			char_x = col * vga->pvt->font->width;
-			x_drawn = (char_x + vga->pvt->font->width) - x;
-		
-			cell = &(video_buf[row * 80 + col]);
-	
-#ifdef USE_DEPRECATED_GDK
-			vga_set_textattr(vga, cell->attr);
-			gdk_gc_set_ts_origin(vga->pvt->gc, char_x,
-					char_y-(16 * cell->c));
-			gdk_draw_rectangle(da->window, vga->pvt->gc, TRUE, x, y,
-					x_drawn, y_drawn);
-#else
-
-/* NEW WAY, TESTING TO SEE HOW MUCH CAIRO FONTS ARE SLOWING ME DOWN */
-/* SPeed seems similar... although things aren't getting wiped now */
-#if 1
-	guchar *data; int row, col, i, j;
-	vga_set_textattr(vga, cell->attr);
-
-	/* Background */
-	//printf("Char at (%d, %d)\n", x, y);
-	cairo_translate(cr, x, y);
-	gdk_cairo_set_source_color(cr,
-			vga_palette_get_color(vga->pvt->pal, vga->pvt->bg));
-	cairo_rectangle(cr, 0, 0,
-			vga->pvt->font->width, vga->pvt->font->height);
-	cairo_fill(cr);
-
-	/* Foreground character */
-	data = vga_font_get_glyph_data(vga->pvt->font, cell->c);
-	gdk_cairo_set_source_color(cr,
-			vga_palette_get_color(vga->pvt->pal, vga->pvt->fg));
-	for (i = 0; i < vga->pvt->font->bytes_per_glyph; i++) {
-		row = i;
-		for (j = 0; j < 8; j++) {
-			if (data[i] & (1 << j)) {
-				col = 7 - j;
-				cairo_rectangle(cr, col * 1.0, row,
-						1.0, 1.0);
-				cairo_fill(cr);
-			}
-		}
-	}
-#endif
-
-#endif
-			x += x_drawn;
-		}
-		y += y_drawn;
-	}
-#endif	/* NEW_WAY */
-	cairo_destroy(cr);
+	cairo_surface_mark_dirty_rectangle(vis->surface_buf,
+			col * atlas->width,
+			(first_row - vga->pvt->band_top) * atlas->height,
+			(last_col - col + 1) * atlas->width,
+			(last_row - first_row + 1) * atlas->height);
 }
 
 /* Draw part of the widget by blitting surface buffer to window */
@@ -916,7 +1919,8 @@ printf("vga_paint(): area x,y = %d,%d, width=%d, height=%d\n", area->x, area->y,
 	/* Set clip region for speed */
 	cairo_rectangle(cr, area->x, area->y, area->width, area->height);
 	cairo_clip(cr);
-	cairo_set_source_surface(cr, vga->pvt->surface_buf, 0, 0);
+	cairo_set_source_surface(cr, vga->pvt->vis->surface_buf, 0,
+		(vga->pvt->band_top - vga->pvt->view_top) * CELL_HEIGHT(vga));
 	cairo_paint(cr);
 	cairo_destroy(cr);
 #endif
@@ -954,7 +1958,7 @@ printf("vga_paint(): area x,y = %d,%d, width=%d, height=%d\n", area->x, area->y,
 		for (x = col_start; x < col_stop; x++)
 		{
 			vga_paint_charcell(widget, vga,
-					vga->pvt->video_buf[y*80+x],
+					vga->pvt->vis->video_buf[y*80+x],
 					x*vga->pvt->font->width,
 					y*vga->pvt->font->height);
 		}
@@ -962,6 +1966,31 @@ printf("vga_paint(): area x,y = %d,%d, width=%d, height=%d\n", area->x, area->y,
 	
 }
 
+/*
+ * Same as vga_paint(), but for a whole region at once: one cairo
+ * context and one blit clipped to all of its rectangles.
+ */
+static void
+vga_paint_damage(GtkWidget *widget, GdkRegion *region)
+{
+	VGAText * vga;
+	cairo_t *cr;
+
+	g_return_if_fail(VGA_IS_TEXT(widget));
+	g_return_if_fail(region != NULL);
+	vga = VGA_TEXT(widget);
+	if (!GTK_WIDGET_DRAWABLE(widget))
+		return;
+
+	cr = gdk_cairo_create(widget->window);
+	gdk_cairo_region(cr, region);
+	cairo_clip(cr);
+	cairo_set_source_surface(cr, vga->pvt->vis->surface_buf, 0,
+		(vga->pvt->band_top - vga->pvt->view_top) * CELL_HEIGHT(vga));
+	cairo_paint(cr);
+	cairo_destroy(cr);
+}
+
 /*
  * Same as vga_paint(), but works on regions of cell rows/columns
  * instead of a pixel area.
@@ -980,10 +2009,10 @@ vga_paint_region(GtkWidget *widget,
 	g_return_if_fail(VGA_IS_TEXT(widget));
 	vga = VGA_TEXT(widget);
 
-	area.x = top_left_x * vga->pvt->font->width;
-	area.y = top_left_y * vga->pvt->font->height;
-	area.width = cols * vga->pvt->font->width;
-	area.height = rows * vga->pvt->font->height;
+	area.x = top_left_x * CELL_WIDTH(vga);
+	area.y = (top_left_y - vga->pvt->view_top) * CELL_HEIGHT(vga);
+	area.width = cols * CELL_WIDTH(vga);
+	area.height = rows * CELL_HEIGHT(vga);
 	vga_paint(widget, &area);
 }
 
@@ -997,7 +2026,8 @@ vga_expose(GtkWidget *widget, GdkEventExpose * event)
 	g_return_val_if_fail(VGA_IS_TEXT(widget), 0);
 	if (event->window == widget->window)
 	{
-		vga_paint(widget, &event->area);
+		vga_paint_damage(widget, event->region);
+		vga_frame_presented(VGA_TEXT(widget));
 	}
 	else
 		g_assert_not_reached();
@@ -1012,6 +2042,7 @@ vga_finalize(GObject *object)
 	VGAText * vga;
 	//GtkWidget * toplevel;
 	GtkWidgetClass * widget_class;
+	int i;
 #ifdef VGA_DEBUG
 	fprintf(stderr, "vga_finalize()\n");
 #endif
@@ -1020,8 +2051,18 @@ vga_finalize(GObject *object)
 	vga = VGA_TEXT(object);
 	widget_class = g_type_class_peek(GTK_TYPE_WIDGET);
 
+	pthread_mutex_lock(&vga->pvt->show_lock);
 	vga->pvt->render_enabled = FALSE;
+	pthread_cond_signal(&vga->pvt->show_cond);
+	pthread_mutex_unlock(&vga->pvt->show_lock);
 	pthread_join(vga->pvt->thread, NULL);
+	pthread_cond_destroy(&vga->pvt->show_cond);
+	pthread_mutex_destroy(&vga->pvt->show_lock);
+	vga_render_pool_unref();
+	vga->pvt->workers = NULL;
+	gdk_region_destroy(vga->pvt->damage);
+	g_slist_foreach(vga->pvt->frame_waits, (GFunc) g_free, NULL);
+	g_slist_free(vga->pvt->frame_waits);
 
 	/* Remove the blink timeout functions */
 	if (vga->pvt->cursor_timeout_id != -1)
@@ -1034,18 +2075,22 @@ vga_finalize(GObject *object)
 #endif
 
 	/* Destroy its font object */
+	vga_watch_font(vga, vga->pvt->font, NULL);
 	g_object_unref(vga->pvt->font);
 
 	/* Destroy palette */
 	g_object_unref(vga->pvt->pal);
 
+	/* The surfaces draw from the arena, so they have to go first */
+	for (i = 0; i < vga->pvt->n_screens; i++)
+	{
+		cairo_surface_destroy(vga->pvt->screens[i].surface_buf);
+		vga_rows_changed(&vga->pvt->screens[i], 0, vga->pvt->rows);
+	}
+
 	/* Free up private widget memory allocations */
-	g_free(vga->pvt->video_buf);
-	g_free(vga->pvt->sec_buf);
-	g_free(vga->pvt->line_buf);
-	g_free(vga->pvt->glyphs);
-	g_free(vga->pvt->dirty_buf);
-	g_free(vga->pvt->dirty_line_buf);
+	g_free(vga->pvt->arena);
+	rowcache_destroy(vga->pvt->row_cache);
 
 	/* Call the inherited finalize() method. */
 	if (G_OBJECT_CLASS(widget_class)->finalize)
@@ -1092,8 +2137,8 @@ vga_size_request(GtkWidget * widget, GtkRequisition *req)
 	g_return_if_fail(VGA_IS_TEXT(widget));
 	vga = VGA_TEXT(widget);
 
-	req->width = vga->pvt->font->width * vga->pvt->cols;
-	req->height = vga->pvt->font->height * vga->pvt->rows;
+	req->width = CELL_WIDTH(vga) * vga->pvt->cols;
+	req->height = CELL_HEIGHT(vga) * vga->pvt->view_rows;
 
 #ifdef VGA_DEBUG
 	fprintf(stderr, "Size request is %dx%d.\n",
@@ -1112,8 +2157,8 @@ vga_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 	g_return_if_fail(VGA_IS_TEXT(widget));
 	vga = VGA_TEXT(widget);
 
-	width = allocation->width / vga->pvt->font->width;
-	height = allocation->height / vga->pvt->font->height;
+	width = CLAMP(allocation->width / CELL_WIDTH(vga), 1, VGA_MAX_COLS);
+	height = CLAMP(allocation->height / CELL_HEIGHT(vga), 1, VGA_MAX_ROWS);
 
 #ifdef VGA_DEBUG
 	fprintf(stderr, "Sizing window to %dx%d (%ldx%ld).\n",
@@ -1124,8 +2169,8 @@ vga_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 	/* Set our allocation to match the structure. */
 	widget->allocation = *allocation;
 
-	/* Set the size of the pseudo-terminal. */
-	//vte_terminal_set_size(terminal, width, height);
+	/* Fit the grid to whatever we were given */
+	vga_resize_grid(vga, width, height);
 
 	/* Adjust scrollback buffers to ensure that they're big enough. */
 	//vte_terminal_set_scrollback_lines(terminal,
@@ -1169,6 +2214,9 @@ vga_class_init(VGATextClass *klass, gconstpointer data)
 	widget_class->focus_in_event = vga_focus_in;
 	widget_class->focus_out_event = vga_focus_out;
 	widget_class->unrealize = vga_unrealize;
+	widget_class->map = vga_map;
+	widget_class->unmap = vga_unmap;
+	widget_class->visibility_notify_event = vga_visibility_notify;
 	widget_class->size_request = vga_size_request;
 	widget_class->size_allocate = vga_size_allocate;
 	//widget_class->get_accessible = vga_get_accessible;
@@ -1183,7 +2231,16 @@ vga_class_init(VGATextClass *klass, gconstpointer data)
 			NULL,
 			g_cclosure_marshal_VOID__VOID,
 			G_TYPE_NONE, 0);
-	
+
+	klass->grid_resized_signal =
+		g_signal_new("grid-resized",
+			G_OBJECT_CLASS_TYPE(klass),
+			G_SIGNAL_RUN_LAST,
+			G_STRUCT_OFFSET(VGATextClass, grid_resized),
+			NULL,
+			NULL,
+			_vga_term_marshal_VOID__INT_INT,
+			G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_INT);
 }
 
 #define RENDER_PERIOD_MS	33
@@ -1194,6 +2251,7 @@ render_thread(void *ptr)
 	VGAText * vga;
 	GTimer *timer;
 	long elapsed_ms;
+	int skipped = 0;
 
 	g_return_if_fail(widget != NULL);
 	g_return_if_fail(VGA_IS_TEXT(widget));
@@ -1203,7 +2261,31 @@ render_thread(void *ptr)
 
 	g_timer_start(timer);
 	while (vga->pvt->render_enabled) {
+		/* Nothing to draw until the widget can be seen again */
+		if (!g_atomic_int_get(&vga->pvt->shown)) {
+			pthread_mutex_lock(&vga->pvt->show_lock);
+			while (!vga->pvt->shown && vga->pvt->render_enabled)
+				pthread_cond_wait(&vga->pvt->show_cond,
+						  &vga->pvt->show_lock);
+			pthread_mutex_unlock(&vga->pvt->show_lock);
+			g_timer_start(timer);
+			continue;
+		}
+
+		/*
+		 * Under an output flood, skip frames without even waiting
+		 * for the lock; the next one shows the latest state anyway.
+		 */
+		if (g_atomic_int_get(&vga->pvt->backlog) >= VGA_FLOOD_BACKLOG
+		    && ++skipped < VGA_FLOOD_FRAME_TICKS) {
+			g_usleep(RENDER_PERIOD_MS * 1000);
+			continue;
+		}
+		skipped = 0;
+
+		g_atomic_int_set(&vga->pvt->frame_wanted, 1);
 		gdk_threads_enter();
+		g_atomic_int_set(&vga->pvt->frame_wanted, 0);
 		vga_render_buf((gpointer) widget);
 		gdk_threads_leave();
 		elapsed_ms = (long) g_timer_elapsed(timer, NULL) * 1000;
@@ -1248,10 +2330,9 @@ fprintf(stderr, "NAC: vga_init(): set flags\n");
 	/* Initialize private data */
 fprintf(stderr, "NAC: vga_init(): malloc\n");
 	pvt = vga->pvt = g_malloc0(sizeof(*vga->pvt));
-fprintf(stderr, "NAC: vga_init(): new font\n");
-	pvt->font = VGA_FONT(vga_font_new());
-fprintf(stderr, "NAC: vga_init(): load default font\n");
-	vga_font_load_default(pvt->font);
+	/* All widgets share the default font until one modifies it */
+	pvt->font = vga_font_get_default();
+	pvt->scale = 1;
 	//vga_font_load_from_file(pvt->font, "dump.fnt");
 
 fprintf(stderr, "NAC: vga_init(): palette dup\n");
@@ -1266,14 +2347,13 @@ fprintf(stderr, "NAC: vga_init(): palette dup\n");
 	/*}*/
 
 fprintf(stderr, "NAC: vga_init(): set pvt fields\n");
-	pvt->rows = 25;
-	pvt->cols = 80;
+	pvt->rows = VGA_DEFAULT_ROWS;
+	pvt->cols = VGA_DEFAULT_COLS;
+	pvt->view_rows = VGA_DEFAULT_ROWS;
 
 	pvt->fg = 0x07;
 	pvt->bg = 0x00;
 
-	pvt->cursor_visible = TRUE;
-
 	/* These are initialized if needed in vga_realize() for now */
 #ifdef USE_DEPRECATED_GDK
 	pvt->glyphs = NULL;
@@ -1281,36 +2361,35 @@ fprintf(stderr, "NAC: vga_init(): set pvt fields\n");
 #endif
 
 fprintf(stderr, "NAC: vga_init(): video buf\n");
-	pvt->video_buf_len = sizeof(vga_charcell) * pvt->rows * pvt->cols;
-	pvt->video_buf = g_malloc0(pvt->video_buf_len);
-	pvt->sec_buf = g_malloc0(pvt->video_buf_len);
+	pvt->row_cache = rowcache_new(VGA_ROW_CACHE_BYTES,
+				      VGA_ROW_CACHE_ROWS);
+	if (pvt->row_cache == NULL)
+		g_error("Could not allocate row cache");
+	pvt->workers = vga_render_pool_ref();
+	if (pvt->workers == NULL)
+		g_error("Could not create render workers");
+	pvt->damage = gdk_region_new();
+
+	/* Starts out zeroed: attribute 0 and glyph 0 in every cell */
+	if (!vga_alloc_screen(vga, pvt->cols, pvt->rows, 1))
+		g_error("Could not allocate %dx%d text screen",
+			pvt->cols, pvt->rows);
 	pvt->render_sec_buf = FALSE;
 #if 0
 	/* populate our buffer with the ASCII table */
 	for (i = 0; i < 80*25; i++)
 	{
-		pvt->video_buf[i].c = i % 256;
-		pvt->video_buf[i].attr = i % 256;
+		pvt->scr->video_buf[i].c = i % 256;
+		pvt->scr->video_buf[i].attr = i % 256;
 	}
 #endif
 	/*
-	pvt->video_buf[0].c = '!';
-	pvt->video_buf[0].attr = 0x09;
-	pvt->video_buf[100].c = '@';
-	pvt->video_buf[100].attr = 0x2A; */
-	/* FIXME: Destroy this on destroy */
-	pvt->line_buf = g_malloc0(sizeof(guchar) * pvt->cols * 3 + 1);
-	/* FIXME: Destroy this on destroy */
-	pvt->glyphs = g_malloc0(sizeof(cairo_glyph_t) * pvt->cols + 1);
-
-	pvt->dirty_buf = g_malloc0(sizeof(char) * pvt->rows * pvt->cols);
-	pvt->dirty_line_buf = g_malloc0(sizeof(gboolean) * pvt->rows);
-
-fprintf(stderr, "NAC: vga_init(): cairo\n");
-	/* FIXME: Destroy this on destroy */
-	pvt->surface_buf = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
-				pvt->font->width * vga->pvt->cols,
-				pvt->font->height * vga->pvt->rows);
+	pvt->scr->video_buf[0].c = '!';
+	pvt->scr->video_buf[0].attr = 0x09;
+	pvt->scr->video_buf[100].c = '@';
+	pvt->scr->video_buf[100].attr = 0x2A; */
+	for (i = 0; i < pvt->rows; i++)
+		vga_runs_set_uniform(vga, pvt->scr, i, 0x00);
 
 
 #if 0
@@ -1318,10 +2397,10 @@ fprintf(stderr, "NAC: vga_init(): cairo\n");
 			vga_render_buf, widget);
 #endif
 
-	/* Add our cursor timeout event to make it blink */
-	/* 229 ms is about how often the cursor blink is toggled in DOS */
-	pvt->cursor_timeout_id = g_timeout_add(CURSOR_BLINK_PERIOD_MS,
-			vga_blink_cursor, vga);
+	/* The cursor starts blinking once we're mapped */
+	pvt->cursor_timeout_id = -1;
+	pvt->shown = FALSE;
+	pvt->visibility = GDK_VISIBILITY_UNOBSCURED;
 
 	/* Leave this at -1 until we actually have characters blinking */
 	pvt->blink_timeout_id = -1;
@@ -1335,6 +2414,10 @@ fprintf(stderr, "NAC: vga_init(): cairo\n");
 	gtk_widget_set_colormap(widget, gdk_screen_get_rgb_colormap(gtk_widget_get_screen(widget)));
 #endif
 
+	/* Plain pthreads like the thread itself, as these work whether or
+	 * not g_thread_init() has been called */
+	pthread_mutex_init(&pvt->show_lock, NULL);
+	pthread_cond_init(&pvt->show_cond, NULL);
 	pvt->render_enabled = TRUE;
 fprintf(stderr, "NAC: vga_init(): pthread_create\n");
 	pthread_create(&pvt->thread, NULL,
@@ -1428,10 +2511,38 @@ vga_refresh_font(VGAText *vga)
 			GTK_WIDGET(vga)->window);
 	gdk_gc_set_stipple(vga->pvt->gc, vga->pvt->glyphs);
 #else
-	/* FIXME: ??? */
+	/*
+	 * Nothing to do: the atlas is kept up to date by the font, which
+	 * tells us about changed glyphs through "glyphs-changed".
+	 */
 #endif
 }
 
+/*
+ * Get the widget's font for modification.  If the font is shared with
+ * other widgets (as the default font is), the widget switches to a
+ * private copy of it first, so the change only affects this widget.
+ */
+VGAFont *
+vga_get_font_writable(VGAText *vga)
+{
+	VGAFont *font;
+
+	g_return_val_if_fail(vga != NULL, NULL);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), NULL);
+
+	if (vga_font_is_shared(vga->pvt->font))
+	{
+		font = vga_font_dup(vga->pvt->font);
+		vga_watch_font(vga, vga->pvt->font, font);
+		g_object_unref(vga->pvt->font);
+		vga->pvt->font = font;
+		vga->pvt->font_serial++;
+	}
+
+	return vga->pvt->font;
+}
+
 /* Override the default VGA font.  Refreshes the display. */
 void
 vga_set_font(VGAText *vga, VGAFont *font)
@@ -1441,8 +2552,11 @@ vga_set_font(VGAText *vga, VGAFont *font)
 
 	if (vga->pvt->font != font)
 	{
+		vga_watch_font(vga, vga->pvt->font, font);
 		g_object_unref(vga->pvt->font);
 		vga->pvt->font = font;
+		vga->pvt->font_serial++;
+		vga_update_surface(vga);
 	}
 
 	vga_refresh_font(vga);
@@ -1470,21 +2584,91 @@ gboolean vga_get_icecolor(VGAText *vga)
 	return vga->pvt->icecolor;
 }
 
+/*
+ * Set the integer zoom factor of the display (1 for one screen pixel
+ * per font pixel).  Glyphs are expanded at this size in the font atlas,
+ * so text is rendered straight at the target resolution and stays sharp.
+ */
+void
+vga_set_scale(VGAText *vga, int scale)
+{
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+	g_return_if_fail(scale > 0);
+
+	if (vga->pvt->scale == scale)
+		return;
+
+	vga->pvt->scale = scale;
+	vga_update_surface(vga);
+}
+
+int
+vga_get_scale(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, -1);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), -1);
+
+	return vga->pvt->scale;
+}
+
+/*
+ * Enable or disable 9-dot mode, where character cells are one pixel
+ * wider than the font as on real VGA hardware.  Line drawing glyphs
+ * (0xC0-0xDF) extend into the extra column so boxes join up; that is
+ * done once when the atlas is built, not while rendering.
+ */
+void
+vga_set_nine_dot(VGAText *vga, gboolean enabled)
+{
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+
+	enabled = enabled ? TRUE : FALSE;
+	if (vga->pvt->nine_dot == enabled)
+		return;
+
+	vga->pvt->nine_dot = enabled;
+	vga_update_surface(vga);
+}
+
+gboolean
+vga_get_nine_dot(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, FALSE);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), FALSE);
+
+	return vga->pvt->nine_dot;
+}
+
 
 /* Put a character on the screen */
 void
 vga_put_char(VGAText *vga, guchar c, guchar attr, int col, int row)
 {
+	VGAScreen *scr;
 	int ofs;
 	GdkRectangle area;
 
 	g_return_if_fail(vga != NULL);
 	g_return_if_fail(VGA_IS_TEXT(vga));
+	scr = vga->pvt->scr;
 
 	/* Update video buffer */
 	ofs = vga->pvt->cols * row + col;
-	vga->pvt->video_buf[ofs].c = c;
-	vga->pvt->video_buf[ofs].attr = attr;
+	if (scr->video_buf[ofs].c != c)
+	{
+		scr->glyph_count[scr->video_buf[ofs].c]--;
+		scr->glyph_count[c]++;
+		GLYPH_MAP_SET(ROW_GLYPH_MAP(scr, row), c);
+		scr->video_buf[ofs].c = c;
+	}
+	if (scr->video_buf[ofs].attr != attr)
+	{
+		scr->video_buf[ofs].attr = attr;
+		vga_runs_set_span(vga, scr, row, col, 1, attr);
+	}
+	vga_rows_changed(scr, row, 1);
 
 #if 0
 	/* Refresh charcell */
@@ -1494,7 +2678,7 @@ vga_put_char(VGAText *vga, guchar c, guchar attr, int col, int row)
 	area.height = vga->pvt->font->height;
 	vga_render_area(vga, &area);
 #else
-	vga_mark_region_dirty(vga, col, row, 1, 1);
+	vga_mark_cells_dirty(vga, scr, col, row, 1, 1);
 #endif
 }
 
@@ -1504,12 +2688,15 @@ vga_put_char(VGAText *vga, guchar c, guchar attr, int col, int row)
 void
 vga_put_string(VGAText *vga, guchar * s, guchar attr, int col, int row)
 {
+	VGAScreen *scr;
 	int ofs, i, len;
+	guint32 *map;
 	GdkRectangle area;
 
 	g_return_if_fail(vga != NULL);
 	g_return_if_fail(VGA_IS_TEXT(vga));
 	g_return_if_fail(s != NULL);
+	scr = vga->pvt->scr;
 
 	len = strlen(s);
 	if (len > (vga->pvt->cols - col))
@@ -1518,11 +2705,17 @@ vga_put_string(VGAText *vga, guchar * s, guchar attr, int col, int row)
 
 	/* Update video buffer */
 	ofs = vga->pvt->cols * row + col;
+	map = ROW_GLYPH_MAP(scr, row);
 	for (i = 0; i < len; i++)
 	{
-		vga->pvt->video_buf[ofs].c = s[i];
-		vga->pvt->video_buf[ofs++].attr = attr;
+		scr->glyph_count[scr->video_buf[ofs].c]--;
+		scr->glyph_count[s[i]]++;
+		GLYPH_MAP_SET(map, s[i]);
+		scr->video_buf[ofs].c = s[i];
+		scr->video_buf[ofs++].attr = attr;
 	}
+	vga_runs_set_span(vga, scr, row, col, len, attr);
+	vga_rows_changed(scr, row, 1);
 
 #if 0
 	/* Refresh charcells */
@@ -1532,20 +2725,60 @@ vga_put_string(VGAText *vga, guchar * s, guchar attr, int col, int row)
 	area.height = vga->pvt->font->height;
 	vga_render_area(vga, &area);
 #else
-	vga_mark_region_dirty(vga, col, row, len, 1);
+	vga_mark_cells_dirty(vga, scr, col, row, len, 1);
 #endif
 }
 
 
+/*
+ * Copy @count cells (character and attribute each) to the screen,
+ * starting at @col, @row.  Truncated at the right edge like
+ * vga_put_string().
+ */
+void
+vga_put_cells(VGAText *vga, const vga_charcell *cells, int count,
+	      int col, int row)
+{
+	struct _VGATextPrivate *pvt;
+	VGAScreen *scr;
+	vga_charcell *dst;
+	guint32 *map;
+	int i;
+
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+	g_return_if_fail(cells != NULL);
+	pvt = vga->pvt;
+	scr = pvt->scr;
+
+	count = MIN(count, pvt->cols - col);
+	if (count <= 0)
+		return;
+
+	dst = scr->video_buf + pvt->cols * row + col;
+	map = ROW_GLYPH_MAP(scr, row);
+	for (i = 0; i < count; i++)
+	{
+		scr->glyph_count[dst[i].c]--;
+		scr->glyph_count[cells[i].c]++;
+		GLYPH_MAP_SET(map, cells[i].c);
+	}
+	memcpy(dst, cells, sizeof(vga_charcell) * count);
+
+	/* Any mix of attributes: work the runs out when next needed */
+	scr->run_count[row] = 0;
+	vga_rows_changed(scr, row, 1);
+	vga_mark_cells_dirty(vga, scr, col, row, count, 1);
+}
 
-/* Get a pointer to the screen internal video buffer */
+/* Get a pointer to the internal video buffer of the selected console */
 guchar *
 vga_get_video_buf(VGAText *vga)
 {
 	g_return_val_if_fail(vga != NULL, NULL);
 	g_return_val_if_fail(VGA_IS_TEXT(vga), NULL);
 
-	return (guchar *) vga->pvt->video_buf;
+	return (guchar *) vga->pvt->scr->video_buf;
 }
 
 /*
@@ -1574,11 +2807,18 @@ vga_video_buf_size(VGAText *vga)
 void
 vga_video_buf_clear(VGAText *vga)
 {
+	int y;
+
 	g_return_if_fail(vga != NULL);
 	g_return_if_fail(VGA_IS_TEXT(vga));
 
 	memset(vga_get_video_buf(vga), 0, vga_video_buf_size(vga));
-	vga_mark_region_dirty(vga, 0, 0, vga->pvt->cols, vga->pvt->rows);
+	for (y = 0; y < vga->pvt->rows; y++)
+		vga_runs_set_uniform(vga, vga->pvt->scr, y, 0x00);
+	vga_glyphs_rebuild(vga, vga->pvt->scr);
+	vga_rows_changed(vga->pvt->scr, 0, vga->pvt->rows);
+	vga_mark_cells_dirty(vga, vga->pvt->scr, 0, 0, vga->pvt->cols,
+			     vga->pvt->rows);
 }
 
 /* Show or hide the cursor */
@@ -1588,7 +2828,7 @@ vga_cursor_set_visible(VGAText *vga, gboolean visible)
 	g_return_if_fail(vga != NULL);
 	g_return_if_fail(VGA_IS_TEXT(vga));
 
-	vga->pvt->cursor_visible = visible;
+	vga->pvt->scr->cursor_visible = visible;
 }
 
 gboolean
@@ -1597,7 +2837,7 @@ vga_cursor_is_visible(VGAText *vga)
 	g_assert(vga != NULL);
 	g_assert(VGA_IS_TEXT(vga));
 
-	return vga->pvt->cursor_visible;
+	return vga->pvt->scr->cursor_visible;
 }
 
 
@@ -1605,20 +2845,23 @@ vga_cursor_is_visible(VGAText *vga)
 void
 vga_cursor_move(VGAText *vga, int x, int y)
 {
+	VGAScreen *scr;
+
 	g_return_if_fail(vga != NULL);
 	g_return_if_fail(VGA_IS_TEXT(vga));
+	scr = vga->pvt->scr;
 
-	if (vga->pvt->cursor_visible)
-		//vga_render_region(vga, vga->pvt->cursor_x,
-		vga_mark_region_dirty(vga, vga->pvt->cursor_x,
-				vga->pvt->cursor_y, 1, 1);
+	if (scr->cursor_visible)
+		//vga_render_region(vga, scr->cursor_x,
+		vga_mark_cells_dirty(vga, scr, scr->cursor_x,
+				scr->cursor_y, 1, 1);
 
-	vga->pvt->cursor_x = x;
-	vga->pvt->cursor_y = y;
+	scr->cursor_x = x;
+	scr->cursor_y = y;
 
-	if (vga->pvt->cursor_visible)
+	if (scr->cursor_visible)
 		//vga_render_region(vga, x, y, 1, 1);
-		vga_mark_region_dirty(vga, x, y, 1, 1);
+		vga_mark_cells_dirty(vga, scr, x, y, 1, 1);
 }
 
 int
@@ -1627,7 +2870,7 @@ vga_cursor_x(VGAText *vga)
 	g_return_val_if_fail(vga != NULL, -1);
 	g_return_val_if_fail(VGA_IS_TEXT(vga), -1);
 
-	return vga->pvt->cursor_x;
+	return vga->pvt->scr->cursor_x;
 }
 
 int
@@ -1636,7 +2879,29 @@ vga_cursor_y(VGAText *vga)
 	g_return_val_if_fail(vga != NULL, -1);
 	g_return_val_if_fail(VGA_IS_TEXT(vga), -1);
 
-	return vga->pvt->cursor_y;
+	return vga->pvt->scr->cursor_y;
+}
+
+/*
+ * Mark cells as needing to be rendered again, without touching the
+ * attribute runs.  Used internally where the runs are already known
+ * to be correct.
+ */
+static void
+vga_mark_cells_dirty(VGAText *vga, VGAScreen *scr,
+			int top_left_x, int top_left_y,
+			int cols, int rows)
+{
+	int i, x, y;
+
+	for (y = top_left_y; y < (top_left_y + rows); y++) {
+//printf("vga_mark_region_dirty(): line %d dirty\n", y);
+		scr->dirty_line_buf[y] = 1;
+		for (x = top_left_x; x < (top_left_x + cols); x++) {
+			i = y * vga->pvt->cols + x;
+			scr->dirty_buf[i] = 1;
+		}
+	}
 }
 
 /*
@@ -1652,7 +2917,7 @@ vga_mark_region_dirty(VGAText *vga,
 			int top_left_x, int top_left_y,
 			int cols, int rows)
 {
-	int i, x, y;
+	int y;
 
 	g_return_if_fail(vga != NULL);
 /* We shouldn't care if vga is realized or not for this */
@@ -1663,14 +2928,21 @@ vga_mark_region_dirty(VGAText *vga,
 
 	g_return_if_fail(VGA_IS_TEXT(vga));
 
-	for (y = top_left_y; y < (top_left_y + rows); y++) {
-//printf("vga_mark_region_dirty(): line %d dirty\n", y);
-		vga->pvt->dirty_line_buf[y] = 1;
-		for (x = top_left_x; x < (top_left_x + cols); x++) {
-			i = y * vga->pvt->cols + x;
-			vga->pvt->dirty_buf[i] = 1;
-		}
+	/*
+	 * The buffer was written directly, so our runs and glyph counts
+	 * can't be trusted, and any glyph may now be on these lines.
+	 */
+	for (y = top_left_y; y < (top_left_y + rows); y++)
+	{
+		vga->pvt->scr->run_count[y] = 0;
+		memset(ROW_GLYPH_MAP(vga->pvt->scr, y), 0xff,
+		       sizeof(guint32) * VGA_GLYPH_MAP_WORDS);
 	}
+	vga->pvt->scr->glyph_count_stale = TRUE;
+	vga_rows_changed(vga->pvt->scr, top_left_y, rows);
+
+	vga_mark_cells_dirty(vga, vga->pvt->scr, top_left_x, top_left_y,
+			     cols, rows);
 }
 
 /*
@@ -1693,10 +2965,10 @@ vga_render_region(VGAText *vga,
 	g_return_if_fail(VGA_IS_TEXT(vga));
 
 //printf("vga_render_region(): top_left_x = %d, top_left_y = %d, cols=%d, rows=%d\n", top_left_x, top_left_y, cols, rows);
-	area.x = top_left_x * vga->pvt->font->width;
-	area.y = top_left_y * vga->pvt->font->height;
-	area.width = cols * vga->pvt->font->width;
-	area.height = rows * vga->pvt->font->height;
+	area.x = top_left_x * CELL_WIDTH(vga);
+	area.y = top_left_y * CELL_HEIGHT(vga);
+	area.width = cols * CELL_WIDTH(vga);
+	area.height = rows * CELL_HEIGHT(vga);
 	vga_render_area(vga, &area);
 }
 		
@@ -1715,17 +2987,179 @@ vga_refresh(VGAText *vga)
 	 * only the final palette is displayed since gtk interprets the
 	 * entire thing as a single invalidate
 	 */
-	vga_mark_region_dirty(vga, 0, 0, vga->pvt->cols, vga->pvt->rows);
-	/* Lame hack that ensures we wait for the rendering thread
-	 * to be updated with the dirty region.... */
-	printf("uslep(%d)\n", RENDER_PERIOD_MS * 1000 * 2);
-	//g_usleep(RENDER_PERIOD_MS * 1000 * 2);
-	//g_usleep(40000);
-	/* Now explicitly repaint it.. */
-	/* This step is SLOOWWWW... */
-	//vga_paint_region(vga, 0, 0, vga->pvt->cols, vga->pvt->rows);
-	gtk_main_iteration();
-	printf("vga_refresh(): done\n");
+	vga_mark_cells_dirty(vga, vga->pvt->vis, 0, 0, vga->pvt->cols,
+			     vga->pvt->rows);
+	vga_flush(vga);
+}
+
+/*
+ * Render whatever is dirty in the lines of the given region right now,
+ * instead of waiting for the render thread, and paint it to the window
+ * before returning.  Only the lines the region covers count; every
+ * dirty cell on them is rendered.
+ *
+ * Returns the number of the frame the window now shows.  Nothing is
+ * rendered while the widget is hidden, in which case that is the last
+ * frame shown before it was.
+ */
+guint
+vga_flush_region(VGAText *vga, int top_left_x, int top_left_y,
+		 int cols, int rows)
+{
+	struct _VGATextPrivate *pvt;
+	GtkWidget *widget;
+	int first, last;
+
+	g_return_val_if_fail(vga != NULL, 0);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+	pvt = vga->pvt;
+	widget = GTK_WIDGET(vga);
+
+	if (!GTK_WIDGET_REALIZED(widget) || !pvt->shown)
+		return pvt->presented_frame;
+
+	/* Lines outside the band aren't on the surface */
+	first = MAX(top_left_y, pvt->band_top);
+	last = MIN(top_left_y + rows, pvt->band_top + pvt->band_rows) - 1;
+	if (cols > 0 && first <= last)
+		vga_render_rows(vga, first, last);
+	vga_flush_damage(vga);
+
+	/* Paints just this window, without running the main loop */
+	gdk_window_process_updates(widget->window, FALSE);
+	gdk_display_flush(gtk_widget_get_display(widget));
+
+	return pvt->presented_frame;
+}
+
+/* vga_flush_region() for the whole grid */
+guint
+vga_flush(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, 0);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+
+	return vga_flush_region(vga, 0, 0, vga->pvt->cols, vga->pvt->rows);
+}
+
+/*
+ * Tell the widget how many bytes of output are queued up for it but
+ * not parsed yet.  Above a threshold it skips frames until the backlog
+ * drains, much like xterm's jump scrolling.  Unlike the rest of the
+ * API, this may be called from any thread without the GDK lock.
+ */
+void
+vga_set_backlog(VGAText *vga, guint bytes)
+{
+	g_return_if_fail(VGA_IS_TEXT(vga));
+
+	g_atomic_int_set(&vga->pvt->backlog, MIN(bytes, G_MAXINT));
+}
+
+guint
+vga_get_backlog(VGAText *vga)
+{
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+
+	return g_atomic_int_get(&vga->pvt->backlog);
+}
+
+/* TRUE if the render thread is waiting for the GDK lock to draw a frame */
+gboolean
+vga_frame_wanted(VGAText *vga)
+{
+	g_return_val_if_fail(VGA_IS_TEXT(vga), FALSE);
+
+	return g_atomic_int_get(&vga->pvt->frame_wanted);
+}
+
+/*
+ * For a writer that holds the GDK lock through a long stretch of work:
+ * if the render thread is waiting for the lock, let go of it until the
+ * render thread has it, then take it back once the frame is drawn.
+ * Just letting go and taking it back straight away isn't enough, since
+ * the waiting thread rarely wins the lock.  The screen should be up to
+ * date first, and the backlog should say how much is still to come.
+ */
+void
+vga_yield_frame(VGAText *vga)
+{
+	g_return_if_fail(VGA_IS_TEXT(vga));
+
+	if (!g_atomic_int_get(&vga->pvt->frame_wanted))
+		return;
+
+	gdk_threads_leave();
+	while (g_atomic_int_get(&vga->pvt->frame_wanted))
+		g_thread_yield();
+	gdk_threads_enter();
+}
+
+/* Number of the latest frame rendered, whether painted yet or not */
+guint
+vga_get_frame(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, 0);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+
+	return vga->pvt->frame;
+}
+
+/* Number of the latest frame painted to the window */
+guint
+vga_get_presented_frame(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, 0);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+
+	return vga->pvt->presented_frame;
+}
+
+/* Sort VGAFrameWait by frame */
+static gint
+vga_frame_wait_cmp(gconstpointer a, gconstpointer b)
+{
+	return (gint) (((const VGAFrameWait *) a)->frame -
+		       ((const VGAFrameWait *) b)->frame);
+}
+
+static gboolean
+vga_frame_idle(gpointer data)
+{
+	VGAText *vga = data;
+
+	vga_run_frame_waits(vga);
+	g_object_unref(vga);
+
+	return FALSE;
+}
+
+/*
+ * Have @func called once frame number @frame has been painted to the
+ * window, without waiting for it.  If it already has been, @func is
+ * called from the main loop when it is next idle, never from in here.
+ */
+void
+vga_notify_frame(VGAText *vga, guint frame, VGAFrameFunc func,
+		 gpointer data)
+{
+	struct _VGATextPrivate *pvt;
+	VGAFrameWait *wait;
+
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+	g_return_if_fail(func != NULL);
+	pvt = vga->pvt;
+
+	wait = g_new(VGAFrameWait, 1);
+	wait->frame = frame;
+	wait->func = func;
+	wait->data = data;
+	pvt->frame_waits = g_slist_insert_sorted(pvt->frame_waits, wait,
+						 vga_frame_wait_cmp);
+
+	if (FRAME_REACHED(pvt->presented_frame, frame))
+		g_idle_add(vga_frame_idle, g_object_ref(vga));
 }
 
 int vga_get_rows(VGAText *vga)
@@ -1744,11 +3178,242 @@ int vga_get_cols(VGAText *vga)
 	return vga->pvt->cols;
 }
 
+/*
+ * Change the size of the text grid, up to VGA_MAX_COLS x VGA_MAX_ROWS.
+ * What fits of the current contents (both buffers) is kept, anchored at
+ * the top left, and "grid-resized" is emitted.  Note that the widget
+ * resizes its grid to fit its allocation, so for this to stick the
+ * widget must be given the size it asks for.
+ *
+ * In canvas mode this sets the size of the view; the grid stays at
+ * least as tall as the canvas.
+ */
+gboolean vga_set_size(VGAText *vga, int cols, int rows)
+{
+	g_return_val_if_fail(vga != NULL, FALSE);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), FALSE);
+	g_return_val_if_fail(cols > 0 && cols <= VGA_MAX_COLS, FALSE);
+	g_return_val_if_fail(rows > 0 && rows <= VGA_MAX_ROWS, FALSE);
+
+	if (!vga_resize_grid(vga, cols, rows))
+		return FALSE;
+	gtk_widget_queue_resize(GTK_WIDGET(vga));
+
+	return TRUE;
+}
+
+/*
+ * Canvas mode: make the grid @rows lines tall (up to VGA_MAX_CANVAS_ROWS)
+ * while the widget only shows as many as fit, starting at the line set
+ * with vga_set_view_top().  Meant for things like long ANSI art, which
+ * can then be written out in full instead of scrolling through the
+ * screen.  Lines are only rendered once they get near the view.
+ * A @rows of 0 turns canvas mode off again.
+ */
+gboolean vga_set_canvas_rows(VGAText *vga, int rows)
+{
+	g_return_val_if_fail(vga != NULL, FALSE);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), FALSE);
+	g_return_val_if_fail(rows >= 0 && rows <= VGA_MAX_CANVAS_ROWS, FALSE);
+
+	vga->pvt->canvas_rows = rows;
+	return vga_resize_grid(vga, vga->pvt->cols, vga->pvt->view_rows);
+}
+
+int vga_get_canvas_rows(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, 0);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+
+	return vga->pvt->canvas_rows;
+}
+
+/* Number of lines shown, which is less than the grid in canvas mode */
+int vga_get_view_rows(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, -1);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), -1);
+
+	return vga->pvt->view_rows;
+}
+
+int vga_get_view_top(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, 0);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+
+	return vga->pvt->view_top;
+}
+
+/*
+ * Move the band of rendered lines so it is centered on the view again.
+ * Lines that stay in the band are moved over in the surface buffer, so
+ * only the ones new to it have to be rendered.
+ */
+static void
+vga_move_band(VGAText *vga)
+{
+	struct _VGATextPrivate *pvt = vga->pvt;
+	VGAScreen *scr;
+	int old_top, new_top, keep, line_bytes, i;
+	guchar *pixels;
+
+	old_top = pvt->band_top;
+	new_top = vga_band_top(vga);
+	if (new_top == old_top)
+		return;
+
+	keep = MAX(pvt->band_rows - ABS(new_top - old_top), 0);
+	pvt->band_top = new_top;
+
+	/* The band is shared, so every console's surface moves with it */
+	for (i = 0; i < pvt->n_screens; i++)
+	{
+		scr = &pvt->screens[i];
+		if (keep > 0)
+		{
+			cairo_surface_flush(scr->surface_buf);
+			pixels = cairo_image_surface_get_data(scr->surface_buf);
+			line_bytes = cairo_image_surface_get_stride(
+					scr->surface_buf) * CELL_HEIGHT(vga);
+			if (new_top > old_top)
+				memmove(pixels,
+					pixels + (new_top - old_top) *
+						line_bytes,
+					keep * line_bytes);
+			else
+				memmove(pixels + (old_top - new_top) *
+						line_bytes,
+					pixels, keep * line_bytes);
+			cairo_surface_mark_dirty(scr->surface_buf);
+		}
+
+		if (new_top > old_top)
+			vga_forget_rows(vga, scr, new_top + keep,
+					pvt->band_rows - keep);
+		else
+			vga_forget_rows(vga, scr, new_top,
+					pvt->band_rows - keep);
+	}
+}
+
+/*
+ * Scroll the view so that line @row of the grid is at the top.  Only
+ * does anything in canvas mode.  Scrolling within the band is just a
+ * repaint; past it, only the lines newly in the band get rendered.
+ */
+void vga_set_view_top(VGAText *vga, int row)
+{
+	struct _VGATextPrivate *pvt;
+
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+	pvt = vga->pvt;
+
+	row = CLAMP(row, 0, pvt->rows - pvt->view_rows);
+	if (row == pvt->view_top)
+		return;
+	pvt->view_top = row;
+
+	if (row < pvt->band_top ||
+	    row + pvt->view_rows > pvt->band_top + pvt->band_rows)
+		vga_move_band(vga);
+
+	gtk_widget_queue_draw(GTK_WIDGET(vga));
+}
+
 void vga_show_secondary(VGAText *vga, gboolean enabled)
 {
 	vga->pvt->render_sec_buf = enabled;
 }
 
+/*
+ * Virtual consoles: give the widget @n (up to VGA_MAX_CONSOLES) screens
+ * of the current grid size, each with its own video buffer, cursor and
+ * rendered surface.  Consoles past the new count are dropped; new ones
+ * start out blank.  Returns FALSE if the memory can't be had.
+ */
+gboolean vga_set_consoles(VGAText *vga, int n)
+{
+	g_return_val_if_fail(vga != NULL, FALSE);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), FALSE);
+	g_return_val_if_fail(n > 0 && n <= VGA_MAX_CONSOLES, FALSE);
+
+	if (n == vga->pvt->n_screens)
+		return TRUE;
+	if (!vga_alloc_screen(vga, vga->pvt->cols, vga->pvt->rows, n))
+		return FALSE;
+	gtk_widget_queue_draw(GTK_WIDGET(vga));
+
+	return TRUE;
+}
+
+int vga_get_consoles(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, 0);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), 0);
+
+	return vga->pvt->n_screens;
+}
+
+/*
+ * Make console @n the one written to by everything that touches the
+ * video buffer or the cursor.  It doesn't have to be the one shown;
+ * writes to a hidden console are only rendered once it is shown.
+ */
+void vga_select_console(VGAText *vga, int n)
+{
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+	g_return_if_fail(n >= 0 && n < vga->pvt->n_screens);
+
+	vga->pvt->scr = &vga->pvt->screens[n];
+}
+
+int vga_get_selected_console(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, -1);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), -1);
+
+	return vga->pvt->scr - vga->pvt->screens;
+}
+
+/*
+ * Show console @n, and paint it right away.  Its surface still has
+ * whatever it showed last, so only the lines that changed since (or
+ * that look different now, e.g. after a palette or font change) are
+ * rendered again; the rest just get repainted.
+ */
+void vga_show_console(VGAText *vga, int n)
+{
+	struct _VGATextPrivate *pvt;
+	int y;
+
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+	pvt = vga->pvt;
+	g_return_if_fail(n >= 0 && n < pvt->n_screens);
+
+	if (pvt->vis == &pvt->screens[n])
+		return;
+	pvt->vis = &pvt->screens[n];
+
+	/* The row hashes sort out which lines really need rendering */
+	vga_mark_cells_dirty(vga, pvt->vis, 0, pvt->band_top, pvt->cols,
+			     pvt->band_rows);
+	for (y = pvt->view_top; y < pvt->view_top + pvt->view_rows; y++)
+		vga_queue_draw_cells(vga, 0, y, pvt->cols);
+	vga_render_buf(vga);
+}
+
+int vga_get_shown_console(VGAText *vga)
+{
+	g_return_val_if_fail(vga != NULL, -1);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), -1);
+
+	return vga->pvt->vis - vga->pvt->screens;
+}
+
 /**
  * memsetword:
  * @s: Pointer to the start of the area
@@ -1771,29 +3436,342 @@ static void * memsetword(void * s, gint16 c, size_t count)
 void vga_clear_area(VGAText *vga, guchar attr, int top_left_x,
 		int top_left_y, int cols, int rows)
 {
+	VGAScreen *scr;
 	gint16 cellword;
 	int ofs, y, endrow;
+	guint32 *map;
 
 	g_return_if_fail(vga != NULL);
 	g_return_if_fail(VGA_IS_TEXT(vga));
+	scr = vga->pvt->scr;
 	/* FIXME: Endianness.  No << 8 for big endian */
 	cellword = 0x0000 | ((gint16) attr << 8);
+	vga_glyphs_count(vga, scr, top_left_x, top_left_y, cols, rows, -1);
+	scr->glyph_count[0] += cols * rows;
 	/* Special case optimization */
+	endrow = top_left_y + rows;
 	if (cols == vga->pvt->cols)
 	{
 		ofs = top_left_y * cols;
-		memsetword(vga->pvt->video_buf + ofs, cellword, cols * rows);
+		memsetword(scr->video_buf + ofs, cellword, cols * rows);
+		for (y = top_left_y; y < endrow; y++)
+		{
+			vga_runs_set_uniform(vga, scr, y, attr);
+			map = ROW_GLYPH_MAP(scr, y);
+			memset(map, 0, sizeof(guint32) * VGA_GLYPH_MAP_WORDS);
+			GLYPH_MAP_SET(map, 0);
+		}
 	}
 	else
 	{
-		endrow = top_left_y + rows;
 		for (y = top_left_y; y < endrow; y++)
 		{
 			ofs = (y * vga->pvt->cols + top_left_x);
-			memsetword(vga->pvt->video_buf + ofs, cellword, cols);
+			memsetword(scr->video_buf + ofs, cellword, cols);
+			vga_runs_set_span(vga, scr, y, top_left_x, cols, attr);
+			GLYPH_MAP_SET(ROW_GLYPH_MAP(scr, y), 0);
+		}
+	}
+	vga_rows_changed(scr, top_left_y, rows);
+	vga_mark_cells_dirty(vga, scr, top_left_x, top_left_y, cols, rows);
+}
+
+/**
+ * vga_scroll_rows:
+ * @vga: VGAText object
+ * @attr: Attribute to clear the uncovered lines with
+ * @top_left_x: Left column of the region (0-based)
+ * @top_left_y: Top row of the region (0-based)
+ * @cols: Width of the region
+ * @rows: Height of the region
+ * @lines: Lines to scroll by; positive scrolls up, negative scrolls down
+ *
+ * Shift the contents of a rectangular region of the video buffer up or
+ * down, clearing the lines that are uncovered.  When the region spans
+ * the full width, the attribute runs move along with their lines
+ * instead of being worked out again.
+ */
+void vga_scroll_rows(VGAText *vga, guchar attr, int top_left_x,
+		int top_left_y, int cols, int rows, int lines)
+{
+	struct _VGATextPrivate *pvt;
+	VGAScreen *scr;
+	int i, y, n, src, dst, step, count;
+	gboolean full_width;
+
+	g_return_if_fail(vga != NULL);
+	g_return_if_fail(VGA_IS_TEXT(vga));
+	pvt = vga->pvt;
+	scr = pvt->scr;
+
+	n = ABS(lines);
+	if (n == 0 || rows <= 0)
+		return;
+	if (n >= rows)
+	{
+		vga_clear_area(vga, attr, top_left_x, top_left_y, cols, rows);
+		return;
+	}
+
+	full_width = (top_left_x == 0 && cols == pvt->cols);
+	count = rows - n;
+
+	if (lines > 0)
+	{
+		dst = top_left_y;
+		src = top_left_y + n;
+		step = 1;
+	}
+	else
+	{
+		/* Work from the bottom up so we don't overwrite sources */
+		dst = top_left_y + rows - 1;
+		src = dst - n;
+		step = -1;
+	}
+
+	/*
+	 * The lines scrolled off are lost; the ones that get uncovered are
+	 * duplicates until they are cleared below.
+	 */
+	vga_glyphs_count(vga, scr, top_left_x, lines > 0 ? top_left_y :
+			 top_left_y + count, cols, n, -1);
+
+	/*
+	 * A full width region is contiguous, so move it in one go.  Whole
+	 * lines just move, so their snapshot lines can go along with them.
+	 */
+	if (full_width)
+	{
+		memmove(scr->video_buf + (top_left_y + (lines < 0 ? n : 0)) *
+				pvt->cols,
+			scr->video_buf + (top_left_y + (lines > 0 ? n : 0)) *
+				pvt->cols,
+			sizeof(vga_charcell) * count * pvt->cols);
+
+		vga_rows_changed(scr, lines > 0 ? top_left_y :
+				 top_left_y + count, n);
+		memmove(scr->snap_rows + top_left_y + (lines < 0 ? n : 0),
+			scr->snap_rows + top_left_y + (lines > 0 ? n : 0),
+			sizeof(VGASnapRow *) * count);
+		/* Moved, not dropped; clear_area() below must not unref */
+		memset(scr->snap_rows + (lines > 0 ? top_left_y + count :
+					 top_left_y),
+		       0, sizeof(VGASnapRow *) * n);
+	}
+	else
+		vga_rows_changed(scr, top_left_y, rows);
+
+	for (y = 0; y < count; y++, src += step, dst += step)
+	{
+		if (!full_width)
+		{
+			memmove(scr->video_buf + dst * pvt->cols + top_left_x,
+				scr->video_buf + src * pvt->cols + top_left_x,
+				sizeof(vga_charcell) * cols);
+			/* Neighbouring columns didn't move; rebuild later */
+			scr->run_count[dst] = 0;
+			for (i = 0; i < VGA_GLYPH_MAP_WORDS; i++)
+				ROW_GLYPH_MAP(scr, dst)[i] |=
+					ROW_GLYPH_MAP(scr, src)[i];
+			continue;
 		}
+		memcpy(ROW_GLYPH_MAP(scr, dst), ROW_GLYPH_MAP(scr, src),
+		       sizeof(guint32) * VGA_GLYPH_MAP_WORDS);
+		memcpy(scr->runs + dst * pvt->cols,
+		       scr->runs + src * pvt->cols,
+		       sizeof(vga_attr_run) * scr->run_count[src]);
+		scr->run_count[dst] = scr->run_count[src];
+	}
+
+	/* Clear the uncovered lines (this also fixes up their runs) */
+	vga_glyphs_count(vga, scr, top_left_x, lines > 0 ? top_left_y + count :
+			 top_left_y, cols, n, 1);
+	vga_clear_area(vga, attr, top_left_x,
+		       lines > 0 ? top_left_y + count : top_left_y,
+		       cols, n);
+	vga_mark_cells_dirty(vga, scr, top_left_x, top_left_y, cols, rows);
+}
+
+/**
+ * vga_get_attr_runs:
+ * @vga: VGAText object
+ * @row: Row of the video buffer (0-based)
+ * @n_runs: Returns the number of runs
+ *
+ * Get the attribute runs of a row of the video buffer, i.e. the row
+ * split into spans of columns that share a text attribute.  The runs
+ * are in column order and cover the whole row.  The returned array is
+ * owned by the widget and is only valid until it is next written to.
+ */
+const vga_attr_run *
+vga_get_attr_runs(VGAText *vga, int row, int *n_runs)
+{
+	g_return_val_if_fail(vga != NULL, NULL);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), NULL);
+	g_return_val_if_fail(n_runs != NULL, NULL);
+	g_return_val_if_fail(row >= 0 && row < vga->pvt->rows, NULL);
+
+	return vga_row_runs(vga, vga->pvt->scr, row, n_runs);
+}
+
+static void
+vga_snap_row_unref(VGASnapRow *line)
+{
+	if (g_atomic_int_dec_and_test(&line->refs))
+		g_free(line);
+}
+
+/* Lines of @scr were written to, so they can't be shared any more */
+static void
+vga_rows_changed(VGAScreen *scr, int top_y, int rows)
+{
+	int y;
+
+	for (y = top_y; y < top_y + rows; y++)
+	{
+		if (scr->snap_rows[y] == NULL)
+			continue;
+		vga_snap_row_unref(scr->snap_rows[y]);
+		scr->snap_rows[y] = NULL;
 	}
-	vga_mark_region_dirty(vga, top_left_x, top_left_y, cols, rows);
+}
+
+/**
+ * vga_snapshot_new:
+ * @vga: VGAText object
+ *
+ * Take an immutable snapshot of the selected console's video buffer
+ * and cursor.  Lines are shared, refcounted, with the console and with
+ * earlier snapshots for as long as they stay unchanged, so only the
+ * lines written to since the last snapshot are copied.  Lines that
+ * just scrolled with vga_scroll_rows() are still shared.
+ *
+ * The snapshot stays valid whatever happens to the widget, and may be
+ * read (and unreffed) from any thread.
+ *
+ * Returns: a new snapshot, to be freed with vga_snapshot_unref()
+ */
+VGASnapshot *
+vga_snapshot_new(VGAText *vga)
+{
+	struct _VGATextPrivate *pvt;
+	VGAScreen *scr;
+	VGASnapshot *snap;
+	VGASnapRow *line;
+	int y;
+
+	g_return_val_if_fail(vga != NULL, NULL);
+	g_return_val_if_fail(VGA_IS_TEXT(vga), NULL);
+	pvt = vga->pvt;
+	scr = pvt->scr;
+
+	snap = g_malloc(sizeof(VGASnapshot) + sizeof(VGASnapRow *) * pvt->rows);
+	snap->refs = 1;
+	snap->cols = pvt->cols;
+	snap->rows = pvt->rows;
+	snap->cursor_visible = scr->cursor_visible;
+	snap->cursor_x = scr->cursor_x;
+	snap->cursor_y = scr->cursor_y;
+	snap->lines = (VGASnapRow **) (snap + 1);
+
+	for (y = 0; y < pvt->rows; y++)
+	{
+		line = scr->snap_rows[y];
+		if (line == NULL)
+		{
+			line = g_malloc(sizeof(VGASnapRow) +
+					sizeof(vga_charcell) * pvt->cols);
+			line->refs = 1;		/* The console's */
+			line->cols = pvt->cols;
+			line->cells = (vga_charcell *) (line + 1);
+			memcpy(line->cells, scr->video_buf + y * pvt->cols,
+			       sizeof(vga_charcell) * pvt->cols);
+			scr->snap_rows[y] = line;
+		}
+		g_atomic_int_inc(&line->refs);
+		snap->lines[y] = line;
+	}
+
+	return snap;
+}
+
+VGASnapshot *
+vga_snapshot_ref(VGASnapshot *snap)
+{
+	g_return_val_if_fail(snap != NULL, NULL);
+
+	g_atomic_int_inc(&snap->refs);
+	return snap;
+}
+
+void
+vga_snapshot_unref(VGASnapshot *snap)
+{
+	int y;
+
+	g_return_if_fail(snap != NULL);
+
+	if (!g_atomic_int_dec_and_test(&snap->refs))
+		return;
+	for (y = 0; y < snap->rows; y++)
+		vga_snap_row_unref(snap->lines[y]);
+	g_free(snap);
+}
+
+int
+vga_snapshot_get_cols(VGASnapshot *snap)
+{
+	g_return_val_if_fail(snap != NULL, 0);
+
+	return snap->cols;
+}
+
+int
+vga_snapshot_get_rows(VGASnapshot *snap)
+{
+	g_return_val_if_fail(snap != NULL, 0);
+
+	return snap->rows;
+}
+
+/* The cells of line @row (0-based) of the snapshot, cols long */
+const vga_charcell *
+vga_snapshot_get_line(VGASnapshot *snap, int row)
+{
+	g_return_val_if_fail(snap != NULL, NULL);
+	g_return_val_if_fail(row >= 0 && row < snap->rows, NULL);
+
+	return snap->lines[row]->cells;
+}
+
+/* Where the cursor was, and whether it was visible */
+gboolean
+vga_snapshot_get_cursor(VGASnapshot *snap, int *x, int *y)
+{
+	g_return_val_if_fail(snap != NULL, FALSE);
+
+	if (x != NULL)
+		*x = snap->cursor_x;
+	if (y != NULL)
+		*y = snap->cursor_y;
+	return snap->cursor_visible;
+}
+
+/*
+ * Whether line @row of two snapshots is the very same shared line,
+ * i.e. it is known not to have changed in between.  Lines that were
+ * rewritten with the same contents don't count as the same.  Cheap
+ * enough to find what to send when mirroring a screen.
+ */
+gboolean
+vga_snapshot_same_line(VGASnapshot *a, VGASnapshot *b, int row)
+{
+	g_return_val_if_fail(a != NULL && b != NULL, FALSE);
+
+	if (row < 0 || row >= a->rows || row >= b->rows)
+		return FALSE;
+	return a->lines[row] == b->lines[row];
 }
 
 /* Clear screen / eol will be done in the terminal widget since it is
@@ -75,6 +75,14 @@ typedef enum
 #define BLINK(col) (col | 0x80)
 #define ATTR(fg, bg) ((bg << 4) | fg)
 
+/* Text grid geometry limits, see vga_set_size() */
+#define VGA_DEFAULT_COLS	80
+#define VGA_DEFAULT_ROWS	25
+#define VGA_MAX_COLS		255
+#define VGA_MAX_ROWS		100
+#define VGA_MAX_CANVAS_ROWS	4096	/* See vga_set_canvas_rows() */
+#define VGA_MAX_CONSOLES	12	/* See vga_set_consoles() */
+
 
 G_BEGIN_DECLS
 
@@ -104,8 +112,11 @@ typedef struct _VGATextClass
 	guint contents_changed_signal;
 	guint refresh_window_signal;
 	guint move_window_signal;
+	guint grid_resized_signal;
+
+	/* Default handler for "grid-resized" (new cols, rows) */
+	void (*grid_resized)(struct _VGAText *vga, int cols, int rows);
 
-	gpointer reserved1;
 	gpointer reserved2;
 	gpointer reserved3;
 	gpointer reserved4;
@@ -121,6 +132,30 @@ typedef struct
 	guchar attr;		/* The text attribute */
 } vga_charcell;
 
+/*
+ * A span of columns in a row that all share the same text attribute.
+ * See vga_get_attr_runs().
+ */
+typedef struct
+{
+	guint16 start;		/* First column of the run */
+	guint16 len;		/* Number of columns */
+	guchar attr;		/* The text attribute */
+} vga_attr_run;
+
+/*
+ * Immutable copy of a console's cells and cursor, sharing unchanged
+ * lines with other snapshots.  See vga_snapshot_new().
+ */
+typedef struct _VGASnapshot VGASnapshot;
+
+/*
+ * Called once frame number @frame (or a later one) has been painted to
+ * the window.  See vga_notify_frame().
+ */
+typedef void (*VGAFrameFunc) (struct _VGAText *vga, guint frame,
+			      gpointer data);
+
 GtkType vga_get_type(void);
 
 #define VGA_TYPE_TEXT	               (vga_get_type())
@@ -146,15 +181,23 @@ void		vga_set_palette		(VGAText *vga,
 					 VGAPalette * palette);
 VGAPalette *	vga_get_palette		(VGAText *vga);
 VGAFont *	vga_get_font		(VGAText *vga);
+VGAFont *	vga_get_font_writable	(VGAText *vga);
 void		vga_refresh_font	(VGAText *vga);
 void		vga_set_font		(VGAText *vga, VGAFont *font);
 void		vga_set_icecolor	(VGAText *vga, gboolean status);
 gboolean	vga_get_icecolor	(VGAText *vga);
+void		vga_set_scale		(VGAText *vga, int scale);
+int		vga_get_scale		(VGAText *vga);
+void		vga_set_nine_dot	(VGAText *vga, gboolean enabled);
+gboolean	vga_get_nine_dot	(VGAText *vga);
 void		vga_put_char		(VGAText *vga, guchar c,
 					 guchar attr,
 					int col, int row);
 void		vga_put_string		(VGAText *vga, guchar *s,
 					 guchar attr, int col, int row);
+void		vga_put_cells		(VGAText *vga,
+					 const vga_charcell *cells,
+					 int count, int col, int row);
 guchar *	vga_get_video_buf	(VGAText *vga);
 guchar *	vga_get_sec_buf		(VGAText *vga);
 int		vga_video_buf_size	(VGAText *vga);
@@ -168,13 +211,53 @@ void		vga_mark_region_dirty	(VGAText *vga,
 					int top_left_x, int top_left_y,
 					int cols, int rows);
 void		vga_refresh		(VGAText *vga);
+guint		vga_flush		(VGAText *vga);
+guint		vga_flush_region	(VGAText *vga,
+					 int top_left_x, int top_left_y,
+					 int cols, int rows);
+guint		vga_get_frame		(VGAText *vga);
+guint		vga_get_presented_frame	(VGAText *vga);
+void		vga_notify_frame	(VGAText *vga, guint frame,
+					 VGAFrameFunc func, gpointer data);
+void		vga_set_backlog		(VGAText *vga, guint bytes);
+guint		vga_get_backlog		(VGAText *vga);
+gboolean	vga_frame_wanted	(VGAText *vga);
+void		vga_yield_frame		(VGAText *vga);
 int		vga_get_rows		(VGAText *vga);
 int		vga_get_cols		(VGAText *vga);
+gboolean	vga_set_size		(VGAText *vga, int cols, int rows);
+gboolean	vga_set_canvas_rows	(VGAText *vga, int rows);
+int		vga_get_canvas_rows	(VGAText *vga);
+int		vga_get_view_rows	(VGAText *vga);
+void		vga_set_view_top	(VGAText *vga, int row);
+int		vga_get_view_top	(VGAText *vga);
 void		vga_clear_area		(VGAText *vga, guchar attr,
 					 int top_left_x,
 					 int top_left_y, int cols, int rows);
 void		vga_video_buf_clear	(VGAText *vga);
+void		vga_scroll_rows		(VGAText *vga, guchar attr,
+					 int top_left_x, int top_left_y,
+					 int cols, int rows, int lines);
+const vga_attr_run *
+		vga_get_attr_runs	(VGAText *vga, int row,
+					 int *n_runs);
 void		vga_show_secondary	(VGAText *vga, gboolean enabled);
+gboolean	vga_set_consoles	(VGAText *vga, int n);
+int		vga_get_consoles	(VGAText *vga);
+void		vga_select_console	(VGAText *vga, int n);
+int		vga_get_selected_console (VGAText *vga);
+void		vga_show_console	(VGAText *vga, int n);
+int		vga_get_shown_console	(VGAText *vga);
+VGASnapshot *	vga_snapshot_new	(VGAText *vga);
+VGASnapshot *	vga_snapshot_ref	(VGASnapshot *snap);
+void		vga_snapshot_unref	(VGASnapshot *snap);
+int		vga_snapshot_get_cols	(VGASnapshot *snap);
+int		vga_snapshot_get_rows	(VGASnapshot *snap);
+const vga_charcell *
+		vga_snapshot_get_line	(VGASnapshot *snap, int row);
+gboolean	vga_snapshot_get_cursor	(VGASnapshot *snap, int *x, int *y);
+gboolean	vga_snapshot_same_line	(VGASnapshot *a, VGASnapshot *b,
+					 int row);
 
 G_END_DECLS
 
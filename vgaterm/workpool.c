@@ -0,0 +1,280 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "workpool.h"
+
+/* More than this many threads just fight over memory bandwidth */
+#define WORKPOOL_MAX_THREADS	7
+
+typedef struct {
+	WorkPool *pool;
+	int worker;
+} WorkPoolThread;
+
+/*
+ * Take jobs off the current batch until there are none left.  Called
+ * with the lock held, and returns with it held.
+ */
+static void workpool_work(WorkPool *pool, int worker)
+{
+	WorkPoolFunc func;
+	void *data;
+	int job;
+
+	while (pool->next_job < pool->n_jobs)
+	{
+		job = pool->next_job++;
+		func = pool->func;
+		data = pool->data;
+
+		pthread_mutex_unlock(&pool->lock);
+		func(data, job, worker);
+		pthread_mutex_lock(&pool->lock);
+
+		if (--pool->jobs_left == 0)
+			pthread_cond_signal(&pool->done);
+	}
+}
+
+static void *workpool_thread(void *ptr)
+{
+	WorkPoolThread *t = ptr;
+	WorkPool *pool = t->pool;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;)
+	{
+		while (!pool->quit && pool->batch == seen)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->quit)
+			break;
+		seen = pool->batch;
+		workpool_work(pool, t->worker);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	free(t);
+	return NULL;
+}
+
+/*
+ * Create a pool of @n_threads workers.  With 0 threads (or if they
+ * can't be started) workpool_run() just runs everything itself.
+ */
+WorkPool * workpool_new(int n_threads)
+{
+	WorkPool *pool;
+	WorkPoolThread *t;
+	int i;
+
+	pool = calloc(1, sizeof(WorkPool));
+	if (pool == NULL)
+		return NULL;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	if (n_threads > 0)
+		pool->threads = malloc(sizeof(pthread_t) * n_threads);
+	if (pool->threads == NULL)
+		return pool;
+
+	for (i = 0; i < n_threads; i++)
+	{
+		t = malloc(sizeof(WorkPoolThread));
+		if (t == NULL)
+			break;
+		t->pool = pool;
+		t->worker = i + 1;
+		if (pthread_create(&pool->threads[i], NULL, workpool_thread,
+				   t) != 0)
+		{
+			free(t);
+			break;
+		}
+		pool->n_threads++;
+	}
+
+	return pool;
+}
+
+void workpool_destroy(WorkPool *pool)
+{
+	int i;
+
+	if (pool == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+	free(pool->threads);
+
+	pthread_cond_destroy(&pool->idle);
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+/*
+ * Run @func for jobs 0..@n_jobs-1, spread over the pool and the calling
+ * thread, and wait for all of them to finish.  Jobs are handed out one
+ * at a time as threads come free, so uneven jobs still balance out.
+ * Any number of threads can share a pool: only one batch runs at a
+ * time, and the others wait their turn.
+ */
+void workpool_run(WorkPool *pool, int n_jobs, WorkPoolFunc func, void *data)
+{
+	int i;
+
+	if (pool->n_threads == 0 || n_jobs <= 1)
+	{
+		for (i = 0; i < n_jobs; i++)
+			func(data, i, 0);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	pool->busy = 1;
+	pool->func = func;
+	pool->data = data;
+	pool->n_jobs = n_jobs;
+	pool->next_job = 0;
+	pool->jobs_left = n_jobs;
+	pool->batch++;
+	pthread_cond_broadcast(&pool->start);
+
+	workpool_work(pool, 0);
+	while (pool->jobs_left > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pool->busy = 0;
+	pthread_cond_signal(&pool->idle);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* One thread per extra CPU, within reason */
+int workpool_default_threads(void)
+{
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	if (n < 0)
+		n = 0;
+	if (n > WORKPOOL_MAX_THREADS)
+		n = WORKPOOL_MAX_THREADS;
+
+	return (int) n;
+}
+
+#ifdef UNIT_TEST
+/* Compile with: gcc workpool.c -o workpool-test -DUNIT_TEST -lpthread */
+#include <assert.h>
+#include <stdio.h>
+
+#define JOBS	1000
+
+static int hits[JOBS];
+static int by_worker[WORKPOOL_MAX_THREADS + 1];
+static int shared_hits[2][JOBS];
+
+static void count_job(void *data, int job, int worker)
+{
+	int *batch = data;
+
+	hits[job] += *batch;
+	__sync_fetch_and_add(&by_worker[worker], 1);
+}
+
+static void shared_job(void *data, int job, int worker)
+{
+	int *counts = data;
+
+	(void) worker;
+	counts[job]++;
+}
+
+static WorkPool *shared_pool;
+
+/* Submit batches to a pool another thread is submitting to as well */
+static void *shared_submitter(void *data)
+{
+	int batch;
+
+	for (batch = 0; batch < 50; batch++)
+		workpool_run(shared_pool, JOBS, shared_job, data);
+	return NULL;
+}
+
+int main(void)
+{
+	WorkPool *pool;
+	pthread_t submitters[2];
+	int i, batch, n;
+
+	pool = workpool_new(3);
+	assert(pool != NULL && pool->n_threads == 3);
+
+	/* Every job runs exactly once per batch, batch after batch */
+	for (batch = 1; batch <= 50; batch++)
+		workpool_run(pool, JOBS, count_job, &batch);
+	for (i = 0; i < JOBS; i++)
+		assert(hits[i] == 50 * 51 / 2);
+	for (i = 0, n = 0; i <= 3; i++)
+		n += by_worker[i];
+	assert(n == 50 * JOBS);
+
+	/* Empty batches are fine */
+	workpool_run(pool, 0, count_job, &batch);
+	workpool_destroy(pool);
+
+	/* Threads sharing a pool take turns */
+	shared_pool = workpool_new(3);
+	for (i = 0; i < 2; i++)
+		assert(pthread_create(&submitters[i], NULL, shared_submitter,
+				      shared_hits[i]) == 0);
+	for (i = 0; i < 2; i++)
+		pthread_join(submitters[i], NULL);
+	for (i = 0; i < JOBS; i++)
+		assert(shared_hits[0][i] == 50 && shared_hits[1][i] == 50);
+	workpool_destroy(shared_pool);
+
+	/* Without threads everything runs in the caller */
+	pool = workpool_new(0);
+	batch = 1;
+	workpool_run(pool, JOBS, count_job, &batch);
+	for (i = 0; i < JOBS; i++)
+		assert(hits[i] == 50 * 51 / 2 + 1);
+	workpool_destroy(pool);
+
+	printf("All tests passed\n");
+
+	return 0;
+}
+#endif
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2002-2011 Nate Case
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of version 2 of the GNU General Public License as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Small pool of worker threads for running a batch of independent jobs
+ *  (e.g. rasterizing rows) in parallel.  The calling thread works on the
+ *  batch too, and workpool_run() only returns once all of it is done.
+ */
+
+#ifndef __WORKPOOL_H__
+#define __WORKPOOL_H__
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Run job number @job of a batch.  @worker is 0 for the calling thread
+ * and 1..n_threads for the pool's own, so it can index per-thread
+ * scratch space.
+ */
+typedef void (*WorkPoolFunc) (void *data, int job, int worker);
+
+typedef struct {
+	int n_threads;			/* Not counting the caller */
+	pthread_t *threads;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;		/* A batch is ready */
+	pthread_cond_t done;		/* The last job of it finished */
+	pthread_cond_t idle;		/* No batch is running */
+
+	WorkPoolFunc func;		/* Current batch */
+	void *data;
+	int n_jobs, next_job, jobs_left;
+	unsigned long batch;		/* Bumped for each batch */
+	int busy;			/* A batch is running */
+	int quit;
+} WorkPool;
+
+WorkPool *	workpool_new		(int n_threads);
+void		workpool_destroy	(WorkPool *pool);
+void		workpool_run		(WorkPool *pool, int n_jobs,
+					 WorkPoolFunc func, void *data);
+int		workpool_default_threads (void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif	/* __WORKPOOL_H__ */